@@ -104,6 +104,7 @@ void CALLBACK GSsetGameCRC(int crc, int gameoptions);
 
 void CALLBACK GSreset();
 s32 CALLBACK GSfreeze(int mode, freezeData *data);
+void CALLBACK GSsetupRecording(const char *filename);
 
 #ifdef __cplusplus
 } // End extern "C"
@@ -159,6 +159,20 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled"
    },
+   {
+      BOOL_PCSX2_OPT_EE_PROFILER,
+      "System: Profile EE Blocks",
+      "Profile EE Blocks",
+      "Counts how often each block of the EE recompiler runs. When disabled again, or when the content is closed, a report of the blocks and functions taking the most EE cycles is written to the 'saves/pcsx2' directory. Slows down emulation slightly while enabled.",
+      NULL,
+      "system_options",
+      {
+         {"disabled", NULL},
+         {"enabled", NULL},
+         {NULL, NULL},
+      },
+      "disabled"
+   },
    {
       STRING_PCSX2_OPT_MEMCARD_SLOT_1,
       "Memory Card: Slot 1",
@@ -196,6 +210,7 @@ struct retro_core_option_v2_definition option_defs_us[] = {
          {"D3D11", NULL},
 #endif
          {"OpenGL", NULL},
+         {"Software (Headless)", NULL},
          {NULL, NULL},
       },
       "Auto"
@@ -418,6 +433,20 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled"
    },
+   {
+      BOOL_PCSX2_OPT_GS_TRACE,
+      "Video: Record GS Trace",
+      "Record GS Trace",
+      "Records everything sent to the GS into a .gstrace file in the 'saves/pcsx2' directory, for replaying it offline with the GS replayer. Traces grow quickly, only enable it for a short time. Loading a state stops the recording.",
+      NULL,
+      "video_options",
+      {
+         {"disabled", NULL},
+         {"enabled", NULL},
+         {NULL, NULL},
+      },
+      "disabled"
+   },
    {
       BOOL_PCSX2_OPT_FRAMESKIP,
       "Video: Frame Skip",
@@ -755,6 +784,24 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "3"
    },
+   {
+      INT_PCSX2_OPT_AUDIO_BLOCK_SIZE,
+      "Emulation: Audio Block Size",
+      "Audio Block Size",
+      "Number of stereo samples sent to the frontend at once. 'Per Frame' sends the audio of a whole frame in one go, smaller blocks lower audio latency at the cost of more frontend calls.",
+      NULL,
+      "emulation_options",
+      {
+         {"0", "Per Frame (default)"},
+         {"64", "64"},
+         {"128", "128"},
+         {"256", "256"},
+         {"512", "512"},
+         {"1024", "1024"},
+         {NULL, NULL},
+      },
+      "0"
+   },
    {
       BOOL_PCSX2_OPT_USERHACK_ALIGN_SPRITE,
       "Hack: Align Sprite",
@@ -9,6 +9,7 @@
 #include "AppCommon.h"
 #include "App.h"
 
+#include <chrono>
 #include <cstdint>
 #include <libretro.h>
 #include <libretro_core_options.h>
@@ -26,15 +27,22 @@
 #include "svnrev.h"
 #include "disk_control.h"
 #include "SPU2/Global.h"
+#include "SPU2/spu2.h"
+#include "SaveState.h"
+#include "Patch.h"
+#include "DeltaState.h"
 #include "ps2/BiosTools.h"
 #include "memcard_retro.h"
 
 
 
 #include "MTVU.h"
+#include "Elfheader.h"
+#include "x86/iR5900Profiler.h"
 
 #ifdef PERF_TEST
 static struct retro_perf_callback perf_cb;
+static void delta_state_benchmark();
 
 #define RETRO_PERFORMANCE_INIT(name)                 \
 	retro_perf_tick_t current_ticks;                 \
@@ -95,6 +103,64 @@ static std::vector<std::string> bios_files;
 static std::vector<std::string> custom_memcard_list_slot1;
 static std::vector<std::string> custom_memcard_list_slot2;
 
+// savestate buffers, see retro_serialize()
+static VmStateBuffer state_buffer;
+static VmStateBuffer state_scratch;
+static std::vector<u8> state_changed;
+static size_t state_size = 0;
+static int state_image_size = 0;
+// retro_run calls left with the EE in lockstep, see pause_vm()
+static int vm_lockstep_frames = 0;
+static void resume_vm();
+static void end_vm_lockstep();
+
+static bool gs_trace_enabled = false;
+
+// Starts or stops the GS trace recording to follow the option.  Only called from the MTGS
+// thread (or before it runs), since it goes straight to the GS plugin.
+static void update_gs_trace()
+{
+	const bool enabled = option_value(BOOL_PCSX2_OPT_GS_TRACE, KeyOptionBool::return_type);
+	if (enabled == gs_trace_enabled)
+		return;
+
+	gs_trace_enabled = enabled;
+	if (enabled)
+	{
+		wxFileName trace(save_dir_root.GetPath(), wxDateTime::Now().Format("gs_%Y%m%d_%H%M%S.gstrace"));
+		log_cb(RETRO_LOG_INFO, "Recording GS trace to %s\n", (const char*)trace.GetFullPath().ToUTF8());
+		GSsetupRecording(trace.GetFullPath().ToUTF8());
+	}
+	else
+		GSsetupRecording(nullptr);
+}
+
+static bool ee_profiler_enabled = false;
+
+// Counts the EE recompiler's block executions while the option is on, and writes the report
+// when it gets turned off or the game is unloaded.
+static void update_ee_profiler(bool enabled)
+{
+	if (enabled == ee_profiler_enabled)
+		return;
+
+	ee_profiler_enabled = enabled;
+	eeBlockProfiler.SetEnabled(enabled);
+	if (enabled)
+	{
+		eeBlockProfiler.Clear();
+		log_cb(RETRO_LOG_INFO, "Profiling EE blocks\n");
+		return;
+	}
+
+	wxFileName report(save_dir_root.GetPath(), wxDateTime::Now().Format("ee_profile_%Y%m%d_%H%M%S.txt"));
+	if (eeBlockProfiler.WriteReport((const char*)report.GetFullPath().ToUTF8(), ElfCRC))
+		log_cb(RETRO_LOG_INFO, "Wrote EE block profile to %s\n", (const char*)report.GetFullPath().ToUTF8());
+	else
+		log_cb(RETRO_LOG_WARN, "Unable to write EE block profile to %s\n", (const char*)report.GetFullPath().ToUTF8());
+	eeBlockProfiler.Clear();
+}
+
 void retro_set_video_refresh(retro_video_refresh_t cb)
 {
 	video_cb = cb;
@@ -383,6 +449,9 @@ void retro_init(void)
 		g_Conf->EmuOptions.Enable60fpsPatches = (option_value(BOOL_PCSX2_OPT_ENABLE_60FPS_PATCHES, KeyOptionBool::return_type));
 		g_Conf->EmuOptions.EnableWideScreenPatches = option_value(BOOL_PCSX2_OPT_ENABLE_WIDESCREEN_PATCHES, KeyOptionBool::return_type);
 		g_Conf->EmuOptions.GS.VsyncQueueSize = option_value(INT_PCSX2_OPT_VSYNC_MTGS_QUEUE, KeyOptionInt::return_type);
+		SndBuffer::SetBlockSize(option_value(INT_PCSX2_OPT_AUDIO_BLOCK_SIZE, KeyOptionInt::return_type));
+		update_gs_trace();
+		update_ee_profiler(option_value(BOOL_PCSX2_OPT_EE_PROFILER, KeyOptionBool::return_type));
 		g_Conf->EmuOptions.EnableCheats = option_value(BOOL_PCSX2_OPT_ENABLE_CHEATS, KeyOptionBool::return_type);
 
 
@@ -461,14 +530,14 @@ void retro_get_system_info(retro_system_info* info)
 #endif
 
 	info->library_name = "pcsx2 (alpha)";
-	info->valid_extensions = "elf|iso|ciso|chd|cso|cue|bin|m3u";
+	info->valid_extensions = "elf|iso|ciso|chd|cso|zso|cue|bin|m3u";
 	info->need_fullpath = true;
 	info->block_extract = true;
 }
 
 void retro_get_system_av_info(retro_system_av_info* info)
 {
-	if ( !std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software") || !std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Null"))
+	if ( !std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software") || !std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software (Headless)") || !std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Null"))
 	{
 		info->geometry.base_width = 640;
 		info->geometry.base_height = 448;
@@ -482,6 +551,13 @@ void retro_get_system_av_info(retro_system_av_info* info)
 	info->geometry.max_width = info->geometry.base_width;
 	info->geometry.max_height = info->geometry.base_height;
 
+	// Headless software frames are sent at the size the GS outputs them.
+	if (!std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software (Headless)"))
+	{
+		info->geometry.max_width = 1280;
+		info->geometry.max_height = 1024;
+	}
+
 	if (option_value(INT_PCSX2_OPT_ASPECT_RATIO, KeyOptionInt::return_type) == 0)
 		info->geometry.aspect_ratio = 4.0f / 3.0f;
 	else
@@ -500,11 +576,13 @@ void retro_reset(void)
 static void context_reset(void)
 {
 	GetMTGS().OpenGS();
+	update_gs_trace();
 }
 
 static void context_destroy(void)
 {
 	GetMTGS().FinishTaskInThread();
+	gs_trace_enabled = false;
 
 	while (pcsx2->HasPendingEvents())
 		pcsx2->ProcessPendingEvents();
@@ -623,6 +701,9 @@ bool retro_load_game(const struct retro_game_info* game)
 	}
 
 	ResetContentStuffs();
+	state_size = 0;
+	state_image_size = 0;
+	mmap_EnableDirtyPageTracking(false);
 
 	const char* selected_bios = sel_bios_path.c_str();
 	if (selected_bios == NULL)
@@ -842,6 +923,13 @@ bool retro_load_game(const struct retro_game_info* game)
 #endif
 	else if (!std::strcmp(option_renderer, "Null"))
 		context_type = RETRO_HW_CONTEXT_NONE;
+	else if (!std::strcmp(option_renderer, "Software (Headless)"))
+	{
+		// The software renderer presents from host memory, there is no hw context to wait for.
+		hw_render.context_type = RETRO_HW_CONTEXT_NONE;
+		context_reset();
+		return true;
+	}
 
 	return set_hw_render(context_type);
 }
@@ -854,6 +942,10 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info* i
 
 void retro_unload_game(void)
 {
+	end_vm_lockstep();
+	state_size = 0;
+	state_image_size = 0;
+	mmap_EnableDirtyPageTracking(false);
 	//	GetMTGS().FinishTaskInThread();
 	//		GetMTGS().CloseGS();
 	GetMTGS().FinishTaskInThread();
@@ -861,6 +953,8 @@ void retro_unload_game(void)
 	while (pcsx2->HasPendingEvents())
 		pcsx2->ProcessPendingEvents();
 	GetMTGS().CloseGS();
+	gs_trace_enabled = false;
+	update_ee_profiler(false);
 
 	while (pcsx2->HasPendingEvents())
 		pcsx2->ProcessPendingEvents();
@@ -874,7 +968,12 @@ void retro_run(void)
 	{
 		log_cb(RETRO_LOG_INFO, "Options Change detected...\n");
 		EmuConfig.GS.VsyncQueueSize = option_value(INT_PCSX2_OPT_VSYNC_MTGS_QUEUE, KeyOptionInt::return_type);
+		// keep the setting across the core thread resumes done by savestates
+		g_Conf->EmuOptions.GS.VsyncQueueSize = EmuConfig.GS.VsyncQueueSize;
+		SndBuffer::SetBlockSize(option_value(INT_PCSX2_OPT_AUDIO_BLOCK_SIZE, KeyOptionInt::return_type));
 		GSUpdateOptions();
+		update_gs_trace();
+		update_ee_profiler(option_value(BOOL_PCSX2_OPT_EE_PROFILER, KeyOptionBool::return_type));
 		Input::RumbleEnabled(
 			option_value(BOOL_PCSX2_OPT_GAMEPAD_RUMBLE_ENABLE, KeyOptionBool::return_type),
 			option_value(INT_PCSX2_OPT_GAMEPAD_RUMBLE_FORCE, KeyOptionInt::return_type)
@@ -889,23 +988,249 @@ void retro_run(void)
 	RETRO_PERFORMANCE_INIT(pcsx2_run);
 	RETRO_PERFORMANCE_START(pcsx2_run);
 
+	// A parked EE only resumes here, see pause_vm()
+	if (vm_lockstep_frames > 0 && --vm_lockstep_frames == 0)
+		end_vm_lockstep();
+	else
+		resume_vm();
+
 	GetMTGS().ExecuteTaskInThread();
 
+	// In lockstep the vsync just presented asked the EE to pause at the next one, wait for
+	// it to get there.
+	const SysThreadBase::ExecutionMode mode = GetCoreThread().GetExecutionMode();
+	if (mode == SysThreadBase::ExecMode_Pausing || mode == SysThreadBase::ExecMode_Paused)
+		GetMTGS().FlushRingUntilEEPaused();
+
+	SndBuffer::Flush();
+
 	RETRO_PERFORMANCE_STOP(pcsx2_run);
+
+#ifdef PERF_TEST
+	delta_state_benchmark();
+#endif
+}
+
+// --------------------------------------------------------------------------------------
+//  Savestates
+// --------------------------------------------------------------------------------------
+// The whole machine (EE/IOP/VU memory and internals, GS and SPU2) is frozen into a single
+// buffer that is kept around between calls, so frontends can snapshot every frame for
+// rewind and run-ahead without going through the allocator or the disk.
+//
+// Layout: retro_state_header, FreezeAll() block, GSfreeze block, SPU2freeze block.
+
+struct retro_state_header
+{
+	u32 magic;
+	u32 version;
+	u32 vm_size;
+	u32 gs_size;
+	u32 spu2_size;
+};
+
+static const u32 RETRO_STATE_MAGIC = 0x53325350; // "PS2S"
+
+static void dropped_frame_cb(const void* data, unsigned width, unsigned height, size_t pitch)
+{
+}
+
+// Savestates need the EE parked at a vsync, with the GS caught up with it.  Once a
+// savestate has been asked for, the EE runs in lockstep with retro_run for a while: each
+// vsync waits for the frontend to process it, which also requests the next pause, and
+// retro_run returns with the EE parked at the following vsync (see ExecuteTaskInThread()
+// and PostVsyncStart() in MTGS.cpp).  Savestate calls in between then never have to run
+// the emulation, and the EE stays parked until the next retro_run.
+static const int VM_LOCKSTEP_FRAMES = 300;
+
+static void pause_vm()
+{
+	vm_lockstep_frames = VM_LOCKSTEP_FRAMES;
+
+	retro_video_refresh_t saved_video_cb = video_cb;
+	video_cb = dropped_frame_cb;
+
+	if (GetCoreThread().GetExecutionMode() == SysThreadBase::ExecMode_Opened)
+	{
+		// First savestate since the last lockstep: the EE may be a few frames ahead, park it
+		// where it is.  The frames it completed are not ours to present outside of
+		// retro_run, so they are dropped.
+		GetMTGS().m_PauseAtVsync = true;
+		GetMTGS().m_EEPaused = false;
+		GetCoreThread().Pause(false);
+		GetMTGS().FlushRingUntilEEPaused();
+	}
+	else
+		GetMTGS().FlushRingInThread();
+
+	video_cb = saved_video_cb;
+}
+
+static void resume_vm()
+{
+	if (GetCoreThread().GetExecutionMode() != SysThreadBase::ExecMode_Paused)
+		return;
+
+	GetMTGS().m_EEPaused = false;
+	GetCoreThread().Resume();
 }
 
+static void end_vm_lockstep()
+{
+	vm_lockstep_frames = 0;
+	GetMTGS().m_PauseAtVsync = false;
+	resume_vm();
+}
+
+// Saves the paused VM into state_buffer, returns the number of bytes used or 0 on failure.
+static size_t save_vm()
+{
+	freezeData gs = {0, nullptr};
+	freezeData spu2 = {0, nullptr};
+	if (GSfreeze(FREEZE_SIZE, &gs) != 0 || SPU2freeze(FREEZE_SIZE, &spu2) != 0)
+		return 0;
+
+	// state_buffer is refreshed in place: only ram pages written since the previous save are
+	// copied, and the rest of the state is diffed against what is already there.
+	mmap_EnableDirtyPageTracking(true);
+
+	retro_state_header header = {RETRO_STATE_MAGIC, g_SaveVersion, 0, (u32)gs.size, (u32)spu2.size};
+
+	memDeltaSavingState saveme(state_buffer, state_image_size, state_changed);
+	state_image_size = 0;
+
+	saveme.Freeze(header);
+	saveme.FreezeAll();
+	header.vm_size = saveme.GetCurrentPos() - sizeof(header);
+	mmap_ResetDirtyPages();
+
+	state_scratch.MakeRoomFor(std::max(gs.size, spu2.size));
+
+	gs.data = (s8*)state_scratch.GetPtr();
+	if (GSfreeze(FREEZE_SAVE, &gs) != 0)
+		return 0;
+	saveme.FreezeMem(gs.data, gs.size);
+
+	spu2.data = (s8*)state_scratch.GetPtr();
+	if (SPU2freeze(FREEZE_SAVE, &spu2) != 0)
+		return 0;
+	saveme.FreezeMem(spu2.data, spu2.size);
+
+	if (memcmp(state_buffer.GetPtr(), &header, sizeof(header)) != 0)
+	{
+		memcpy(state_buffer.GetPtr(), &header, sizeof(header));
+		state_changed[0] = 1;
+	}
+
+	state_image_size = saveme.GetCurrentPos();
+	return state_image_size;
+}
+
+// Loads the paused VM from the first 'size' bytes of state_buffer.
+static bool load_vm(size_t size)
+{
+	retro_state_header header;
+	memcpy(&header, state_buffer.GetPtr(), sizeof(header));
+
+	if (header.magic != RETRO_STATE_MAGIC || header.version != g_SaveVersion)
+	{
+		log_cb(RETRO_LOG_ERROR, "Savestate was made by an incompatible version.\n");
+		return false;
+	}
+	if (sizeof(header) + header.vm_size + header.gs_size + header.spu2_size > size)
+	{
+		log_cb(RETRO_LOG_ERROR, "Savestate is truncated.\n");
+		return false;
+	}
+
+	memLoadingState loadme(state_buffer);
+	loadme.Freeze(header);
+	loadme.FreezeAll();
+
+	freezeData gs = {(int)header.gs_size, (s8*)loadme.GetBlockPtr()};
+	loadme.CommitBlock(header.gs_size);
+	freezeData spu2 = {(int)header.spu2_size, (s8*)loadme.GetBlockPtr()};
+	loadme.CommitBlock(header.spu2_size);
+
+	return GSfreeze(FREEZE_LOAD, &gs) == 0 && SPU2freeze(FREEZE_LOAD, &spu2) == 0;
+}
+
+#ifdef PERF_TEST
+// Captures a delta savestate every frame, the way a rewind buffer would, and logs how much
+// it costs in bytes and time.
+static void delta_state_benchmark()
+{
+	static DeltaStateRing ring(60, 60);
+
+	if (!GetCoreThread().HasActiveMachine() || !GetMTGS().m_Opened)
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	pause_vm();
+	size_t size = save_vm();
+	const auto saved = std::chrono::steady_clock::now();
+
+	if (!size)
+		return;
+	ring.Capture(state_buffer, size, state_changed);
+
+	static u64 save_us = 0;
+	save_us += std::chrono::duration_cast<std::chrono::microseconds>(saved - start).count();
+
+	const DeltaStateRing::Stats& stats = ring.GetStats();
+	if (stats.Captures < 300)
+		return;
+
+	log_cb(RETRO_LOG_INFO, "Delta savestates: %.1f KB/frame, %.2f ms/frame save + %.2f ms/frame capture (%u keyframes, state %u KB)\n",
+		stats.Bytes / 1024.0 / stats.Captures, save_us / 1000.0 / stats.Captures,
+		stats.Microseconds / 1000.0 / stats.Captures, (uint)stats.Keyframes, (uint)(size / 1024));
+	ring.ResetStats();
+	save_us = 0;
+}
+#endif
+
 size_t retro_serialize_size(void)
 {
-	return 0;
+	if (!GetCoreThread().HasActiveMachine() || !GetMTGS().m_Opened)
+		return 0;
+
+	// The size never changes for a given session, so only measure it once.
+	if (!state_size)
+	{
+		pause_vm();
+		state_size = save_vm();
+	}
+
+	return state_size;
 }
 
 bool retro_serialize(void* data, size_t size)
 {
-	return false;
+	if (!GetCoreThread().HasActiveMachine() || !GetMTGS().m_Opened)
+		return false;
+
+	pause_vm();
+	size_t written = save_vm();
+
+	if (!written || written > size)
+		return false;
+
+	memcpy(data, state_buffer.GetPtr(), written);
+	return true;
 }
+
 bool retro_unserialize(const void* data, size_t size)
 {
-	return false;
+	if (!GetCoreThread().HasActiveMachine() || !GetMTGS().m_Opened || size < sizeof(retro_state_header))
+		return false;
+
+	pause_vm();
+	state_buffer.MakeRoomFor(size);
+	memcpy(state_buffer.GetPtr(), data, size);
+	bool loaded = load_vm(size);
+	state_image_size = loaded ? size : 0;
+
+	return loaded;
 }
 
 unsigned retro_get_region(void)
@@ -930,16 +1255,22 @@ void* retro_get_memory_data(unsigned id)
 
 void retro_cheat_reset(void)
 {
+	ForgetCheats();
 }
 
 void retro_cheat_set(unsigned index, bool enabled, const char* code)
 {
+	int lines = SetCheat(index, enabled, code ? code : "");
+	if (enabled && lines == 0)
+		log_cb(RETRO_LOG_WARN, "Cheat %u: no valid code found\n", index);
 }
 
 retro_audio_sample_t sample_cb;
+retro_audio_sample_batch_t batch_cb;
 
 void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb)
 {
+	batch_cb = cb;
 }
 
 void retro_set_audio_sample(retro_audio_sample_t cb)
@@ -18,6 +18,8 @@
 #define BOOL_PCSX2_OPT_CONSERVATIVE_BUFFER                    "pcsx2_conservative_buffer"
 #define BOOL_PCSX2_OPT_ACCURATE_DATE                          "pcsx2_accurate_date"
 #define BOOL_PCSX2_OPT_PALETTE_CONVERSION                     "pcsx2_palette_conversion"
+#define BOOL_PCSX2_OPT_GS_TRACE                               "pcsx2_gs_trace"
+#define BOOL_PCSX2_OPT_EE_PROFILER                            "pcsx2_ee_profiler"
 
 #define STRING_PCSX2_OPT_BIOS                                 "pcsx2_bios"
 #define STRING_PCSX2_OPT_RENDERER                             "pcsx2_renderer"
@@ -49,6 +51,7 @@
 #define INT_PCSX2_OPT_DITHERING                               "pcsx2_dithering"
 #define INT_PCSX2_OPT_GAMEPAD_L_DEADZONE                      "pcsx2_gamepad_l_deadzone"
 #define INT_PCSX2_OPT_GAMEPAD_R_DEADZONE                      "pcsx2_gamepad_r_deadzone"
+#define INT_PCSX2_OPT_AUDIO_BLOCK_SIZE                        "pcsx2_audio_block_size"
 
 #define INT_PCSX2_OPT_USERHACK_TEXTURE_OFFSET_X_HUNDREDS      "pcsx2_userhack_texture_offset_x_hundreds"
 #define INT_PCSX2_OPT_USERHACK_TEXTURE_OFFSET_X_TENS          "pcsx2_userhack_texture_offset_x_tens"
@@ -5,6 +5,9 @@
 
 #include <wx/dir.h>
 
+#include <algorithm>
+#include <chrono>
+
 
 bool ChdFileReader::CanHandle(const wxString &fileName)
 {
@@ -95,57 +98,317 @@ bool ChdFileReader::Open(const wxString &fileName)
     sector_size = header->unitbytes;
     sector_count = header->unitcount;
     sectors_per_hunk = header->hunkbytes / sector_size;
-    hunk_buffer = new u8[header->hunkbytes];
-    current_hunk = -1;
+    hunk_bytes = header->hunkbytes;
+    hunk_count = header->totalhunks;
 
     delete header;
+
+    chd_chain.clear();
+    for (int d = 0; d <= chd_depth; d++)
+      chd_chain.push_back(static_cast<const char*>(chds[d]));
+
+    quit = false;
+    next_hunk = -1;
+    memzero(stats);
+    SetCacheSize(CHD_CACHE_SIZE_MB, CHD_PREFETCH_HUNKS);
+    for (int i = 0; i < CHD_WORKER_THREADS; i++)
+      workers.emplace_back(&ChdFileReader::WorkerThread, this);
+
     return true;
 }
 
-int ChdFileReader::ReadSync(void *pBuffer, uint sector, uint count)
+// Opens another handle on the file, libchdr handles can't be shared between threads.
+chd_file *ChdFileReader::OpenChain()
+{
+    chd_file *parent = NULL;
+    for (int d = chd_chain.size() - 1; d >= 0; d--) {
+      chd_file *child = NULL;
+      chd_error error = chd_open(chd_chain[d].c_str(), CHD_OPEN_READ, parent, &child);
+      if (error != CHDERR_NONE) {
+        log_cb(RETRO_LOG_ERROR, "chd_open return error: %s\n", chd_error_string(error));
+        if (parent != NULL)
+          chd_close(parent);
+        return NULL;
+      }
+      parent = child;
+    }
+    return parent;
+}
+
+void ChdFileReader::SetCacheSize(uint megabytes, uint prefetch)
+{
+    if (hunk_bytes == 0)
+      return;
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+    prefetch_hunks = prefetch;
+    cache_hunks = std::max<uint>((u64)megabytes * 1024 * 1024 / hunk_bytes, prefetch + 2);
+    Evict();
+}
+
+ChdFileReader::Stats ChdFileReader::GetStats()
+{
+    std::lock_guard<std::mutex> guard(cache_lock);
+    return stats;
+}
+
+bool ChdFileReader::Decompress(chd_file *chd, u32 hunk, u8 *dest)
+{
+    const auto start = std::chrono::steady_clock::now();
+    chd_error error = chd_read(chd, hunk, dest);
+    const u64 us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (error != CHDERR_NONE)
+      log_cb(RETRO_LOG_ERROR, "chd_read return error: %s\n", chd_error_string(error));
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+    stats.decompressed++;
+    stats.decompress_us += us;
+    return error == CHDERR_NONE;
+}
+
+void ChdFileReader::Touch(Hunk &entry)
+{
+    lru.splice(lru.begin(), lru, entry.lru);
+}
+
+// Drops the least recently used hunks until there's room for a new one. Pending hunks are
+// being written by a worker and stay.
+void ChdFileReader::Evict()
+{
+    auto it = lru.end();
+    while (hunks.size() >= cache_hunks && it != lru.begin()) {
+      --it;
+      auto entry = hunks.find(*it);
+      if (entry->second.state == HunkState::Pending)
+        continue;
+      free_buffers.push_back(std::move(entry->second.data));
+      hunks.erase(entry);
+      it = lru.erase(it);
+    }
+}
+
+ChdFileReader::Hunk &ChdFileReader::Insert(std::unique_lock<std::mutex> &lock, u32 hunk, HunkState state)
+{
+    Evict();
+
+    Hunk &entry = hunks[hunk];
+    entry.state = state;
+    if (!free_buffers.empty()) {
+      entry.data = std::move(free_buffers.back());
+      free_buffers.pop_back();
+    } else {
+      entry.data.reset(new u8[hunk_bytes]);
+    }
+    lru.push_front(hunk);
+    entry.lru = lru.begin();
+    return entry;
+}
+
+void ChdFileReader::Queue(std::unique_lock<std::mutex> &lock, u32 hunk, bool urgent)
+{
+    if (hunk >= hunk_count)
+      return;
+
+    auto it = hunks.find(hunk);
+    if (it != hunks.end()) {
+      if (urgent && it->second.state == HunkState::Pending) {
+        auto queued = std::find(queue.begin(), queue.end(), hunk);
+        if (queued != queue.end()) {
+          queue.erase(queued);
+          queue.push_front(hunk);
+        }
+      }
+      return;
+    }
+
+    Insert(lock, hunk, HunkState::Pending);
+    if (urgent)
+      queue.push_front(hunk);
+    else
+      queue.push_back(hunk);
+    work_cv.notify_one();
+}
+
+// Hands the hunks of a read to the workers, along with the ones after it when reading
+// sequentially.
+void ChdFileReader::Request(uint sector, uint count)
+{
+    if (workers.empty() || count == 0)
+      return;
+
+    const u32 first = sector / sectors_per_hunk;
+    const u32 last = (sector + count - 1) / sectors_per_hunk;
+
+    std::unique_lock<std::mutex> lock(cache_lock);
+
+    // Queued in reverse so the first hunk ends up at the front. Anything that doesn't fit
+    // in the cache is left for CopySectors.
+    const u32 urgent_last = std::min<u32>(last, first + cache_hunks - prefetch_hunks - 1);
+    for (u32 hunk = urgent_last + 1; hunk-- > first;)
+      Queue(lock, hunk, true);
+
+    const bool sequential = next_hunk != (u32)-1 && first <= next_hunk && first + 1 >= next_hunk;
+    if (sequential) {
+      for (u32 i = 1; i <= prefetch_hunks; i++) {
+        if (hunks.count(last + i) == 0)
+          stats.prefetched += last + i < hunk_count;
+        Queue(lock, last + i, false);
+      }
+    }
+    next_hunk = last + 1;
+}
+
+int ChdFileReader::CopySectors(void *pBuffer, uint sector, uint count)
 {
     u8 *dst = (u8 *) pBuffer;
     u32 hunk = sector / sectors_per_hunk;
     u32 sector_in_hunk = sector % sectors_per_hunk;
-    chd_error error;
+    bool retried = false;
 
-    for (uint i = 0; i < count; i++) {
-      if (current_hunk != hunk) {
-        error = chd_read(ChdFile, hunk, hunk_buffer);
-        if (error != CHDERR_NONE) {
-            log_cb(RETRO_LOG_ERROR, "chd_read return error: %s\n", chd_error_string(error));
-            // return i * m_blocksize;
-        }
-        current_hunk = hunk;
+    std::unique_lock<std::mutex> lock(cache_lock);
+    for (uint i = 0; i < count;) {
+      auto it = hunks.find(hunk);
+      Hunk *entry = it != hunks.end() ? &it->second : NULL;
+      if (entry == NULL) {
+        // Not requested or already evicted, decompress it here. It's pending until then
+        // so nothing evicts it.
+        stats.misses++;
+        entry = &Insert(lock, hunk, HunkState::Pending);
+        lock.unlock();
+        const bool ok = Decompress(ChdFile, hunk, entry->data.get());
+        lock.lock();
+        entry->state = ok ? HunkState::Ready : HunkState::Failed;
+        retried = true;
+      } else if (entry->state == HunkState::Pending) {
+        stats.waits++;
+        ready_cv.wait(lock, [entry] { return entry->state != HunkState::Pending; });
+      } else {
+        stats.hits++;
+      }
+
+      if (entry->state == HunkState::Failed && !retried) {
+        // A worker failed, try again with our own handle
+        free_buffers.push_back(std::move(entry->data));
+        lru.erase(entry->lru);
+        hunks.erase(hunk);
+        retried = true;
+        continue;
       }
-      memcpy(dst + i * m_blocksize, hunk_buffer + sector_in_hunk * sector_size, m_blocksize);
-      sector_in_hunk++;
-      if (sector_in_hunk >= sectors_per_hunk) {
-        hunk++;
-        sector_in_hunk = 0;
+
+      Touch(*entry);
+      const uint n = std::min<uint>(count - i, sectors_per_hunk - sector_in_hunk);
+      for (uint j = 0; j < n; j++)
+        memcpy(dst + (i + j) * m_blocksize, entry->data.get() + (sector_in_hunk + j) * sector_size, m_blocksize);
+
+      if (entry->state == HunkState::Failed) {
+        free_buffers.push_back(std::move(entry->data));
+        lru.erase(entry->lru);
+        hunks.erase(hunk);
       }
+
+      i += n;
+      hunk++;
+      sector_in_hunk = 0;
+      retried = false;
     }
     return m_blocksize * count;
 }
 
+void ChdFileReader::WorkerThread()
+{
+    chd_file *chd = OpenChain();
+
+    std::unique_lock<std::mutex> lock(cache_lock);
+    while (true) {
+      work_cv.wait(lock, [this] { return quit || !queue.empty(); });
+      if (quit)
+        break;
+
+      const u32 hunk = queue.front();
+      queue.pop_front();
+      Hunk &entry = hunks.at(hunk);
+
+      lock.unlock();
+      const bool ok = chd != NULL && Decompress(chd, hunk, entry.data.get());
+      lock.lock();
+
+      entry.state = ok ? HunkState::Ready : HunkState::Failed;
+      ready_cv.notify_all();
+    }
+    lock.unlock();
+
+    if (chd != NULL)
+      chd_close(chd);
+}
+
+void ChdFileReader::StopWorkers()
+{
+    {
+      std::lock_guard<std::mutex> guard(cache_lock);
+      quit = true;
+    }
+    work_cv.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+    workers.clear();
+
+    // Hunks that were still queued will never be decompressed
+    for (u32 hunk : queue) {
+      auto it = hunks.find(hunk);
+      lru.erase(it->second.lru);
+      hunks.erase(it);
+    }
+    queue.clear();
+}
+
+int ChdFileReader::ReadSync(void *pBuffer, uint sector, uint count)
+{
+    Request(sector, count);
+    return CopySectors(pBuffer, sector, count);
+}
+
 void ChdFileReader::BeginRead(void *pBuffer, uint sector, uint count)
 {
-  // TODO: Check if libchdr can read asynchronously
-  async_read = ReadSync(pBuffer, sector, count);
+    // The workers decompress the hunks in the background, FinishRead waits for them
+    read_buffer = pBuffer;
+    read_sector = sector;
+    read_count = count;
+    Request(sector, count);
 }
 
 int ChdFileReader::FinishRead()
 {
-	return async_read;
+    if (read_buffer == NULL)
+      return -1;
+
+    const int ret = CopySectors(read_buffer, read_sector, read_count);
+    read_buffer = NULL;
+    return ret;
+}
+
+void ChdFileReader::CancelRead()
+{
+    read_buffer = NULL;
 }
 
 void ChdFileReader::Close()
 {
-    if (hunk_buffer != NULL) {
-      //free(hunk_buffer);
-      delete[] hunk_buffer;
-      hunk_buffer = NULL;
+    StopWorkers();
+
+    const u64 reads = stats.hits + stats.waits + stats.misses;
+    if (reads != 0) {
+      log_cb(RETRO_LOG_INFO, "CHD: %llu hunk reads, %.1f%% hits, %llu waits, %llu misses, %llu prefetched, %.0f us per decompressed hunk\n",
+        (unsigned long long)reads, 100.0 * stats.hits / reads, (unsigned long long)stats.waits, (unsigned long long)stats.misses,
+        (unsigned long long)stats.prefetched, stats.decompressed ? (double)stats.decompress_us / stats.decompressed : 0.0);
     }
+    memzero(stats);
+
+    hunks.clear();
+    lru.clear();
+    free_buffers.clear();
+    read_buffer = NULL;
+
     if (ChdFile != NULL) {
       chd_close(ChdFile);
       ChdFile = NULL;
@@ -169,5 +432,12 @@ u32 ChdFileReader::GetBlockCount() const
 ChdFileReader::ChdFileReader(void)
 {
   ChdFile = NULL;
-  hunk_buffer = NULL;
+  hunk_bytes = 0;
+  hunk_count = 0;
+  quit = false;
+  cache_hunks = 0;
+  prefetch_hunks = 0;
+  next_hunk = -1;
+  memzero(stats);
+  read_buffer = NULL;
 };
@@ -2,6 +2,18 @@
 #include "AsyncFileReader.h"
 #include "libchdr/chd.h"
 
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define CHD_CACHE_SIZE_MB 16    /* decompressed hunks kept around, at least CHD_PREFETCH_HUNKS + 2 hunks are kept */
+#define CHD_PREFETCH_HUNKS 8    /* hunks decompressed ahead of sequential reads */
+#define CHD_WORKER_THREADS 2    /* threads decompressing hunks, 0 decompresses on the reading thread only */
+
 class ChdFileReader : public AsyncFileReader
 {
     DeclareNoncopyableObject(ChdFileReader);
@@ -15,7 +27,7 @@ public:
 
     void BeginRead(void *pBuffer, uint sector, uint count) override;
     int FinishRead(void) override;
-    void CancelRead(void) override {};
+    void CancelRead(void) override;
 
     void Close(void) override;
     void SetBlockSize(uint blocksize);
@@ -23,12 +35,71 @@ public:
     uint GetBlockCount(void) const override;
     ChdFileReader(void);
 
+    // Number of decompressed hunks cached and read ahead, can be changed while open.
+    void SetCacheSize(uint megabytes, uint prefetch_hunks);
+
+    struct Stats
+    {
+        u64 hits;            // hunks already decompressed when read
+        u64 waits;           // hunks still being decompressed by a worker when read
+        u64 misses;          // hunks decompressed by the reading thread
+        u64 prefetched;      // hunks queued ahead of the reads
+        u64 decompressed;
+        u64 decompress_us;   // time spent in chd_read, on any thread
+    };
+    Stats GetStats();
+
 private:
+    enum class HunkState
+    {
+        Pending, // queued or being decompressed by a worker
+        Ready,
+        Failed,
+    };
+
+    struct Hunk
+    {
+        HunkState state;
+        std::unique_ptr<u8[]> data;
+        std::list<u32>::iterator lru;
+    };
+
     chd_file *ChdFile;
-    u8 *hunk_buffer;
+    std::vector<std::string> chd_chain; // file and its parents, for the workers own handles
+    u32 hunk_bytes;
     u32 sector_size;
     u32 sector_count;
     u32 sectors_per_hunk;
-    u32 current_hunk;
-    u32 async_read;
+    u32 hunk_count;
+
+    // Everything below is protected by cache_lock
+    std::mutex cache_lock;
+    std::condition_variable work_cv;  // queue not empty or quitting
+    std::condition_variable ready_cv; // a pending hunk was decompressed
+    std::unordered_map<u32, Hunk> hunks;
+    std::list<u32> lru;               // most recently used first
+    std::vector<std::unique_ptr<u8[]>> free_buffers;
+    std::deque<u32> queue;            // hunks the workers should decompress, most urgent first
+    std::vector<std::thread> workers;
+    bool quit;
+    uint cache_hunks;
+    uint prefetch_hunks;
+    u32 next_hunk;                    // hunk following the last read, for sequential read detection
+    Stats stats;
+
+    // Pending read
+    void *read_buffer;
+    uint read_sector;
+    uint read_count;
+
+    chd_file *OpenChain();
+    void Request(uint sector, uint count);
+    int CopySectors(void *pBuffer, uint sector, uint count);
+    void WorkerThread();
+    bool Decompress(chd_file *chd, u32 hunk, u8 *dest);
+    Hunk &Insert(std::unique_lock<std::mutex> &lock, u32 hunk, HunkState state);
+    void Queue(std::unique_lock<std::mutex> &lock, u32 hunk, bool urgent);
+    void Touch(Hunk &entry);
+    void Evict();
+    void StopWorkers();
 };
\ No newline at end of file
@@ -19,40 +19,155 @@
 void ChunksCache::SetLimit(uint megabytes)
 {
 	m_limit = (PX_off_t)megabytes * 1024 * 1024;
-	MatchLimit();
+	Reset();
 }
 
-void ChunksCache::MatchLimit(bool removeAll)
+void ChunksCache::SetChunkSize(uint bytes)
 {
-	std::list<CacheEntry*>::reverse_iterator rit;
-	while (!m_entries.empty() && (removeAll || m_size > m_limit))
+	m_chunkSize = bytes;
+	Reset();
+}
+
+void ChunksCache::Reset()
+{
+	m_capacity = std::max<PX_off_t>(m_limit / m_chunkSize, 1);
+	m_chunksPerSlab = std::max<uint>(SlabSize / m_chunkSize, 1);
+
+	uint tableSize = 1;
+	while (tableSize < m_capacity * 2)
+		tableSize <<= 1;
+
+	m_entries.clear();
+	m_entries.shrink_to_fit();
+	m_slabs.clear();
+	m_table.assign(tableSize, None);
+	m_mru = m_lru = None;
+}
+
+u32 ChunksCache::Slot(PX_off_t offset) const
+{
+	u64 chunk = offset / m_chunkSize;
+	return (u32)((chunk * 0x9E3779B97F4A7C15ull) >> 32) & (m_table.size() - 1);
+}
+
+u32 ChunksCache::Find(PX_off_t offset) const
+{
+	const u32 mask = m_table.size() - 1;
+	for (u32 slot = Slot(offset); m_table[slot] != None; slot = (slot + 1) & mask)
 	{
-		rit = m_entries.rbegin();
-		m_size -= (*rit)->size;
-		delete (*rit);
-		m_entries.pop_back();
+		if (m_entries[m_table[slot]].offset == offset)
+			return m_table[slot];
 	}
+	return None;
 }
 
-void ChunksCache::Take(void* pMallocedSrc, PX_off_t offset, int length, int coverage)
+void ChunksCache::Unlink(u32 entry)
 {
-	m_entries.push_front(new CacheEntry(pMallocedSrc, offset, length, coverage));
-	m_size += length;
-	MatchLimit();
+	CacheEntry& e = m_entries[entry];
+	if (e.prev != None)
+		m_entries[e.prev].next = e.next;
+	else
+		m_mru = e.next;
+	if (e.next != None)
+		m_entries[e.next].prev = e.prev;
+	else
+		m_lru = e.prev;
 }
 
-// By design, succeed only if the entire request is in a single cached chunk
-int ChunksCache::Read(void* pDest, PX_off_t offset, int length)
+void ChunksCache::LinkFront(u32 entry)
+{
+	CacheEntry& e = m_entries[entry];
+	e.prev = None;
+	e.next = m_mru;
+	if (m_mru != None)
+		m_entries[m_mru].prev = entry;
+	else
+		m_lru = entry;
+	m_mru = entry;
+}
+
+// Takes the entry out of the index, shifting back the entries that probed past it so
+// lookups don't need tombstones.
+void ChunksCache::Remove(u32 entry)
+{
+	const u32 mask = m_table.size() - 1;
+	u32 hole = Slot(m_entries[entry].offset);
+	while (m_table[hole] != entry)
+		hole = (hole + 1) & mask;
+
+	for (u32 slot = (hole + 1) & mask; m_table[slot] != None; slot = (slot + 1) & mask)
+	{
+		// Entries whose home slot is cyclically in (hole, slot] have to stay
+		const u32 home = Slot(m_entries[m_table[slot]].offset);
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			m_table[hole] = m_table[slot];
+			hole = slot;
+		}
+	}
+	m_table[hole] = None;
+}
+
+void ChunksCache::Insert(const void* pSrc, PX_off_t offset, int length, int coverage)
 {
-	for (auto it = m_entries.begin(); it != m_entries.end(); it++)
+	// Readers only cache whole chunks, anything else is simply not cached
+	if (offset % m_chunkSize || length > (int)m_chunkSize)
+		return;
+
+	u32 entry = Find(offset);
+	if (entry != None)
 	{
-		CacheEntry* e = *it;
-		if (e && offset >= e->offset && (offset + length) <= (e->offset + e->coverage))
+		Unlink(entry);
+	}
+	else
+	{
+		if (m_entries.size() < m_capacity)
 		{
-			if (it != m_entries.begin())
-				m_entries.splice(m_entries.begin(), m_entries, it); // Move to top (MRU)
-			return CopyAvailable(e->data, e->offset, e->size, pDest, offset, length);
+			entry = m_entries.size();
+			m_entries.push_back(CacheEntry());
+			if (entry % m_chunksPerSlab == 0)
+				m_slabs.emplace_back(new u8[(size_t)m_chunksPerSlab * m_chunkSize]);
 		}
+		else
+		{
+			// Recycle the least recently used chunk, data slot included
+			entry = m_lru;
+			Remove(entry);
+			Unlink(entry);
+		}
+
+		const u32 mask = m_table.size() - 1;
+		u32 slot = Slot(offset);
+		while (m_table[slot] != None)
+			slot = (slot + 1) & mask;
+		m_table[slot] = entry;
+	}
+
+	CacheEntry& e = m_entries[entry];
+	e.offset = offset;
+	e.size = length;
+	e.coverage = coverage;
+	if (length)
+		memcpy(GetData(entry), pSrc, length);
+	LinkFront(entry);
+}
+
+// By design, succeed only if the entire request is in a single cached chunk
+int ChunksCache::Read(void* pDest, PX_off_t offset, int length)
+{
+	const PX_off_t chunkOffset = offset - offset % m_chunkSize;
+	const u32 entry = Find(chunkOffset);
+	if (entry == None)
+		return -1;
+
+	const CacheEntry& e = m_entries[entry];
+	if ((offset + length) > (e.offset + e.coverage))
+		return -1;
+
+	if (entry != m_mru)
+	{
+		Unlink(entry);
+		LinkFront(entry); // Move to top (MRU)
 	}
-	return -1;
+	return CopyAvailable(GetData(entry), e.offset, e.size, pDest, offset, length);
 }
@@ -17,21 +17,33 @@
 
 #include "zlib_indexed.h"
 
+#include <memory>
+#include <vector>
+
 #define CLAMP(val, minval, maxval) (std::min(maxval, std::max(minval, val)))
 
+// Cache of decompressed chunks of a fixed size, aligned to that size in the uncompressed
+// data.  Chunks are found with a hash of their index, kept in an intrusive LRU list, and
+// their data lives in slabs allocated as the cache grows, so nothing is allocated once
+// the cache is full.
 class ChunksCache
 {
 public:
-	ChunksCache(uint initialLimitMb)
-		: m_entries(0)
-		, m_size(0)
-		, m_limit(initialLimitMb * 1024 * 1024){};
-	~ChunksCache() { Clear(); };
+	ChunksCache(uint initialLimitMb, uint chunkSize)
+		: m_limit((PX_off_t)initialLimitMb * 1024 * 1024)
+		, m_chunkSize(chunkSize)
+	{
+		Reset();
+	};
 	void SetLimit(uint megabytes);
-	void Clear() { MatchLimit(true); };
+	void SetChunkSize(uint bytes);
+	void Clear() { Reset(); };
 
-	void Take(void* pMallocedSrc, PX_off_t offset, int length, int coverage);
+	// Copies 'length' bytes of the chunk at 'offset', 'coverage' being how much of the
+	// uncompressed data the chunk stands for (more than length at the end of the file).
+	void Insert(const void* pSrc, PX_off_t offset, int length, int coverage);
 	int Read(void* pDest, PX_off_t offset, int length);
+	bool Has(PX_off_t offset) const { return Find(offset - offset % m_chunkSize) != None; }
 
 	static int CopyAvailable(void* pSrc, PX_off_t srcOffset, int srcSize,
 							 void* pDst, PX_off_t dstOffset, int maxCopySize)
@@ -42,31 +54,35 @@ public:
 	};
 
 private:
-	class CacheEntry
-	{
-	public:
-		CacheEntry(void* pMallocedSrc, PX_off_t offset, int length, int coverage)
-			: data(pMallocedSrc)
-			, offset(offset)
-			, coverage(coverage)
-			, size(length){};
-
-		~CacheEntry()
-		{
-			if (data)
-				free(data);
-		};
+	static constexpr u32 None = (u32)-1;
+	static constexpr uint SlabSize = 4 * 1024 * 1024;
 
-		void* data;
+	struct CacheEntry
+	{
 		PX_off_t offset;
-		int coverage;
 		int size;
+		int coverage;
+		u32 prev; // LRU neighbours, towards the most recently used
+		u32 next;
 	};
 
-	std::list<CacheEntry*> m_entries;
-	void MatchLimit(bool removeAll = false);
-	PX_off_t m_size;
+	std::vector<CacheEntry> m_entries; // grows up to m_capacity, the data of entry i is in slot i
+	std::vector<std::unique_ptr<u8[]>> m_slabs;
+	std::vector<u32> m_table; // open addressing on the chunk index, entry or None
+	u32 m_capacity;
+	u32 m_chunksPerSlab;
+	u32 m_mru;
+	u32 m_lru;
 	PX_off_t m_limit;
+	uint m_chunkSize;
+
+	void Reset();
+	u8* GetData(u32 entry) const { return &m_slabs[entry / m_chunksPerSlab][(entry % m_chunksPerSlab) * m_chunkSize]; }
+	u32 Slot(PX_off_t offset) const;
+	u32 Find(PX_off_t offset) const;
+	void Unlink(u32 entry);
+	void LinkFront(u32 entry);
+	void Remove(u32 entry);
 };
 
 #undef CLAMP
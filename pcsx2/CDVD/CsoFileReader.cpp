@@ -26,6 +26,10 @@
 
 // Implementation of CSO compressed ISO reading, based on:
 // https://github.com/unknownbrackets/maxcso/blob/master/README_CSO.md
+//
+// CSOv2 (README_CSO2.md) frames are stored as is when they take a whole frame, otherwise
+// the high bit of the index picks LZ4 instead of deflate.  ZSO uses the CSOv1 layout with
+// LZ4 frames.
 struct CsoHeader
 {
 	u8 magic[4];
@@ -39,10 +43,77 @@ struct CsoHeader
 
 static const u32 CSO_READ_BUFFER_SIZE = 256 * 1024;
 
+// Decompresses an LZ4 block until 'dest' is full or the input runs out, whichever comes
+// first: CSO frames are padded to the index alignment, so the input may go on past the
+// end of the block.  Returns the decompressed size or -1 if the block is corrupted.
+static int Lz4DecompressBlock(const u8* src, int srcSize, u8* dest, int destSize)
+{
+	const u8* ip = src;
+	const u8* const iend = src + srcSize;
+	u8* op = dest;
+	u8* const oend = dest + destSize;
+
+	auto readLength = [&](size_t& length) {
+		u8 b;
+		do
+		{
+			if (ip >= iend)
+				return false;
+			b = *ip++;
+			length += b;
+		} while (b == 255);
+		return true;
+	};
+
+	while (ip < iend)
+	{
+		const u8 token = *ip++;
+
+		size_t length = token >> 4;
+		if (length == 15 && !readLength(length))
+			return -1;
+		if (length > (size_t)(iend - ip) || length > (size_t)(oend - op))
+			return -1;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		// The last sequence only has literals
+		if (op == oend || ip >= iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dest))
+			return -1;
+
+		length = token & 15;
+		if (length == 15 && !readLength(length))
+			return -1;
+		length += 4;
+		if (length > (size_t)(oend - op))
+			return -1;
+
+		const u8* match = op - offset;
+		if (offset >= 8)
+		{
+			for (; length >= 8; length -= 8, op += 8, match += 8)
+				memcpy(op, match, 8);
+		}
+		// Overlapping matches repeat the last 'offset' bytes, copy them one at a time
+		while (length--)
+			*op++ = *match++;
+	}
+
+	return op - dest;
+}
+
 bool CsoFileReader::CanHandle(const wxString& fileName)
 {
 	bool supported = false;
-	if (wxFileName::FileExists(fileName) && fileName.Lower().EndsWith(L".cso"))
+	if (wxFileName::FileExists(fileName) && (fileName.Lower().EndsWith(L".cso") || fileName.Lower().EndsWith(L".zso")))
 	{
 		FILE* fp = PX_fopen_rb(fileName);
 		CsoHeader hdr;
@@ -60,14 +131,16 @@ bool CsoFileReader::CanHandle(const wxString& fileName)
 
 bool CsoFileReader::ValidateHeader(const CsoHeader& hdr)
 {
-	if (hdr.magic[0] != 'C' || hdr.magic[1] != 'I' || hdr.magic[2] != 'S' || hdr.magic[3] != 'O')
+	const bool cso = hdr.magic[0] == 'C' && hdr.magic[1] == 'I' && hdr.magic[2] == 'S' && hdr.magic[3] == 'O';
+	const bool zso = hdr.magic[0] == 'Z' && hdr.magic[1] == 'I' && hdr.magic[2] == 'S' && hdr.magic[3] == 'O';
+	if (!cso && !zso)
 	{
 		// Invalid magic, definitely a bad file.
 		return false;
 	}
-	if (hdr.ver > 1)
+	if ((cso && hdr.ver > 2) || (zso && hdr.ver > 1))
 	{
-		log_cb(RETRO_LOG_ERROR, "Only CSOv1 files are supported.\n");
+		log_cb(RETRO_LOG_ERROR, "Only CSOv1, CSOv2 and ZSO files are supported.\n");
 		return false;
 	}
 	if ((hdr.frame_size & (hdr.frame_size - 1)) != 0)
@@ -89,10 +162,10 @@ bool CsoFileReader::Open(const wxString& fileName)
 {
 	Close();
 	m_filename = fileName;
-	m_src = PX_fopen_rb(m_filename);
+	m_decoder.src = PX_fopen_rb(m_filename);
 
 	bool success = false;
-	if (m_src && ReadFileHeader() && InitializeBuffers())
+	if (m_decoder.src && ReadFileHeader() && InitializeBuffers())
 	{
 		success = true;
 	}
@@ -102,6 +175,12 @@ bool CsoFileReader::Open(const wxString& fileName)
 		Close();
 		return false;
 	}
+
+	// Each worker gets its own handle, opened here as wxString isn't safe to convert from
+	// several threads at once
+	for (uint i = 0; i < CSO_WORKER_THREADS; i++)
+		m_workers.emplace_back(&CsoFileReader::WorkerThread, this, PX_fopen_rb(m_filename));
+
 	return true;
 }
 
@@ -109,8 +188,8 @@ bool CsoFileReader::ReadFileHeader()
 {
 	CsoHeader hdr = {};
 
-	PX_fseeko(m_src, m_dataoffset, SEEK_SET);
-	if (fread(&hdr, 1, sizeof(hdr), m_src) != sizeof(hdr))
+	PX_fseeko(m_decoder.src, m_dataoffset, SEEK_SET);
+	if (fread(&hdr, 1, sizeof(hdr), m_decoder.src) != sizeof(hdr))
 	{
 		log_cb(RETRO_LOG_ERROR, "Failed to read CSO file header.\n");
 		return false;
@@ -122,6 +201,11 @@ bool CsoFileReader::ReadFileHeader()
 		return false;
 	}
 
+	if (hdr.magic[0] == 'Z')
+		m_format = Format::ZSO;
+	else
+		m_format = hdr.ver == 2 ? Format::CSOv2 : Format::CSOv1;
+
 	m_frameSize = hdr.frame_size;
 	// Determine the translation from bytes to frame.
 	m_frameShift = 0;
@@ -137,74 +221,97 @@ bool CsoFileReader::ReadFileHeader()
 	return true;
 }
 
-bool CsoFileReader::InitializeBuffers()
+bool CsoFileReader::FrameDecoder::Init(u32 frameSize, u8 indexShift)
 {
-	// Round up, since part of a frame requires a full frame.
-	u32 numFrames = (u32)((m_totalSize + m_frameSize - 1) / m_frameSize);
-
 	// We might read a bit of alignment too, so be prepared.
-	if (m_frameSize + (1 << m_indexShift) < CSO_READ_BUFFER_SIZE)
-	{
-		m_readBuffer = new u8[CSO_READ_BUFFER_SIZE];
-	}
-	else
-	{
-		m_readBuffer = new u8[m_frameSize + (1 << m_indexShift)];
-	}
+	readBufferSize = std::max<u32>(frameSize + (1 << indexShift), CSO_READ_BUFFER_SIZE);
+	readBuffer = new u8[readBufferSize];
 
 	// This is a buffer for the most recently decompressed frame.
-	m_zlibBuffer = new u8[m_frameSize + (1 << m_indexShift)];
-	m_zlibBufferFrame = numFrames;
-
-	const u32 indexSize = numFrames + 1;
-	m_index = new u32[indexSize];
-	if (fread(m_index, sizeof(u32), indexSize, m_src) != indexSize)
-	{
-		log_cb(RETRO_LOG_ERROR, "Unable to read index data from CSO.\n");
-		return false;
-	}
+	frame = new u8[frameSize + (1 << indexShift)];
 
-	m_z_stream = new z_stream;
-	m_z_stream->zalloc = Z_NULL;
-	m_z_stream->zfree = Z_NULL;
-	m_z_stream->opaque = Z_NULL;
-	if (inflateInit2(m_z_stream, -15) != Z_OK)
+	zstream = new z_stream;
+	zstream->zalloc = Z_NULL;
+	zstream->zfree = Z_NULL;
+	zstream->opaque = Z_NULL;
+	if (inflateInit2(zstream, -15) != Z_OK)
 	{
 		log_cb(RETRO_LOG_ERROR, "Unable to initialize zlib for CSO decompression.\n");
+		delete zstream;
+		zstream = NULL;
 		return false;
 	}
 
 	return true;
 }
 
-void CsoFileReader::Close()
+void CsoFileReader::FrameDecoder::Close()
 {
-	m_filename.Empty();
-#if CSO_USE_CHUNKSCACHE
-	m_cache.Clear();
-#endif
-
-	if (m_src)
+	if (src)
 	{
-		fclose(m_src);
-		m_src = NULL;
+		fclose(src);
+		src = NULL;
 	}
-	if (m_z_stream)
+	if (zstream)
 	{
-		inflateEnd(m_z_stream);
-		m_z_stream = NULL;
+		inflateEnd(zstream);
+		delete zstream;
+		zstream = NULL;
 	}
 
-	if (m_readBuffer)
+	delete[] readBuffer;
+	readBuffer = NULL;
+	delete[] frame;
+	frame = NULL;
+}
+
+bool CsoFileReader::InitializeBuffers()
+{
+	// Round up, since part of a frame requires a full frame.
+	m_numFrames = (u32)((m_totalSize + m_frameSize - 1) / m_frameSize);
+	m_decodedFrame = m_numFrames;
+
+	const u32 indexSize = m_numFrames + 1;
+	m_index = new u32[indexSize];
+	if (fread(m_index, sizeof(u32), indexSize, m_decoder.src) != indexSize)
 	{
-		delete[] m_readBuffer;
-		m_readBuffer = NULL;
+		log_cb(RETRO_LOG_ERROR, "Unable to read index data from CSO.\n");
+		return false;
 	}
-	if (m_zlibBuffer)
+
+	m_cache.SetChunkSize(m_frameSize);
+	m_readaheadFrames = std::max<u32>(CSO_READAHEAD_SIZE / m_frameSize, 1);
+	m_nextFrame = (u32)-1;
+	m_quit = false;
+
+	return m_decoder.Init(m_frameSize, m_indexShift);
+}
+
+void CsoFileReader::StopWorkers()
+{
 	{
-		delete[] m_zlibBuffer;
-		m_zlibBuffer = NULL;
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_quit = true;
 	}
+	m_workCv.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	// Queued frames will never be decompressed
+	m_queue.clear();
+	m_pending.clear();
+}
+
+void CsoFileReader::Close()
+{
+	StopWorkers();
+
+	m_filename.Empty();
+	m_cache.Clear();
+	m_decoder.Close();
+	m_readDest = NULL;
+
 	if (m_index)
 	{
 		delete[] m_index;
@@ -214,7 +321,13 @@ void CsoFileReader::Close()
 
 int CsoFileReader::ReadSync(void* pBuffer, uint sector, uint count)
 {
-	if (!m_src)
+	Request(sector, count);
+	return ReadFrames(pBuffer, sector, count);
+}
+
+int CsoFileReader::ReadFrames(void* pBuffer, uint sector, uint count)
+{
+	if (!m_decoder.src)
 	{
 		return 0;
 	}
@@ -230,29 +343,11 @@ int CsoFileReader::ReadSync(void* pBuffer, uint sector, uint count)
 
 	while (remaining > 0)
 	{
-		int readBytes;
-
-#if CSO_USE_CHUNKSCACHE
-		// Try first to read from the cache.
-		readBytes = m_cache.Read(dest + bytes, pos + bytes, remaining);
-#else
-		readBytes = -1;
-#endif
-		if (readBytes < 0)
+		int readBytes = ReadFromFrame(dest + bytes, pos + bytes, remaining);
+		if (readBytes == 0)
 		{
-			readBytes = ReadFromFrame(dest + bytes, pos + bytes, remaining);
-			if (readBytes == 0)
-			{
-				// We hit EOF.
-				break;
-			}
-
-#if CSO_USE_CHUNKSCACHE
-			// Add the bytes into the cache.  We need to allocate a buffer for it.
-			void* cached = malloc(readBytes);
-			memcpy(cached, dest + bytes, readBytes);
-			m_cache.Take(cached, pos + bytes, readBytes, readBytes);
-#endif
+			// We hit EOF.
+			break;
 		}
 
 		bytes += readBytes;
@@ -271,12 +366,51 @@ int CsoFileReader::ReadFromFrame(u8* dest, u64 pos, int maxBytes)
 	}
 
 	const u32 frame = (u32)(pos >> m_frameShift);
-	const u32 offset = (u32)(pos - (frame << m_frameShift));
+	const u32 offset = (u32)(pos - ((u64)frame << m_frameShift));
 	// This is how many bytes we will actually be reading from this frame.
-	const u32 bytes = (u32)(std::min(m_blocksize, static_cast<uint>(m_frameSize - offset)));
+	const u32 bytes = std::min<u32>(maxBytes, m_frameSize - offset);
+
+	// We don't need to decompress if we already did this same frame last time.
+	if (m_decodedFrame != frame)
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		if (m_pending.count(frame))
+		{
+			// A worker has it, make sure it's the next one they do
+			Queue(frame, true);
+			m_readyCv.wait(lock, [this, frame] { return m_pending.count(frame) == 0; });
+		}
+		if (m_cache.Read(dest, pos, bytes) == (int)bytes)
+			return bytes;
+		lock.unlock();
+
+		if (!DecompressFrame(m_decoder, frame))
+		{
+			m_decodedFrame = (u32)-1;
+			return 0;
+		}
+		m_decodedFrame = frame;
+
+		lock.lock();
+		m_cache.Insert(m_decoder.frame, (u64)frame << m_frameShift, m_frameSize, m_frameSize);
+	}
+
+	// Now we just copy the offset data from the cache.
+	memcpy(dest, m_decoder.frame + offset, bytes);
+	return bytes;
+}
+
+bool CsoFileReader::DecompressFrame(FrameDecoder& decoder, u32 frame)
+{
+	enum
+	{
+		Stored,
+		Deflate,
+		LZ4,
+	} method;
 
 	// Grab the index data for the frame we're about to read.
-	const bool compressed = (m_index[frame + 0] & 0x80000000) == 0;
+	const bool highBit = (m_index[frame + 0] & 0x80000000) != 0;
 	const u32 index0 = m_index[frame + 0] & 0x7FFFFFFF;
 	const u32 index1 = m_index[frame + 1] & 0x7FFFFFFF;
 
@@ -284,80 +418,183 @@ int CsoFileReader::ReadFromFrame(u8* dest, u64 pos, int maxBytes)
 	const u64 frameRawPos = (u64)index0 << m_indexShift;
 	const u64 frameRawSize = (u64)(index1 - index0) << m_indexShift;
 
-	if (!compressed)
+	switch (m_format)
+	{
+		case Format::CSOv2:
+			method = frameRawSize >= m_frameSize ? Stored : highBit ? LZ4 : Deflate;
+			break;
+		case Format::ZSO:
+			method = highBit ? Stored : LZ4;
+			break;
+		default:
+			method = highBit ? Stored : Deflate;
+			break;
+	}
+
+	if (PX_fseeko(decoder.src, m_dataoffset + frameRawPos, SEEK_SET) != 0)
+	{
+		log_cb(RETRO_LOG_ERROR, "Unable to seek to CSO data.\n");
+		return false;
+	}
+
+	if (method == Stored)
 	{
-		// Just read directly, easy.
-		if (PX_fseeko(m_src, m_dataoffset + frameRawPos + offset, SEEK_SET) != 0)
+		// Just read directly, easy.  The last frame may be short.
+		const u32 readBytes = fread(decoder.frame, 1, m_frameSize, decoder.src);
+		if (readBytes == 0)
 		{
-			log_cb(RETRO_LOG_ERROR, "Unable to seek to uncompressed CSO data.\n");
-			return 0;
+			log_cb(RETRO_LOG_ERROR, "Unable to read uncompressed CSO data.\n");
+			return false;
 		}
-		return fread(dest, 1, bytes, m_src);
+		memset(decoder.frame + readBytes, 0, m_frameSize - readBytes);
+		return true;
 	}
-	else
+
+	// This might be less bytes than frameRawSize in case of padding on the last frame.
+	// This is because the index positions must be aligned.
+	const u32 readRawBytes = fread(decoder.readBuffer, 1, std::min<u64>(frameRawSize, decoder.readBufferSize), decoder.src);
+
+	if (method == LZ4)
 	{
-		// We don't need to decompress if we already did this same frame last time.
-		if (m_zlibBufferFrame != frame)
+		const int decompressed = Lz4DecompressBlock(decoder.readBuffer, readRawBytes, decoder.frame, m_frameSize);
+		if (decompressed <= 0)
 		{
-			if (PX_fseeko(m_src, m_dataoffset + frameRawPos, SEEK_SET) != 0)
-			{
-				log_cb(RETRO_LOG_ERROR, "Unable to seek to compressed CSO data.\n");
-				return 0;
-			}
-			// This might be less bytes than frameRawSize in case of padding on the last frame.
-			// This is because the index positions must be aligned.
-			const u32 readRawBytes = fread(m_readBuffer, 1, frameRawSize, m_src);
-			if (!DecompressFrame(frame, readRawBytes))
-			{
-				return 0;
-			}
+			log_cb(RETRO_LOG_ERROR, "Unable to decompress CSO frame using LZ4.\n");
+			return false;
 		}
+		memset(decoder.frame + decompressed, 0, m_frameSize - decompressed);
+		return true;
+	}
+
+	z_stream* zstream = decoder.zstream;
+	zstream->next_in = decoder.readBuffer;
+	zstream->avail_in = readRawBytes;
+	zstream->next_out = decoder.frame;
+	zstream->avail_out = m_frameSize;
 
-		// Now we just copy the offset data from the cache.
-		memcpy(dest, m_zlibBuffer + offset, bytes);
+	int status = inflate(zstream, Z_FINISH);
+	bool success = status == Z_STREAM_END && zstream->total_out == m_frameSize;
+	if (!success)
+	{
+		log_cb(RETRO_LOG_ERROR, "Unable to decompress CSO frame using zlib.\n");
 	}
 
-	return bytes;
+	inflateReset(zstream);
+	return success;
 }
 
-bool CsoFileReader::DecompressFrame(u32 frame, u32 readBufferSize)
+// Called with m_lock held.
+void CsoFileReader::Queue(u32 frame, bool urgent)
 {
-	m_z_stream->next_in = m_readBuffer;
-	m_z_stream->avail_in = readBufferSize;
-	m_z_stream->next_out = m_zlibBuffer;
-	m_z_stream->avail_out = m_frameSize;
-
-	int status = inflate(m_z_stream, Z_FINISH);
-	bool success = status == Z_STREAM_END && m_z_stream->total_out == m_frameSize;
-	if (success)
+	if (frame >= m_numFrames)
+		return;
+
+	if (m_pending.count(frame))
 	{
-		// Our buffer now contains this frame.
-		m_zlibBufferFrame = frame;
+		if (urgent)
+		{
+			auto queued = std::find(m_queue.begin(), m_queue.end(), frame);
+			if (queued != m_queue.end())
+			{
+				m_queue.erase(queued);
+				m_queue.push_front(frame);
+			}
+		}
+		return;
 	}
+
+	if (frame == m_decodedFrame || m_cache.Has((u64)frame << m_frameShift))
+		return;
+
+	m_pending.insert(frame);
+	if (urgent)
+		m_queue.push_front(frame);
 	else
+		m_queue.push_back(frame);
+	m_workCv.notify_one();
+}
+
+// Hands the frames of a read to the workers, along with the ones after it when reading
+// sequentially.
+void CsoFileReader::Request(uint sector, uint count)
+{
+	if (m_workers.empty() || count == 0)
+		return;
+
+	const u64 start = (u64)sector * m_blocksize;
+	const u64 end = std::min<u64>(start + (u64)count * m_blocksize, m_totalSize);
+	if (start >= end)
+		return;
+
+	const u32 first = (u32)(start >> m_frameShift);
+	const u32 last = (u32)((end - 1) >> m_frameShift);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	// Queued in reverse so the first frame ends up at the front
+	for (u32 frame = last + 1; frame-- > first;)
+		Queue(frame, true);
+
+	const bool sequential = m_nextFrame != (u32)-1 && first <= m_nextFrame && first + 1 >= m_nextFrame;
+	if (sequential)
 	{
-		log_cb(RETRO_LOG_ERROR, "Unable to decompress CSO frame using zlib.\n");
-		m_zlibBufferFrame = (u32)-1;
+		for (u32 i = 1; i <= m_readaheadFrames; i++)
+			Queue(last + i, false);
 	}
+	m_nextFrame = last + 1;
+}
 
-	inflateReset(m_z_stream);
-	return success;
+void CsoFileReader::WorkerThread(FILE* src)
+{
+	FrameDecoder decoder;
+	decoder.src = src;
+	const bool ready = decoder.src && decoder.Init(m_frameSize, m_indexShift);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true)
+	{
+		m_workCv.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+		if (m_quit)
+			break;
+
+		const u32 frame = m_queue.front();
+		m_queue.pop_front();
+
+		lock.unlock();
+		const bool decompressed = ready && DecompressFrame(decoder, frame);
+		lock.lock();
+
+		// If this failed the reading thread will try again on its own
+		if (decompressed)
+			m_cache.Insert(decoder.frame, (u64)frame << m_frameShift, m_frameSize, m_frameSize);
+		m_pending.erase(frame);
+		m_readyCv.notify_all();
+	}
+	lock.unlock();
+
+	decoder.Close();
 }
 
 void CsoFileReader::BeginRead(void* pBuffer, uint sector, uint count)
 {
-	// TODO: No async support yet, implement as sync.
-	m_bytesRead = ReadSync(pBuffer, sector, count);
+	// The workers decompress the frames in the background, FinishRead waits for them
+	m_readDest = pBuffer;
+	m_readSector = sector;
+	m_readCount = count;
+	Request(sector, count);
 }
 
 int CsoFileReader::FinishRead()
 {
-	int res = m_bytesRead;
-	m_bytesRead = -1;
+	if (!m_readDest)
+		return -1;
+
+	int res = ReadFrames(m_readDest, m_readSector, m_readCount);
+	m_readDest = NULL;
 	return res;
 }
 
 void CsoFileReader::CancelRead()
 {
-	// TODO: No async read support yet.
+	m_readDest = NULL;
 }
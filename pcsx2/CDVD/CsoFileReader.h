@@ -15,22 +15,25 @@
 
 #pragma once
 
-// Based on testing, the overhead of using this cache is high.
-//
-// The test was done with CSO files using a block size of 16KB.
-// Cache hit rates were observed in the range of 25%.
-// Cache overhead added 35% to the overall read time.
-//
-// For this reason, it's currently disabled.
-#define CSO_USE_CHUNKSCACHE 0
-
 #include "AsyncFileReader.h"
 #include "ChunksCache.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
 struct CsoHeader;
 typedef struct z_stream_s z_stream;
 
+// Decompressed frames are kept in a ChunksCache, keyed by frame.  Worker threads fill it
+// with the frames of a read as soon as it's started, and with the frames following it
+// when reading sequentially.
 static const uint CSO_CHUNKCACHE_SIZE_MB = 200;
+static const uint CSO_WORKER_THREADS = 2;          // 0 decompresses on the reading thread only
+static const uint CSO_READAHEAD_SIZE = 256 * 1024; // decompressed ahead of sequential reads
 
 class CsoFileReader : public AsyncFileReader
 {
@@ -41,19 +44,18 @@ public:
 		: m_frameSize(0)
 		, m_frameShift(0)
 		, m_indexShift(0)
-		, m_readBuffer(0)
-		, m_zlibBuffer(0)
-		, m_zlibBufferFrame(0)
+		, m_format(Format::CSOv1)
 		, m_index(0)
+		, m_numFrames(0)
 		, m_totalSize(0)
-		, m_src(0)
-		, m_z_stream(0)
-		,
-#if CSO_USE_CHUNKSCACHE
-		m_cache(CSO_CHUNKCACHE_SIZE_MB)
-		,
-#endif
-		m_bytesRead(0)
+		, m_decodedFrame(0)
+		, m_cache(CSO_CHUNKCACHE_SIZE_MB, 2048) // chunk size set to the frame size by Open
+		, m_quit(false)
+		, m_readaheadFrames(0)
+		, m_nextFrame(0)
+		, m_readDest(0)
+		, m_readSector(0)
+		, m_readCount(0)
 	{
 		m_blocksize = 2048;
 	};
@@ -80,28 +82,63 @@ public:
 	virtual void SetDataOffset(int bytes) { m_dataoffset = bytes; }
 
 private:
+	enum class Format
+	{
+		CSOv1, // deflate frames
+		CSOv2, // deflate or LZ4 frames
+		ZSO,   // LZ4 frames
+	};
+
+	// What a thread needs to decompress frames on its own.
+	struct FrameDecoder
+	{
+		FILE* src = NULL;
+		z_stream* zstream = NULL;
+		u8* readBuffer = NULL;
+		u32 readBufferSize = 0;
+		u8* frame = NULL; // the last decompressed frame
+
+		bool Init(u32 frameSize, u8 indexShift);
+		void Close();
+	};
+
 	static bool ValidateHeader(const CsoHeader& hdr);
 	bool ReadFileHeader();
 	bool InitializeBuffers();
+	int ReadFrames(void* pBuffer, uint sector, uint count);
 	int ReadFromFrame(u8* dest, u64 pos, int maxBytes);
-	bool DecompressFrame(u32 frame, u32 readBufferSize);
+	bool DecompressFrame(FrameDecoder& decoder, u32 frame);
+	void Request(uint sector, uint count);
+	void Queue(u32 frame, bool urgent);
+	void WorkerThread(FILE* src);
+	void StopWorkers();
 
 	u32 m_frameSize;
 	u8 m_frameShift;
 	u8 m_indexShift;
-	u8* m_readBuffer;
-	u8* m_zlibBuffer;
-	u32 m_zlibBufferFrame;
+	Format m_format;
 	u32* m_index;
+	u32 m_numFrames;
 	u64 m_totalSize;
-	// The actual source cso file handle.
-	FILE* m_src;
-	z_stream* m_z_stream;
 
-#if CSO_USE_CHUNKSCACHE
-	ChunksCache m_cache;
-#endif
+	// The reading thread's own file handle and buffers.
+	FrameDecoder m_decoder;
+	u32 m_decodedFrame;
 
-	// The result of a read is stored here between BeginRead() and FinishRead().
-	int m_bytesRead;
+	// Everything below is protected by m_lock
+	std::mutex m_lock;
+	std::condition_variable m_workCv;  // queue not empty or quitting
+	std::condition_variable m_readyCv; // a pending frame was decompressed
+	ChunksCache m_cache;
+	std::unordered_set<u32> m_pending; // frames queued or being decompressed
+	std::deque<u32> m_queue;           // most urgent first
+	std::vector<std::thread> m_workers;
+	bool m_quit;
+	u32 m_readaheadFrames;
+	u32 m_nextFrame; // frame following the last read, for sequential read detection
+
+	// The read started by BeginRead(), done by FinishRead().
+	void* m_readDest;
+	uint m_readSector;
+	uint m_readCount;
 };
@@ -368,6 +368,21 @@ bool SymbolMap::GetLabelValue(const char* name, u32& dest) {
 	return false;
 }
 
+std::string SymbolMap::GetNearestLabel(u32 address, u32& start) const {
+	std::lock_guard<std::recursive_mutex> guard(m_lock);
+	const u32 function = GetFunctionStart(address);
+	auto it = function != INVALID_ADDRESS ? activeLabels.find(function) : activeLabels.end();
+	if (it == activeLabels.end()) {
+		it = activeLabels.upper_bound(address);
+		if (it == activeLabels.begin())
+			return "";
+		it--;
+	}
+
+	start = it->first;
+	return it->second.name;
+}
+
 void SymbolMap::AddData(u32 address, u32 size, DataType type, int moduleIndex) {
 	std::lock_guard<std::recursive_mutex> guard(m_lock);
 
@@ -72,6 +72,8 @@ public:
 
 	void AddLabel(const char* name, u32 address, int moduleIndex = -1);
 	bool GetLabelValue(const char* name, u32& dest);
+	// Name of the function 'address' is in, or of the closest label before it.
+	std::string GetNearestLabel(u32 address, u32& start) const;
 
 	void AddData(u32 address, u32 size, DataType type, int moduleIndex = -1);
 	u32 GetDataStart(u32 address) const;
@@ -0,0 +1,119 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PrecompiledHeader.h"
+#include "DeltaState.h"
+
+#include <chrono>
+
+DeltaStateRing::DeltaStateRing( uint capacity, int keyframeInterval )
+	: m_ring( capacity )
+	, m_keyframeInterval( keyframeInterval )
+{
+	pxAssert( capacity > 0 && keyframeInterval > 0 );
+	Clear();
+	ResetStats();
+}
+
+void DeltaStateRing::Clear()
+{
+	for (Delta& delta : m_ring)
+	{
+		delta.Base.reset();
+		delta.Pages.clear();
+		delta.Data.clear();
+	}
+
+	m_head = 0;
+	m_count = 0;
+	m_keyframe.reset();
+	m_sinceKeyframe.clear();
+	m_untilKeyframe = 0;
+}
+
+void DeltaStateRing::Capture( const VmStateBuffer& state, int size, const std::vector<u8>& changed )
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	Delta& delta = m_ring[m_head];
+	delta.Pages.clear();
+	delta.Data.clear();
+
+	if (!m_keyframe || m_untilKeyframe <= 0 || (int)m_keyframe->size() != size)
+	{
+		const u8* src = state.GetPtr();
+		m_keyframe = std::make_shared<const Keyframe>( src, src + size );
+		m_sinceKeyframe.assign( (size + PageSize - 1) / PageSize, 0 );
+		m_untilKeyframe = m_keyframeInterval;
+
+		m_stats.Keyframes++;
+		m_stats.Bytes += size;
+	}
+	else
+	{
+		for (uint page = 0; page < m_sinceKeyframe.size(); ++page)
+		{
+			if (page < changed.size() && changed[page])
+				m_sinceKeyframe[page] = 1;
+			if (!m_sinceKeyframe[page])
+				continue;
+
+			const int offset = page * PageSize;
+			const int len = std::min( PageSize, size - offset );
+			const u8* src = state.GetPtr( offset );
+
+			delta.Pages.push_back( page );
+			delta.Data.insert( delta.Data.end(), src, src + len );
+		}
+
+		m_stats.Bytes += delta.Data.size() + delta.Pages.size() * sizeof(u32);
+	}
+
+	delta.Base = m_keyframe;
+	m_untilKeyframe--;
+
+	m_head = (m_head + 1) % m_ring.size();
+	if (m_count < m_ring.size())
+		m_count++;
+
+	m_stats.Captures++;
+	m_stats.Microseconds += std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start ).count();
+}
+
+int DeltaStateRing::Restore( uint age, VmStateBuffer& dest ) const
+{
+	if (age >= m_count)
+		return 0;
+
+	const Delta& delta = m_ring[(m_head + m_ring.size() - 1 - age) % m_ring.size()];
+	const Keyframe& base = *delta.Base;
+	const int size = base.size();
+
+	dest.MakeRoomFor( size );
+	memcpy( dest.GetPtr(), base.data(), size );
+
+	const u8* src = delta.Data.data();
+	for (u32 page : delta.Pages)
+	{
+		const int offset = page * PageSize;
+		const int len = std::min( PageSize, size - offset );
+
+		memcpy( dest.GetPtr( offset ), src, len );
+		src += len;
+	}
+
+	return size;
+}
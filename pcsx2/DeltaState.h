@@ -0,0 +1,80 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "SaveState.h"
+
+#include <memory>
+
+// --------------------------------------------------------------------------------------
+//  DeltaStateRing
+// --------------------------------------------------------------------------------------
+// Keeps the last few memory states for rewind/run-ahead without storing each of them in
+// full.  Every KeyframeInterval captures a full copy of the state is taken, the captures
+// in between only store the pages that differ from that keyframe, so any entry can be
+// rebuilt with a single keyframe + delta pass.
+//
+// Captures take a state refreshed by memDeltaSavingState along with its changed-page map.
+class DeltaStateRing
+{
+public:
+	static const int PageSize = memDeltaSavingState::StatePageSize;
+
+	struct Stats
+	{
+		u64 Captures;
+		u64 Keyframes;
+		u64 Bytes;		// keyframe and delta bytes stored
+		u64 Microseconds;	// time spent capturing
+	};
+
+protected:
+	typedef std::vector<u8> Keyframe;
+
+	struct Delta
+	{
+		std::shared_ptr<const Keyframe> Base;
+		std::vector<u32> Pages;
+		std::vector<u8> Data;
+	};
+
+	std::vector<Delta> m_ring;
+	uint m_head;		// slot the next capture goes to
+	uint m_count;
+
+	std::shared_ptr<const Keyframe> m_keyframe;
+	std::vector<u8> m_sinceKeyframe;	// pages changed since the current keyframe
+	int m_keyframeInterval;
+	int m_untilKeyframe;
+
+	Stats m_stats;
+
+public:
+	DeltaStateRing( uint capacity, int keyframeInterval );
+	virtual ~DeltaStateRing() = default;
+
+	void Capture( const VmStateBuffer& state, int size, const std::vector<u8>& changed );
+
+	// Rebuilds the state captured 'age' captures ago (0 = latest) into 'dest'.  Returns
+	// the size of the state, or 0 if the ring doesn't go back that far.
+	int Restore( uint age, VmStateBuffer& dest ) const;
+
+	void Clear();
+
+	uint GetCount() const { return m_count; }
+	const Stats& GetStats() const { return m_stats; }
+	void ResetStats() { memzero( m_stats ); }
+};
@@ -157,7 +157,11 @@ void ElfObject::loadSectionHeaders()
 		for(uint i = 1; i < (secthead[i_st].sh_size / sizeof(Elf32_Sym)); i++) {
 			if ((eS[i].st_value != 0) && (ELF32_ST_TYPE(eS[i].st_info) == 2))
 			{
-				symbolMap.AddLabel(&SymNames[eS[i].st_name],eS[i].st_value);
+				// with a size it is also known as a function, for looking up what contains an address
+				if (eS[i].st_size != 0)
+					symbolMap.AddFunction(&SymNames[eS[i].st_name],eS[i].st_value,eS[i].st_size);
+				else
+					symbolMap.AddLabel(&SymNames[eS[i].st_name],eS[i].st_value);
 			}
 		}
 	}
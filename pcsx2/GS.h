@@ -265,6 +265,20 @@ public:
 	std::atomic<int>	m_QueuedFrameCount;
 	std::atomic<bool>	m_VsyncSignalListener;
 
+#ifdef __LIBRETRO__
+	// Set while FlushRingInThread() is running: vsync packets no longer end the task,
+	// an empty ringbuffer does.
+	std::atomic<bool>	m_FlushRingOnly;
+	// Set while FlushRingUntilEEPaused() is running: the ringbuffer running dry only ends
+	// the task once the EE is paused as well.
+	std::atomic<bool>	m_FlushUntilEEPaused;
+	// Lockstep with the frontend (savestates): the EE waits for each of its vsyncs to be
+	// processed, which then requests the core thread to pause at the next one.
+	std::atomic<bool>	m_PauseAtVsync;
+	// Set by the EE once it is parked in a paused state, cleared before resuming it.
+	std::atomic<bool>	m_EEPaused;
+#endif
+
 	Mutex			m_mtx_RingBufferBusy;  // Is obtained while processing ring-buffer data
 	Mutex			m_mtx_RingBufferBusy2; // This one gets released on semaXGkick waiting...
 	Mutex			m_mtx_WaitGS;
@@ -308,6 +322,11 @@ public:
 
 	void ExecuteTaskInThread();
 	void FinishTaskInThread();
+#ifdef __LIBRETRO__
+	void FlushRingInThread();
+	void FlushRingUntilEEPaused();
+	void NotifyEEPaused();
+#endif
 	void OpenGS();
 	void CloseGS();
 
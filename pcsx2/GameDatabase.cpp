@@ -72,6 +72,26 @@ static std::vector<std::string> convertMultiLineStringToVector(const std::string
 	return lines;
 }
 
+static bool isValidGameFix(const std::string& fix)
+{
+	for (GamefixId id = GamefixId_FIRST; id < pxEnumEnd; id++)
+	{
+		if (wxString(EnumToString(id)).ToStdString() + "Hack" == fix)
+			return true;
+	}
+	return false;
+}
+
+static bool isValidSpeedHack(const std::string& speedHack)
+{
+	for (SpeedhackId id = SpeedhackId_FIRST; id < pxEnumEnd; id++)
+	{
+		if (wxString(EnumToString(id)).ToStdString() + "SpeedHack" == speedHack)
+			return true;
+	}
+	return false;
+}
+
 static GameDatabaseSchema::GameEntry entryFromYaml(const std::string serial, const YAML::Node& node)
 {
 	GameDatabaseSchema::GameEntry gameEntry;
@@ -95,17 +115,7 @@ static GameDatabaseSchema::GameEntry entryFromYaml(const std::string serial, con
 		// Validate game fixes, invalid ones will be dropped!
 		for (std::string& fix : node["gameFixes"].as<std::vector<std::string>>(std::vector<std::string>()))
 		{
-			bool fixValidated = false;
-			for (GamefixId id = GamefixId_FIRST; id < pxEnumEnd; id++)
-			{
-				std::string validFix =wxString(EnumToString(id)).ToStdString() + "Hack";
-				if (validFix == fix)
-				{
-					fixValidated = true;
-					break;
-				}
-			}
-			if (fixValidated)
+			if (isValidGameFix(fix))
 			{
 				gameEntry.gameFixes.push_back(fix);
 			} else
@@ -120,17 +130,7 @@ static GameDatabaseSchema::GameEntry entryFromYaml(const std::string serial, con
 			for (const auto& entry : speedHacksNode)
 			{
 				std::string speedHack = entry.first.as<std::string>();
-				bool speedHackValidated = false;
-				for (SpeedhackId id = SpeedhackId_FIRST; id < pxEnumEnd; id++)
-				{
-					std::string validSpeedHack = wxString(EnumToString(id)).ToStdString() + "SpeedHack";
-					if (validSpeedHack == speedHack)
-					{
-						speedHackValidated = true;
-						break;
-					}
-				}
-				if (speedHackValidated)
+				if (isValidSpeedHack(speedHack))
 				{
 					gameEntry.speedHacks[speedHack] = entry.second.as<int>();
 				} else
@@ -231,3 +231,160 @@ bool YamlGameDatabaseImpl::initDatabase(std::istream& stream)
 
 	return true;
 }
+
+const char* BinaryGameDatabaseImpl::getString(u32 offset) const
+{
+	// The pool ends with a NUL (checked in initDatabase), so any offset inside it is a valid string
+	return offset < header->stringsSize ? strings + offset : "";
+}
+
+bool BinaryGameDatabaseImpl::getList(const GameIndexBin::List& list, u32 stride, const u32*& out) const
+{
+	if (list.count == 0)
+	{
+		out = nullptr;
+		return true;
+	}
+	if (list.first > header->refCount || list.count > (header->refCount - list.first) / stride)
+		return false;
+	out = refs + list.first;
+	return true;
+}
+
+std::vector<std::string> BinaryGameDatabaseImpl::getStrings(const GameIndexBin::List& list) const
+{
+	std::vector<std::string> out;
+	const u32* items;
+	if (getList(list, 1, items))
+	{
+		out.reserve(list.count);
+		for (u32 i = 0; i < list.count; i++)
+			out.emplace_back(getString(items[i]));
+	}
+	return out;
+}
+
+GameDatabaseSchema::GameEntry BinaryGameDatabaseImpl::decodeEntry(const GameIndexBin::Entry& bin) const
+{
+	const char* serial = getString(bin.serial);
+
+	GameDatabaseSchema::GameEntry gameEntry;
+	gameEntry.isValid = !(bin.flags & GameIndexBin::Entry_Invalid);
+	gameEntry.name = getString(bin.name);
+	gameEntry.region = getString(bin.region);
+	gameEntry.compat = static_cast<GameDatabaseSchema::Compatibility>(bin.compat);
+	gameEntry.eeRoundMode = static_cast<GameDatabaseSchema::RoundMode>(bin.eeRoundMode);
+	gameEntry.vuRoundMode = static_cast<GameDatabaseSchema::RoundMode>(bin.vuRoundMode);
+	gameEntry.eeClampMode = static_cast<GameDatabaseSchema::ClampMode>(bin.eeClampMode);
+	gameEntry.vuClampMode = static_cast<GameDatabaseSchema::ClampMode>(bin.vuClampMode);
+
+	// The compiler doesn't know the gamefix and speedhack names, validate them here as
+	// entryFromYaml does
+	for (std::string& fix : getStrings(bin.gameFixes))
+	{
+		if (isValidGameFix(fix))
+			gameEntry.gameFixes.push_back(fix);
+		else
+			log_cb(RETRO_LOG_ERROR, "[GameDB] Invalid gamefix: '%s', specified for serial: '%s'. Dropping!\n", fix.c_str(), serial);
+	}
+
+	const u32* speedHacks;
+	if (getList(bin.speedHacks, 2, speedHacks))
+	{
+		const GameIndexBin::SpeedHack* hacks = reinterpret_cast<const GameIndexBin::SpeedHack*>(speedHacks);
+		for (u32 i = 0; i < bin.speedHacks.count; i++)
+		{
+			std::string speedHack = getString(hacks[i].name);
+			if (isValidSpeedHack(speedHack))
+				gameEntry.speedHacks[speedHack] = hacks[i].value;
+			else
+				log_cb(RETRO_LOG_ERROR, "[GameDB] Invalid speedhack: '%s', specified for serial: '%s'. Dropping!\n", speedHack.c_str(), serial);
+		}
+	}
+
+	gameEntry.memcardFilters = getStrings(bin.memcardFilters);
+
+	const u32* patches;
+	if (getList(bin.patches, 4, patches))
+	{
+		const GameIndexBin::Patch* patch = reinterpret_cast<const GameIndexBin::Patch*>(patches);
+		for (u32 i = 0; i < bin.patches.count; i++)
+		{
+			GameDatabaseSchema::Patch& patchCol = gameEntry.patches[getString(patch[i].crc)];
+			patchCol.author = getString(patch[i].author);
+			patchCol.patchLines = getStrings(patch[i].lines);
+		}
+	}
+
+	return gameEntry;
+}
+
+GameDatabaseSchema::GameEntry BinaryGameDatabaseImpl::findGame(const std::string serial)
+{
+	std::string serialLower = strToLower(serial);
+	log_cb(RETRO_LOG_INFO, "[GameDB] Searching for '%s' in GameDB\n", serialLower.c_str());
+	if (header)
+	{
+		const GameIndexBin::Entry* end = entries + header->entryCount;
+		const GameIndexBin::Entry* it = std::lower_bound(entries, end, serialLower.c_str(),
+			[this](const GameIndexBin::Entry& entry, const char* key) { return strcmp(getString(entry.serial), key) < 0; });
+		if (it != end && serialLower == getString(it->serial))
+		{
+			log_cb(RETRO_LOG_INFO, "[GameDB] Found '%s' in GameDB\n", serialLower.c_str());
+			return decodeEntry(*it);
+		}
+	}
+
+	log_cb(RETRO_LOG_ERROR, "[GameDB] Could not find '%s' in GameDB\n", serialLower.c_str());
+	GameDatabaseSchema::GameEntry entry;
+	entry.isValid = false;
+	return entry;
+}
+
+bool BinaryGameDatabaseImpl::initDatabase(const void* data, size_t size)
+{
+	header = nullptr;
+
+	const GameIndexBin::Header* hdr = static_cast<const GameIndexBin::Header*>(data);
+	if (!data || size < sizeof(GameIndexBin::Header) || hdr->magic != GameIndexBin::Magic || hdr->version != GameIndexBin::Version)
+	{
+		log_cb(RETRO_LOG_ERROR, "[GameDB] Precompiled GameDB is missing or from another version.\n");
+		return false;
+	}
+
+	const u8* base = static_cast<const u8*>(data);
+	const bool inRange =
+		hdr->entriesOffset % alignof(GameIndexBin::Entry) == 0 &&
+		hdr->entriesOffset <= size && hdr->entryCount <= (size - hdr->entriesOffset) / sizeof(GameIndexBin::Entry) &&
+		hdr->refsOffset % alignof(u32) == 0 &&
+		hdr->refsOffset <= size && hdr->refCount <= (size - hdr->refsOffset) / sizeof(u32) &&
+		hdr->stringsOffset <= size && hdr->stringsSize > 0 && hdr->stringsSize <= size - hdr->stringsOffset &&
+		base[hdr->stringsOffset + hdr->stringsSize - 1] == 0;
+	if (!inRange)
+	{
+		log_cb(RETRO_LOG_ERROR, "[GameDB] Precompiled GameDB is corrupted.\n");
+		return false;
+	}
+
+	header = hdr;
+	entries = reinterpret_cast<const GameIndexBin::Entry*>(base + hdr->entriesOffset);
+	refs = reinterpret_cast<const u32*>(base + hdr->refsOffset);
+	strings = reinterpret_cast<const char*>(base + hdr->stringsOffset);
+
+	log_cb(RETRO_LOG_INFO, "[GameDB] %u entries in precompiled GameDB\n", header->entryCount);
+	return true;
+}
+
+bool BinaryGameDatabaseImpl::initDatabase(std::istream& stream)
+{
+	if (!stream)
+	{
+		log_cb(RETRO_LOG_ERROR, "[GameDB] Unable to open GameDB file.\n");
+		return false;
+	}
+
+	std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	buffer.assign((data.size() + sizeof(u32) - 1) / sizeof(u32), 0);
+	memcpy(buffer.data(), data.data(), data.size());
+	return initDatabase(buffer.data(), data.size());
+}
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "GameDatabaseBinary.h"
 #include "yaml-cpp/yaml.h"
 
 #include <unordered_map>
@@ -98,3 +99,28 @@ public:
 private:
 	std::unordered_map<std::string, GameDatabaseSchema::GameEntry> gameDb;
 };
+
+// Reads the table precompiled from GameIndex.yaml by tools/GameIndexCompiler (see
+// GameDatabaseBinary.h).  Nothing is decoded up front, findGame binary searches the
+// serials and only builds the entry that was asked for.
+class BinaryGameDatabaseImpl : public IGameDatabase
+{
+public:
+	// Copies the table out of the stream.
+	bool initDatabase(std::istream& stream) override;
+	// Uses the table in place, 'data' must stay valid and be 4-byte aligned.
+	bool initDatabase(const void* data, size_t size);
+	GameDatabaseSchema::GameEntry findGame(const std::string serial) override;
+
+private:
+	std::vector<u32> buffer;
+	const GameIndexBin::Header* header = nullptr;
+	const GameIndexBin::Entry* entries = nullptr;
+	const u32* refs = nullptr;
+	const char* strings = nullptr;
+
+	const char* getString(u32 offset) const;
+	bool getList(const GameIndexBin::List& list, u32 stride, const u32*& out) const;
+	std::vector<std::string> getStrings(const GameIndexBin::List& list) const;
+	GameDatabaseSchema::GameEntry decodeEntry(const GameIndexBin::Entry& bin) const;
+};
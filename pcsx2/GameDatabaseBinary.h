@@ -0,0 +1,98 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Layout of the precompiled GameDB written by tools/GameIndexCompiler from GameIndex.yaml.
+// This header is shared with the compiler so it must not pull in anything from PCSX2.
+//
+//   Header
+//   Entry[entryCount]      sorted by serial (lower-case, strcmp order)
+//   uint32_t[refCount]     lists referenced by the entries
+//   char[stringsSize]      interned NUL terminated strings, offset 0 is the empty string
+//
+// Lists are a (first, count) range in the ref table:
+//   gameFixes, memcardFilters  one string offset per item
+//   speedHacks                 SpeedHack (2 refs) per item
+//   patches                    Patch (4 refs) per item, its lines being a list of string offsets
+//
+// Everything is stored in host byte order; the table is generated at build time for the
+// build target.
+namespace GameIndexBin
+{
+	static const uint32_t Magic = 0x42444947; // 'GIDB'
+	static const uint32_t Version = 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t entriesOffset;
+		uint32_t refCount;
+		uint32_t refsOffset;
+		uint32_t stringsSize;
+		uint32_t stringsOffset;
+	};
+
+	enum EntryFlags : uint8_t
+	{
+		Entry_Invalid = 1 << 0, // the YAML entry failed to parse
+	};
+
+	struct List
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct Entry
+	{
+		uint32_t serial;
+		uint32_t name;
+		uint32_t region;
+		int8_t compat;
+		int8_t eeRoundMode;
+		int8_t vuRoundMode;
+		int8_t eeClampMode;
+		int8_t vuClampMode;
+		uint8_t flags;
+		uint16_t pad;
+		List gameFixes;
+		List speedHacks;
+		List memcardFilters;
+		List patches;
+	};
+
+	struct SpeedHack
+	{
+		uint32_t name;
+		int32_t value;
+	};
+
+	struct Patch
+	{
+		uint32_t crc;
+		uint32_t author;
+		List lines;
+	};
+
+	static_assert(sizeof(Header) == 32, "GameIndexBin::Header layout");
+	static_assert(sizeof(Entry) == 52, "GameIndexBin::Entry layout");
+	static_assert(sizeof(SpeedHack) == 2 * sizeof(uint32_t), "GameIndexBin::SpeedHack layout");
+	static_assert(sizeof(Patch) == 4 * sizeof(uint32_t), "GameIndexBin::Patch layout");
+} // namespace GameIndexBin
@@ -16,6 +16,479 @@
 #include "PrecompiledHeader.h"
 #include "AsyncFileReader.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define FLATFILE_IO_URING
+#endif
+#endif
+#endif
+
+// --------------------------------------------------------------------------------------
+//  FlatFileUring
+// --------------------------------------------------------------------------------------
+// Reads the file through io_uring, in chunks held by a small ring of buffers registered with
+// the kernel.  The chunks of a read are submitted together along with the chunks following
+// them when the reads are sequential, so the next reads are usually served from memory.
+// The file is opened a second time with O_DIRECT for these reads when the filesystem allows
+// it since the chunks are cached here already, and dropped on the first read it refuses.
+//
+// The raw syscalls are used, liburing isn't needed.  Create() returns null when the kernel
+// doesn't support io_uring (or it's disabled), FlatFileReader uses AIO then.
+#ifdef FLATFILE_IO_URING
+
+class FlatFileUring
+{
+	DeclareNoncopyableObject(FlatFileUring);
+
+public:
+	static const u32 ChunkSize = 128 * 1024;
+	static const u32 SlotCount = 32;
+	static const u32 ReadAheadChunks = 8;
+
+	static std::unique_ptr<FlatFileUring> Create(const wxString& fileName, int fd);
+	~FlatFileUring();
+
+	void BeginRead(void* pBuffer, s64 offset, u32 bytes);
+	int FinishRead();
+	void CancelRead() { m_dest = NULL; }
+
+private:
+	enum class SlotState
+	{
+		Free,
+		InFlight,
+		Ready,
+	};
+
+	struct Slot
+	{
+		s64 chunk;
+		SlotState state;
+		int bytes; // result of the read, negative errno on failure
+		u32 lastUse;
+	};
+
+	int m_ring_fd = -1;
+	int m_fd; // owned by FlatFileReader
+	int m_direct_fd = -1;
+	s64 m_file_size = 0;
+
+	void* m_sq_ptr = MAP_FAILED;
+	void* m_cq_ptr = MAP_FAILED;
+	size_t m_sq_size = 0;
+	size_t m_cq_size = 0;
+	io_uring_sqe* m_sqes = (io_uring_sqe*)MAP_FAILED;
+	size_t m_sqes_size = 0;
+
+	u32* m_sq_head;
+	u32* m_sq_tail;
+	u32* m_sq_mask;
+	u32* m_sq_entries;
+	u32* m_sq_array;
+	u32* m_cq_head;
+	u32* m_cq_tail;
+	u32* m_cq_mask;
+	io_uring_cqe* m_cqes;
+
+	u8* m_buffers = NULL;
+	bool m_registered = false;
+	Slot m_slots[SlotCount];
+	iovec m_iovs[SlotCount]; // READV only
+	u32 m_to_submit = 0;
+	u32 m_in_flight = 0;
+	u32 m_stamp = 0;
+	s64 m_next_chunk = -1;
+
+	void* m_dest = NULL;
+	s64 m_offset = 0;
+	u32 m_bytes = 0;
+
+	FlatFileUring(int fd) : m_fd(fd) {}
+
+	bool Setup(const wxString& fileName);
+	int Enter(u32 toSubmit, u32 minComplete);
+	void Submit();
+	void Reap();
+
+	int Find(s64 chunk) const;
+	int Load(s64 chunk);
+	bool Wait(int slot);
+	int ReadDirect(u8* dest, s64 offset, u32 bytes);
+
+	u8* GetBuffer(int slot) const { return m_buffers + (size_t)slot * ChunkSize; }
+};
+
+std::unique_ptr<FlatFileUring> FlatFileUring::Create(const wxString& fileName, int fd)
+{
+	std::unique_ptr<FlatFileUring> uring(new FlatFileUring(fd));
+	if (!uring->Setup(fileName))
+		return nullptr;
+	return uring;
+}
+
+bool FlatFileUring::Setup(const wxString& fileName)
+{
+	struct stat st;
+	if (fstat(m_fd, &st) != 0)
+		return false;
+	m_file_size = st.st_size;
+
+	io_uring_params params = {};
+	m_ring_fd = syscall(__NR_io_uring_setup, SlotCount, &params);
+	if (m_ring_fd < 0)
+		return false;
+
+	m_sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+	m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+	m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+	if (m_sq_ptr == MAP_FAILED)
+		return false;
+	if (!single_mmap)
+	{
+		m_cq_ptr = mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+		if (m_cq_ptr == MAP_FAILED)
+			return false;
+	}
+	m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = (io_uring_sqe*)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED)
+		return false;
+
+	u8* sq = (u8*)m_sq_ptr;
+	u8* cq = single_mmap ? sq : (u8*)m_cq_ptr;
+	m_sq_head = (u32*)(sq + params.sq_off.head);
+	m_sq_tail = (u32*)(sq + params.sq_off.tail);
+	m_sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+	m_sq_entries = (u32*)(sq + params.sq_off.ring_entries);
+	m_sq_array = (u32*)(sq + params.sq_off.array);
+	m_cq_head = (u32*)(cq + params.cq_off.head);
+	m_cq_tail = (u32*)(cq + params.cq_off.tail);
+	m_cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+	m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	// Page aligned, which covers the O_DIRECT requirements.
+	if (posix_memalign((void**)&m_buffers, 4096, (size_t)SlotCount * ChunkSize) != 0)
+	{
+		m_buffers = NULL;
+		return false;
+	}
+
+	// Registering pins the buffers, it can fail against RLIMIT_MEMLOCK on older kernels.
+	// Plain reads into the same buffers are used then.
+	iovec iov = {m_buffers, (size_t)SlotCount * ChunkSize};
+	m_registered = syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+	m_direct_fd = wxOpen(fileName, O_RDONLY | O_DIRECT, 0);
+
+	for (Slot& slot : m_slots)
+	{
+		slot.chunk = -1;
+		slot.state = SlotState::Free;
+		slot.bytes = 0;
+		slot.lastUse = 0;
+	}
+
+	return true;
+}
+
+FlatFileUring::~FlatFileUring()
+{
+	// Reads still in flight write to the buffers, wait for them.
+	while (m_in_flight > 0)
+	{
+		if (Enter(m_to_submit, 1) < 0)
+			break;
+		Reap();
+	}
+
+	if (m_ring_fd >= 0)
+		close(m_ring_fd);
+	if (m_direct_fd >= 0)
+		close(m_direct_fd);
+	if (m_sqes != MAP_FAILED)
+		munmap(m_sqes, m_sqes_size);
+	if (m_cq_ptr != MAP_FAILED)
+		munmap(m_cq_ptr, m_cq_size);
+	if (m_sq_ptr != MAP_FAILED)
+		munmap(m_sq_ptr, m_sq_size);
+	free(m_buffers);
+}
+
+int FlatFileUring::Enter(u32 toSubmit, u32 minComplete)
+{
+	const u32 flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+	for (;;)
+	{
+		const int ret = syscall(__NR_io_uring_enter, m_ring_fd, toSubmit, minComplete, flags, NULL, 0);
+		if (ret >= 0)
+		{
+			m_to_submit -= std::min<u32>(ret, m_to_submit);
+			return ret;
+		}
+		if (errno != EINTR && errno != EAGAIN)
+			return -errno;
+	}
+}
+
+void FlatFileUring::Submit()
+{
+	// On failure they are left queued, the next Enter() picks them up.
+	if (m_to_submit > 0)
+		Enter(m_to_submit, 0);
+}
+
+void FlatFileUring::Reap()
+{
+	u32 head = *m_cq_head;
+	const u32 tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+		Slot& slot = m_slots[cqe.user_data];
+		slot.bytes = cqe.res;
+		// The filesystem accepted O_DIRECT at open but refuses the reads (alignment, or no
+		// direct io support at all), go through the regular fd from now on.  The reads
+		// already queued on it fail the same way and are redone by FinishRead.
+		if (cqe.res == -EINVAL && m_direct_fd >= 0)
+		{
+			close(m_direct_fd);
+			m_direct_fd = -1;
+		}
+		slot.state = SlotState::Ready;
+		m_in_flight--;
+	}
+	__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+}
+
+int FlatFileUring::Find(s64 chunk) const
+{
+	for (u32 i = 0; i < SlotCount; i++)
+		if (m_slots[i].state != SlotState::Free && m_slots[i].chunk == chunk)
+			return i;
+	return -1;
+}
+
+// Returns the slot holding the chunk, queuing its read when it isn't there yet, or -1 when
+// every slot is busy.
+int FlatFileUring::Load(s64 chunk)
+{
+	int found = Find(chunk);
+	if (found >= 0)
+	{
+		m_slots[found].lastUse = ++m_stamp;
+		return found;
+	}
+
+	// A free slot, else the least recently used one that isn't being read into.
+	int victim = -1;
+	for (u32 i = 0; i < SlotCount; i++)
+	{
+		const Slot& slot = m_slots[i];
+		if (slot.state == SlotState::Free)
+		{
+			victim = i;
+			break;
+		}
+		if (slot.state == SlotState::Ready && (victim < 0 || (s32)(slot.lastUse - m_slots[victim].lastUse) < 0))
+			victim = i;
+	}
+	if (victim < 0)
+		return -1;
+
+	const u32 tail = *m_sq_tail;
+	if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= *m_sq_entries)
+		return -1;
+
+	const u32 index = tail & *m_sq_mask;
+	io_uring_sqe& sqe = m_sqes[index];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = m_registered ? IORING_OP_READ_FIXED : IORING_OP_READV;
+	sqe.fd = m_direct_fd >= 0 ? m_direct_fd : m_fd;
+	sqe.off = chunk * ChunkSize;
+	sqe.user_data = victim;
+	if (m_registered)
+	{
+		sqe.addr = (u64)(uptr)GetBuffer(victim);
+		sqe.len = ChunkSize;
+		sqe.buf_index = 0;
+	}
+	else
+	{
+		// The iovec has to stay valid until the kernel picks the submission up.
+		m_iovs[victim].iov_base = GetBuffer(victim);
+		m_iovs[victim].iov_len = ChunkSize;
+		sqe.addr = (u64)(uptr)&m_iovs[victim];
+		sqe.len = 1;
+	}
+	m_sq_array[index] = index;
+	__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	Slot& slot = m_slots[victim];
+	slot.chunk = chunk;
+	slot.state = SlotState::InFlight;
+	slot.bytes = 0;
+	slot.lastUse = ++m_stamp;
+	m_to_submit++;
+	m_in_flight++;
+	return victim;
+}
+
+bool FlatFileUring::Wait(int slot)
+{
+	while (m_slots[slot].state == SlotState::InFlight)
+	{
+		if (Enter(m_to_submit, 1) < 0)
+			return false;
+		Reap();
+	}
+	return true;
+}
+
+int FlatFileUring::ReadDirect(u8* dest, s64 offset, u32 bytes)
+{
+	u32 done = 0;
+	while (done < bytes)
+	{
+		const ssize_t ret = pread(m_fd, dest + done, bytes - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+	return done;
+}
+
+void FlatFileUring::BeginRead(void* pBuffer, s64 offset, u32 bytes)
+{
+	m_dest = pBuffer;
+	m_offset = offset;
+	m_bytes = bytes;
+	if (bytes == 0)
+		return;
+
+	const s64 first = offset / ChunkSize;
+	const s64 last = (offset + bytes - 1) / ChunkSize;
+	// Reads too large for the slots are done directly by FinishRead.
+	if (last - first + 1 > SlotCount - ReadAheadChunks)
+		return;
+
+	for (s64 chunk = first; chunk <= last; chunk++)
+		Load(chunk);
+
+	// Keep the chunks ahead of a sequential read coming in.
+	if (first == m_next_chunk || first + 1 == m_next_chunk)
+	{
+		const s64 end_chunk = (m_file_size + ChunkSize - 1) / ChunkSize;
+		for (s64 chunk = last + 1; chunk <= last + ReadAheadChunks && chunk < end_chunk; chunk++)
+			if (Load(chunk) < 0)
+				break;
+	}
+	m_next_chunk = last + 1;
+
+	Submit();
+}
+
+int FlatFileUring::FinishRead()
+{
+	if (!m_dest)
+		return -1;
+
+	u8* dest = (u8*)m_dest;
+	m_dest = NULL;
+
+	const s64 first = m_offset / ChunkSize;
+	const s64 last = m_bytes ? (m_offset + m_bytes - 1) / ChunkSize : first;
+	if (last - first + 1 > SlotCount - ReadAheadChunks)
+		return ReadDirect(dest, m_offset, m_bytes);
+
+	s64 pos = m_offset;
+	u32 done = 0;
+	while (done < m_bytes)
+	{
+		const s64 chunk = pos / ChunkSize;
+		const u32 chunk_pos = pos % ChunkSize;
+		const u32 len = std::min<u32>(m_bytes - done, ChunkSize - chunk_pos);
+
+		int slot = Find(chunk);
+		if (slot >= 0 && !Wait(slot))
+			slot = -1;
+
+		if (slot < 0 || m_slots[slot].bytes < 0)
+		{
+			// Not queued (every slot busy) or the read failed, e.g. O_DIRECT or the
+			// opcode being refused.  Read it synchronously.
+			if (slot >= 0)
+				m_slots[slot].state = SlotState::Free;
+			const int ret = ReadDirect(dest + done, pos, len);
+			if (ret < 0)
+				return -1;
+			done += ret;
+			if ((u32)ret < len)
+				break;
+		}
+		else
+		{
+			const Slot& s = m_slots[slot];
+			if ((u32)s.bytes <= chunk_pos)
+				break;
+			const u32 avail = std::min<u32>(len, s.bytes - chunk_pos);
+			memcpy(dest + done, GetBuffer(slot) + chunk_pos, avail);
+			done += avail;
+			if (avail < len)
+			{
+				// Short read before the end of the file, get the rest directly.
+				if (pos + avail < m_file_size)
+				{
+					const int ret = ReadDirect(dest + done, pos + avail, len - avail);
+					if (ret < 0)
+						return -1;
+					done += ret;
+					if ((u32)ret < len - avail)
+						break;
+				}
+				else
+					break;
+			}
+		}
+		pos += len;
+	}
+
+	return done;
+}
+
+#else
+
+class FlatFileUring
+{
+public:
+	static std::unique_ptr<FlatFileUring> Create(const wxString&, int) { return nullptr; }
+
+	void BeginRead(void*, s64, u32) {}
+	int FinishRead() { return -1; }
+	void CancelRead() {}
+};
+
+#endif
+
+// --------------------------------------------------------------------------------------
+//  FlatFileReader
+// --------------------------------------------------------------------------------------
+
 FlatFileReader::FlatFileReader(bool shareWrite) : shareWrite(shareWrite)
 {
 	m_blocksize = 2048;
@@ -32,12 +505,22 @@ bool FlatFileReader::Open(const wxString& fileName)
 {
 	m_filename = fileName;
 
-	int err = io_setup(64, &m_aio_context);
-	if (err) return false;
-
     m_fd = wxOpen(fileName, O_RDONLY, 0);
+	if (m_fd == -1)
+		return false;
+
+	m_uring = FlatFileUring::Create(fileName, m_fd);
+	if (m_uring)
+		return true;
+
+	int err = io_setup(64, &m_aio_context);
+	if (err)
+	{
+		Close();
+		return false;
+	}
 
-	return (m_fd != -1);
+	return true;
 }
 
 int FlatFileReader::ReadSync(void* pBuffer, uint sector, uint count)
@@ -53,6 +536,12 @@ void FlatFileReader::BeginRead(void* pBuffer, uint sector, uint count)
 
 	u32 bytesToRead = count * m_blocksize;
 
+	if (m_uring)
+	{
+		m_uring->BeginRead(pBuffer, offset, bytesToRead);
+		return;
+	}
+
 	struct iocb iocb;
 	struct iocb* iocbs = &iocb;
 
@@ -62,6 +551,9 @@ void FlatFileReader::BeginRead(void* pBuffer, uint sector, uint count)
 
 int FlatFileReader::FinishRead(void)
 {
+	if (m_uring)
+		return m_uring->FinishRead();
+
 	int min_nr = 1;
 	int max_nr = 1;
 	struct io_event events[max_nr];
@@ -76,6 +568,13 @@ int FlatFileReader::FinishRead(void)
 
 void FlatFileReader::CancelRead(void)
 {
+	// io_uring: the read is left to complete into its slot, it may serve a later read.
+	if (m_uring)
+	{
+		m_uring->CancelRead();
+		return;
+	}
+
 	// Will be done when m_aio_context context is destroyed
 	// Note: io_cancel exists but need the iocb structure as parameter
 	// int io_cancel(aio_context_t ctx_id, struct iocb *iocb,
@@ -84,10 +583,12 @@ void FlatFileReader::CancelRead(void)
 
 void FlatFileReader::Close(void)
 {
+	m_uring.reset();
 
 	if (m_fd != -1) close(m_fd);
 
-	io_destroy(m_aio_context);
+	if (m_aio_context)
+		io_destroy(m_aio_context);
 
 	m_fd = -1;
 	m_aio_context = 0;
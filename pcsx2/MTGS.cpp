@@ -60,6 +60,12 @@ void SysMtgsThread::OnStart()
 	m_VsyncSignalListener = false;
 	m_SignalRingEnable    = false;
 	m_SignalRingPosition  = 0;
+#ifdef __LIBRETRO__
+	m_FlushRingOnly       = false;
+	m_FlushUntilEEPaused  = false;
+	m_PauseAtVsync        = false;
+	m_EEPaused            = false;
+#endif
 
 	m_CopyDataTally		= 0;
 
@@ -137,8 +143,16 @@ void SysMtgsThread::PostVsyncStart()
 	// If those are needed back, it's better to increase the VsyncQueueSize via PCSX_vm.ini.
 	// (The Xenosaga engine is known to run into this, due to it throwing bulks of data in one frame followed by 2 empty frames.)
 
+#ifdef __LIBRETRO__
+	// In lockstep no frame is queued ahead, the EE has to stop at the next vsync with
+	// nothing left in the ring but what it sent since this one.
+	const bool queued = m_QueuedFrameCount.fetch_add(1) < EmuConfig.GS.VsyncQueueSize;
+	if (queued && !m_PauseAtVsync.load(std::memory_order_relaxed))
+		return;
+#else
 	if ((m_QueuedFrameCount.fetch_add(1) < EmuConfig.GS.VsyncQueueSize))
 		return;
+#endif
 
 	m_VsyncSignalListener.store(true, std::memory_order_release);
 
@@ -226,16 +240,31 @@ void SysMtgsThread::ExecuteTaskInThread()
 #endif
 	// Threading info: run in MTGS thread
 	// m_ReadPos is only update by the MTGS thread so it is safe to load it with a relaxed atomic
+#ifdef __LIBRETRO__
+	auto flushed = [this]() {
+		return m_FlushRingOnly.load(std::memory_order_relaxed) &&
+			(!m_FlushUntilEEPaused.load(std::memory_order_relaxed) || m_EEPaused.load(std::memory_order_acquire)) &&
+			m_ReadPos.load(std::memory_order_relaxed) == m_WritePos.load(std::memory_order_acquire);
+	};
+#endif
         for (;;)
 	{
 #ifdef __LIBRETRO__
 		while (wxTheApp->HasPendingEvents())
 			wxTheApp->ProcessPendingEvents();
 
+		// When only flushing, return as soon as the ring is drained rather than after
+		// the wait below times out.
+		if (flushed())
+			return;
+
 		while (!m_sem_event.WaitWithoutYield(wxTimeSpan::Millisecond()))
 		{
 			while (wxTheApp->HasPendingEvents())
 				wxTheApp->ProcessPendingEvents();
+
+			if (flushed())
+				return;
 		}
 		StateCheckInThread();
 #else
@@ -313,6 +342,13 @@ void SysMtgsThread::ExecuteTaskInThread()
 								// CSR & 0x2000; is the pageflip id.
 								GSvsync(((u32&)RingBuffer.Regs[0x1000]) & 0x2000);
 
+#ifdef __LIBRETRO__
+								// The EE is held in PostVsyncStart until released below, so it
+								// parks at the very next vsync: one frame after this one.
+								if (m_PauseAtVsync.load(std::memory_order_relaxed) && !m_FlushRingOnly.load(std::memory_order_relaxed))
+									GetCoreThread().Pause(false);
+#endif
+
 								m_QueuedFrameCount.fetch_sub(1);
 								if (m_VsyncSignalListener.exchange(false))
 									m_sem_Vsync.Post();
@@ -378,7 +414,7 @@ void SysMtgsThread::ExecuteTaskInThread()
 				}
 			}
 #ifdef __LIBRETRO__
-			if(tag.command == GS_RINGTYPE_VSYNC)
+			if(tag.command == GS_RINGTYPE_VSYNC && !m_FlushRingOnly.load(std::memory_order_relaxed))
 			{
 #ifndef __LIBRETRO__
 				busy.Release();
@@ -423,6 +459,35 @@ void SysMtgsThread::FinishTaskInThread()
 		m_sem_Vsync.Post();
 }
 
+#ifdef __LIBRETRO__
+// Processes everything the EE has queued so far and returns once the ringbuffer runs dry,
+// instead of stopping at the next vsync.  Used to bring the GS in line with a paused EE
+// (savestates), where waiting for a vsync could block forever.
+void SysMtgsThread::FlushRingInThread()
+{
+	m_FlushRingOnly.store(true, std::memory_order_relaxed);
+	ExecuteTaskInThread();
+	m_FlushRingOnly.store(false, std::memory_order_relaxed);
+}
+
+// Same, but also keeps processing until the EE is parked after a pause request, so that
+// nothing it sent on its way there is left behind.  Waits on the ring events while the
+// ringbuffer is empty; NotifyEEPaused() wakes it up.
+void SysMtgsThread::FlushRingUntilEEPaused()
+{
+	m_FlushUntilEEPaused.store(true, std::memory_order_relaxed);
+	FlushRingInThread();
+	m_FlushUntilEEPaused.store(false, std::memory_order_relaxed);
+}
+
+// Called by the EE thread once it is paused (SysCoreThread::OnPauseInThread).
+void SysMtgsThread::NotifyEEPaused()
+{
+	m_EEPaused.store(true, std::memory_order_release);
+	m_sem_event.Post();
+}
+#endif
+
 void SysMtgsThread::CloseGS()
 {
 	if( !m_Opened ) return;
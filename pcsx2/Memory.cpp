@@ -827,11 +827,96 @@ static __fi void mmap_ClearCpuBlock( uint offset )
 	Cpu->Clear( m_PageProtectInfo[rampage].ReverseRamMap, 0x400 );
 }
 
+// --------------------------------------------------------------------------------------
+//  Dirty page tracking (incremental savestates)
+// --------------------------------------------------------------------------------------
+// While enabled, EE and IOP main ram are write-protected each time the dirty flags are
+// reset, and the first write to each page flags it from the page fault handler.  Pages
+// that still hold EE code keep going through mmap_ClearCpuBlock as usual.
+//
+// VU0/VU1 Mem and Micro are not tracked, memDeltaSavingState just diffs them.  They are
+// only 40 KB together (a memcmp of a microsecond or so), and nearly all of it is rewritten
+// every frame by VIF unpacks, the VU recompilers and the MTVU thread, so protecting it
+// would fault on most pages each frame, on threads the EE fault handling doesn't expect.
+
+static bool m_DirtyPageTracking = false;
+static u8 m_EEDirtyPages[Ps2MemSize::MainRam >> 12];
+static u8 m_IOPDirtyPages[Ps2MemSize::IopRam >> 12];
+
+void mmap_EnableDirtyPageTracking( bool enable )
+{
+	if( m_DirtyPageTracking == enable ) return;
+	m_DirtyPageTracking = enable;
+
+	// Nothing is known about what changed before tracking started.
+	memset( m_EEDirtyPages, 1, sizeof(m_EEDirtyPages) );
+	memset( m_IOPDirtyPages, 1, sizeof(m_IOPDirtyPages) );
+
+	if( enable || !eeMem || !iopMem ) return;
+
+	for( uint rampage = 0; rampage < ArraySize(m_EEDirtyPages); ++rampage )
+	{
+		if( m_PageProtectInfo[rampage].Mode != ProtMode_Write )
+			HostSys::MemProtect( &eeMem->Main[rampage<<12], __pagesize, PageAccess_ReadWrite() );
+	}
+	HostSys::MemProtect( iopMem->Main, Ps2MemSize::IopRam, PageAccess_ReadWrite() );
+}
+
+void mmap_ResetDirtyPages()
+{
+	if( !m_DirtyPageTracking ) return;
+
+	memzero( m_EEDirtyPages );
+	memzero( m_IOPDirtyPages );
+	HostSys::MemProtect( eeMem->Main, Ps2MemSize::MainRam, PageAccess_ReadOnly() );
+	HostSys::MemProtect( iopMem->Main, Ps2MemSize::IopRam, PageAccess_ReadOnly() );
+}
+
+// Returns false only for EE/IOP main ram pages known to be unchanged since the last
+// mmap_ResetDirtyPages().  Anything else (VU memory and the rest, tracking off) counts
+// as dirty and gets diffed.
+bool mmap_IsRamPageDirty( const void* ptr )
+{
+	if( !m_DirtyPageTracking ) return true;
+
+	uptr offset = (uptr)ptr - (uptr)eeMem->Main;
+	if( offset < Ps2MemSize::MainRam ) return m_EEDirtyPages[offset >> 12];
+
+	offset = (uptr)ptr - (uptr)iopMem->Main;
+	if( offset < Ps2MemSize::IopRam ) return m_IOPDirtyPages[offset >> 12];
+
+	return true;
+}
+
 void mmap_PageFaultHandler::OnPageFaultEvent( const PageFaultInfo& info, bool& handled )
 {
 	// get bad virtual address
 	uptr offset = info.addr - (uptr)eeMem->Main;
-	if( offset >= Ps2MemSize::MainRam ) return;
+	if( offset >= Ps2MemSize::MainRam )
+	{
+		if( !m_DirtyPageTracking ) return;
+
+		offset = info.addr - (uptr)iopMem->Main;
+		if( offset >= Ps2MemSize::IopRam ) return;
+
+		m_IOPDirtyPages[offset >> 12] = 1;
+		HostSys::MemProtect( &iopMem->Main[offset & ~0xfff], __pagesize, PageAccess_ReadWrite() );
+		handled = true;
+		return;
+	}
+
+	if( m_DirtyPageTracking )
+	{
+		m_EEDirtyPages[offset >> 12] = 1;
+
+		// Only write-protected because of the dirty tracking, no code to clear.
+		if( m_PageProtectInfo[offset >> 12].Mode != ProtMode_Write )
+		{
+			HostSys::MemProtect( &eeMem->Main[offset & ~0xfff], __pagesize, PageAccess_ReadWrite() );
+			handled = true;
+			return;
+		}
+	}
 
 	mmap_ClearCpuBlock( offset );
 	handled = true;
@@ -844,5 +929,8 @@ void mmap_PageFaultHandler::OnPageFaultEvent( const PageFaultInfo& info, bool& h
 void mmap_ResetBlockTracking(void)
 {
 	memzero( m_PageProtectInfo );
-	if (eeMem) HostSys::MemProtect( eeMem->Main, Ps2MemSize::MainRam, PageAccess_ReadWrite() );
+
+	// Pages that are not flagged dirty yet must stay write-protected for the dirty tracking.
+	if (eeMem) HostSys::MemProtect( eeMem->Main, Ps2MemSize::MainRam,
+		m_DirtyPageTracking ? PageAccess_ReadOnly() : PageAccess_ReadWrite() );
 }
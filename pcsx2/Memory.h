@@ -123,6 +123,10 @@ extern vtlb_ProtectionMode mmap_GetRamPageInfo( u32 paddr );
 extern void mmap_MarkCountedRamPage( u32 paddr );
 extern void mmap_ResetBlockTracking();
 
+extern void mmap_EnableDirtyPageTracking( bool enable );
+extern void mmap_ResetDirtyPages();
+extern bool mmap_IsRamPageDirty( const void* ptr );
+
 #define memRead8 vtlb_memRead<mem8_t>
 #define memRead16 vtlb_memRead<mem16_t>
 #define memRead32 vtlb_memRead<mem32_t>
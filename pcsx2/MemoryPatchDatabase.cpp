@@ -1,16 +1,15 @@
 #include "MemoryPatchDatabase.h"
 #include <zlib.h>
-#include <sstream>
 #include <algorithm>
+#include <cstdlib>
 
 #define LOCAL_FILE_HEADER_SIGNATURE		0x04034b50
 #define COMPRESSED_SIZE_INDEX_OFFSET		18
 #define UNCOMPRESSED_SIZE_INDEX_OFFSET  	22
+#define FILE_NAME_LENGTH_INDEX_OFFSET		26
+#define EXTRA_FIELD_LENGTH_INDEX_OFFSET		28
 #define FILE_NAME_LENGTH_NO_EXTENSION		8
 #define FILE_NAME_INDEX_OFFSET			30
-#define LOCAL_FILE_HEADER_LENGTH		44
-#define MISSING_ENTRY				182
-#define MEMORY_PATCH_MAX_SIZE  			32768
 
 static uint32_t uint32_from_bytes_little_endian(uint8_t* byte_array)
 {
@@ -25,62 +24,108 @@ static uint16_t uint16_from_bytes_little_endian(uint8_t* byte_array)
 	return	(byte_array[0]) | (byte_array[1] << 8);
 }
 
+static bool crc_from_string(const char* str, size_t len, uint32_t& crc)
+{
+	if (len != FILE_NAME_LENGTH_NO_EXTENSION)
+		return false;
+
+	crc = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		const char c = str[i];
+		uint32_t digit;
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+		crc = (crc << 4) | digit;
+	}
+	return true;
+}
+
+static const std::vector<std::string> no_patch_lines;
+
 MemoryPatchDatabase::MemoryPatchDatabase(uint8_t *s, size_t len)
 {
 	this->compressed_archive_as_byte_array = s;
 	this->archive_length                   = len;
 }
 
-std::vector<std::string> MemoryPatchDatabase::GetPatchLines(std::string key)
+MemoryPatchDatabase::Patch* MemoryPatchDatabase::FindEntry(uint32_t crc)
 {
-	std::vector<std::string> patch_lines;
+	auto it = std::lower_bound(entries.begin(), entries.end(), crc,
+		[](const Patch& patch, uint32_t crc) { return patch.crc < crc; });
+	if (it == entries.end() || it->crc != crc)
+		return nullptr;
+	return &*it;
+}
 
-	if (entries.count(key) == 1 && entries[key].compressed_data)
-	{
-		uint8_t uncompressed_data[MEMORY_PATCH_MAX_SIZE];
-		int result;
+const std::vector<std::string>& MemoryPatchDatabase::GetPatchLines(const std::string& key)
+{
+	uint32_t crc;
+	if (!crc_from_string(key.c_str(), key.size(), crc))
+		return no_patch_lines;
+	return GetPatchLines(crc);
+}
+
+const std::vector<std::string>& MemoryPatchDatabase::GetPatchLines(uint32_t crc)
+{
+	Patch* patch = FindEntry(crc);
+	if (!patch)
+		return no_patch_lines;
 
-		result = DecompressEntry(key, uncompressed_data);
+	if (!patch->parsed)
+	{
+		patch->parsed = true;
 
-		if (result == Z_STREAM_END)
+		std::vector<uint8_t> uncompressed_data;
+		if (DecompressEntry(*patch, uncompressed_data))
 		{
-			std::string patch(reinterpret_cast<const char*>(uncompressed_data), entries[key].uncompressed_size);
-			std::istringstream stream(patch);
-			std::string line;
-			while (std::getline(stream, line))
-				patch_lines.push_back(line);
+			const char* data = reinterpret_cast<const char*>(uncompressed_data.data());
+			const char* end = data + uncompressed_data.size();
+			while (data < end)
+			{
+				const char* eol = std::find(data, end, '\n');
+				if (eol != data)
+					patch->lines.emplace_back(data, eol);
+				data = eol + 1;
+			}
 		}
 	}
 
-	return patch_lines;
+	return patch->lines;
 }
 
-int MemoryPatchDatabase::DecompressEntry(std::string key, uint8_t* dest_buffer)
+bool MemoryPatchDatabase::DecompressEntry(const Patch& patch, std::vector<uint8_t>& dest)
 {
-	int result = Z_ERRNO;
-
-	if (entries.count(key) == 1 && entries[key].compressed_data)
-	{
-		z_stream stream;
-
-		// initialize the stream
-		stream.next_in = reinterpret_cast<Bytef*>(entries[key].compressed_data);
-		stream.avail_in = entries[key].compressed_size;
-		stream.zalloc = Z_NULL;
-		stream.zfree = Z_NULL;
-		stream.opaque = Z_NULL;
-		result = inflateInit2(&stream, -MAX_WBITS);
-		
-		// decompress the data into dest_buffer
-		if (result == Z_OK) {
-			stream.next_out = dest_buffer;
-			// we're assuming uncompressed_size <= 32768
-			stream.avail_out = entries[key].uncompressed_size;
-			result = inflate(&stream, Z_NO_FLUSH);
-		}
+	if (!patch.compressed_data)
+		return false;
+
+	dest.resize(patch.uncompressed_size);
+
+	z_stream stream;
+
+	// initialize the stream
+	stream.next_in = patch.compressed_data;
+	stream.avail_in = patch.compressed_size;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	int result = inflateInit2(&stream, -MAX_WBITS);
+
+	// decompress the data into dest
+	if (result == Z_OK) {
+		stream.next_out = dest.data();
+		stream.avail_out = patch.uncompressed_size;
+		result = inflate(&stream, Z_FINISH);
+		inflateEnd(&stream);
 	}
-	
-	return result;
+
+	return result == Z_STREAM_END;
 }
 
 void MemoryPatchDatabase::InitEntries()
@@ -98,47 +143,60 @@ the following simplifying assumptions:
 
 (1) The general purpose bit flags are all set to 0
 (2) In particular, encryption is not used
-(3) Extra fields are not used
-(4) Data descriptors are not used
-(5) Compression method is deflate
-(6) All files inside the archive are filenames of the form XXXXXXX.pnach,
-	case insensitive
-(7) Maximum allowed file size inside the archive is 32768 bytes
+(3) Data descriptors are not used
+(4) Compression method is deflate
+(5) All files inside the archive are filenames of the form XXXXXXXX.pnach,
+	case insensitive, the XXXXXXXX part being the CRC in hex
 
 If any of the above assumptions are violated, this code may NOT work, so don't
 use this as a general-purpose .ZIP reader.
+
+Only the headers are read here, building an index sorted by CRC.  The entries are
+inflated the first time they are looked up.
 */
 void MemoryPatchDatabase::InitEntries(uint8_t* compressed_archive_as_byte_array, uint32_t archive_length)
 {
-	uint32_t header_signature;
-	uint32_t compressed_size;
-	uint32_t uncompressed_size;
-	uint32_t total_compressed_entry_size;
-
-	if (archive_length < LOCAL_FILE_HEADER_LENGTH)
-		return; // finished processing the last entry
-	
-	header_signature = uint32_from_bytes_little_endian(compressed_archive_as_byte_array);
-	
-	if (header_signature != LOCAL_FILE_HEADER_SIGNATURE)
-		return; // finished processing the last entry
-
-	compressed_size = uint32_from_bytes_little_endian(&compressed_archive_as_byte_array[COMPRESSED_SIZE_INDEX_OFFSET]);
-	uncompressed_size = uint32_from_bytes_little_endian(&compressed_archive_as_byte_array[UNCOMPRESSED_SIZE_INDEX_OFFSET]);
-	total_compressed_entry_size = compressed_size + LOCAL_FILE_HEADER_LENGTH;
-
-	if (archive_length < total_compressed_entry_size)
-		return; // archive entry is invalid; no more valid entries to add to database
-
-	std::string file_name(reinterpret_cast<const char*>(&compressed_archive_as_byte_array[FILE_NAME_INDEX_OFFSET]),
-		FILE_NAME_LENGTH_NO_EXTENSION);
-
-	std::transform(file_name.begin(), file_name.end(), file_name.begin(), ::toupper);
-
-	entries[file_name].compressed_size = compressed_size;
-	entries[file_name].uncompressed_size = uncompressed_size;
-	entries[file_name].compressed_data = &compressed_archive_as_byte_array[LOCAL_FILE_HEADER_LENGTH];
-	
-	// processes the archive, starting from the next entry
-	InitEntries(&compressed_archive_as_byte_array[total_compressed_entry_size], archive_length - total_compressed_entry_size);
+	entries.clear();
+
+	while (archive_length >= FILE_NAME_INDEX_OFFSET)
+	{
+		const uint32_t header_signature = uint32_from_bytes_little_endian(compressed_archive_as_byte_array);
+		if (header_signature != LOCAL_FILE_HEADER_SIGNATURE)
+			break; // finished processing the last entry
+
+		const uint32_t compressed_size = uint32_from_bytes_little_endian(&compressed_archive_as_byte_array[COMPRESSED_SIZE_INDEX_OFFSET]);
+		const uint32_t uncompressed_size = uint32_from_bytes_little_endian(&compressed_archive_as_byte_array[UNCOMPRESSED_SIZE_INDEX_OFFSET]);
+		const uint16_t file_name_length = uint16_from_bytes_little_endian(&compressed_archive_as_byte_array[FILE_NAME_LENGTH_INDEX_OFFSET]);
+		const uint16_t extra_field_length = uint16_from_bytes_little_endian(&compressed_archive_as_byte_array[EXTRA_FIELD_LENGTH_INDEX_OFFSET]);
+		const uint32_t header_length = FILE_NAME_INDEX_OFFSET + file_name_length + extra_field_length;
+		const uint64_t total_compressed_entry_size = (uint64_t)header_length + compressed_size;
+
+		if (archive_length < total_compressed_entry_size)
+			break; // archive entry is invalid; no more valid entries to add to database
+
+		// The name is the CRC followed by the extension
+		const char* file_name = reinterpret_cast<const char*>(&compressed_archive_as_byte_array[FILE_NAME_INDEX_OFFSET]);
+		const char* extension = std::find(file_name, file_name + file_name_length, '.');
+		uint32_t crc;
+		if (crc_from_string(file_name, extension - file_name, crc))
+		{
+			Patch patch;
+			patch.crc = crc;
+			patch.compressed_size = compressed_size;
+			patch.uncompressed_size = uncompressed_size;
+			patch.compressed_data = &compressed_archive_as_byte_array[header_length];
+			entries.push_back(std::move(patch));
+		}
+
+		// processes the archive, starting from the next entry
+		compressed_archive_as_byte_array += total_compressed_entry_size;
+		archive_length -= total_compressed_entry_size;
+	}
+
+	// Later entries win over earlier ones with the same CRC, like they used to.
+	std::stable_sort(entries.begin(), entries.end(),
+		[](const Patch& a, const Patch& b) { return a.crc < b.crc; });
+	auto last = std::unique(entries.rbegin(), entries.rend(),
+		[](const Patch& a, const Patch& b) { return a.crc == b.crc; });
+	entries.erase(entries.begin(), last.base());
 }
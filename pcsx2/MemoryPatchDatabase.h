@@ -1,6 +1,6 @@
 #pragma once
 
-#include <unordered_map>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -13,18 +13,29 @@ public:
 
 	struct Patch
 	{
+		uint32_t crc = 0;
 		uint32_t compressed_size = 0;
 		uint32_t uncompressed_size = 0;
-		uint8_t* compressed_data;
+		uint8_t* compressed_data = nullptr;
+
+		// Filled the first time the patch is asked for
+		bool parsed = false;
+		std::vector<std::string> lines;
 	};
 
-	std::vector<std::string> GetPatchLines(std::string key);
+	// Returns the non-empty lines of the patch for a CRC (8 hex digits, any case), or an
+	// empty list if there's none.  An entry is only inflated and split once, later calls
+	// return the same lines.
+	const std::vector<std::string>& GetPatchLines(const std::string& key);
+	const std::vector<std::string>& GetPatchLines(uint32_t crc);
 	void InitEntries();
 	void InitEntries(uint8_t* compressed_archive_as_byte_array, uint32_t archive_length);
+	size_t GetEntryCount() const { return entries.size(); }
 private:
-	int DecompressEntry(std::string key, uint8_t* dest_buffer);
+	bool DecompressEntry(const Patch& patch, std::vector<uint8_t>& dest);
+	Patch* FindEntry(uint32_t crc);
 
-	std::unordered_map<std::string, Patch> entries;
+	std::vector<Patch> entries; // sorted by CRC
 	uint8_t* compressed_archive_as_byte_array;
 	uint32_t archive_length;
 };
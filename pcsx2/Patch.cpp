@@ -22,7 +22,10 @@
 #include "GameDatabase.h"
 #include "MemoryPatchDatabase.h"
 
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <wx/textfile.h>
 #include <wx/dir.h>
@@ -33,12 +36,20 @@
 
 #include "retro_messager.h"
 
-// This is a declaration for PatchMemory.cpp::_ApplyPatch where we're (patch.cpp)
-// the only consumer, so it's not made public via Patch.h
-// Applies a single patch line to emulation memory regardless of its "place" value.
-extern void _ApplyPatch(IniPatch* p);
+// These are declarations for PatchMemory.cpp::_CompilePatches/_RunPatches where we're
+// (patch.cpp) the only consumer, so they're not made public via Patch.h
+// _CompilePatches turns the patches with a given "place" value into the program applied
+// to emulation memory by _RunPatches.
+extern void _CompilePatches(patch_place_type place, const std::vector<IniPatch>& patches);
+extern void _RunPatches(patch_place_type place);
 
 static std::vector<IniPatch> Patch;
+static bool PatchChanged = true; // compiled patches are out of date
+
+// Cheats set through SetCheat, by index.  They are set from the frontend thread.
+static std::mutex CheatMutex;
+static std::map<uint, std::vector<IniPatch>> Cheats;
+static std::atomic<bool> CheatChanged(false);
 
 struct PatchTextTable
 {
@@ -165,6 +176,7 @@ void inifile_process(wxTextFile& f1)
 void ForgetLoadedPatches()
 {
 	Patch.clear();
+	PatchChanged = true;
 }
 
 static int _LoadPatchFiles(const wxDirName& folderName, wxString& fileSpec, const wxString& friendlyName, int& numberFoundPatchFiles)
@@ -202,8 +214,6 @@ static int _LoadPatchFiles(const wxDirName& folderName, wxString& fileSpec, cons
 int Load60fpsPatchesFromDatabase(std::string gameCRC)
 {
 	static MemoryPatchDatabase *sixtyfps_database;
-	std::transform(gameCRC.begin(), gameCRC.end(), gameCRC.begin(), ::toupper);
-
 	int before = Patch.size();
 
 	if (!sixtyfps_database)
@@ -211,9 +221,8 @@ int Load60fpsPatchesFromDatabase(std::string gameCRC)
 		sixtyfps_database = new MemoryPatchDatabase(cheats_60fps_zip, cheats_60fps_zip_len);
 		sixtyfps_database->InitEntries();
 	}
-	std::vector<std::string> patch_lines = sixtyfps_database->GetPatchLines(gameCRC);
 
-	for (std::string line : patch_lines)
+	for (const std::string& line : sixtyfps_database->GetPatchLines(gameCRC))
 		inifile_processString(line);
 
 	return Patch.size() - before;
@@ -222,8 +231,6 @@ int Load60fpsPatchesFromDatabase(std::string gameCRC)
 int LoadWidescreenPatchesFromDatabase(std::string gameCRC)
 {
 	static MemoryPatchDatabase *widescreen_database;
-	std::transform(gameCRC.begin(), gameCRC.end(), gameCRC.begin(), ::toupper);
-
 	int before = Patch.size();
 
 	if (!widescreen_database)
@@ -231,9 +238,8 @@ int LoadWidescreenPatchesFromDatabase(std::string gameCRC)
 		widescreen_database = new MemoryPatchDatabase(cheats_ws_zip, cheats_ws_zip_len);
 		widescreen_database->InitEntries();
 	}
-	std::vector<std::string> patch_lines = widescreen_database->GetPatchLines(gameCRC);
 
-	for (std::string line : patch_lines)
+	for (const std::string& line : widescreen_database->GetPatchLines(gameCRC))
 		inifile_processString(line);
 
 	return Patch.size() - before;
@@ -242,8 +248,6 @@ int LoadWidescreenPatchesFromDatabase(std::string gameCRC)
 int LoadNointerlacingPatchesFromDatabase(std::string gameCRC)
 {
 	static MemoryPatchDatabase* nointerlacing_database;
-	std::transform(gameCRC.begin(), gameCRC.end(), gameCRC.begin(), ::toupper);
-
 	int before = Patch.size();
 
 	if (!nointerlacing_database)
@@ -251,9 +255,8 @@ int LoadNointerlacingPatchesFromDatabase(std::string gameCRC)
 		nointerlacing_database = new MemoryPatchDatabase(cheats_nointerlacing_zip, cheats_nointerlacing_zip_len);
 		nointerlacing_database->InitEntries();
 	}
-	std::vector<std::string> patch_lines = nointerlacing_database->GetPatchLines(gameCRC);
 
-	for (std::string line : patch_lines)
+	for (const std::string& line : nointerlacing_database->GetPatchLines(gameCRC))
 		inifile_processString(line);
 
 	return Patch.size() - before;
@@ -313,7 +316,9 @@ namespace PatchFunc
 		const wxString& WriteValue() const { return m_pieces[4]; }
 	};
 
-	void patchHelper(const wxString& cmd, const wxString& param)
+	// Parses the parameters of a patch line, returns false (after logging why) if they're
+	// not valid.
+	static bool parsePatch(const wxString& cmd, const wxString& param, IniPatch& iPatch)
 	{
 		// Error Handling Note:  I just throw simple wxStrings here, and then catch them below and
 		// format them into more detailed cmd+data+error printouts.  If we want to add user-friendly
@@ -328,8 +333,12 @@ namespace PatchFunc
 		{
 			PatchPieces pieces(param);
 
-			IniPatch iPatch = {0};
+			iPatch = {0};
 			iPatch.enabled = 0;
+
+			if (pieces.m_pieces.GetCount() < 5)
+				goto error;
+
 			iPatch.placetopatch = StrToU32(pieces.PlaceToPatch(), 10);
 
 			if (iPatch.placetopatch >= _PPT_END_MARKER)
@@ -353,22 +362,117 @@ namespace PatchFunc
 			}
 
 			iPatch.enabled = 1; // omg success!!
-			Patch.push_back(iPatch);
 		}
 
-		return;
+		return true;
 error:
 		log_cb(RETRO_LOG_ERROR, "(Patch) Error Parsing: %s=%s\n", WX_STR(cmd), WX_STR(param));
+		return false;
+	}
+
+	void patchHelper(const wxString& cmd, const wxString& param)
+	{
+		IniPatch iPatch;
+		if (parsePatch(cmd, param, iPatch))
+		{
+			Patch.push_back(iPatch);
+			PatchChanged = true;
+		}
 	}
 	void patch(const wxString& cmd, const wxString& param) { patchHelper(cmd, param); }
 } // namespace PatchFunc
 
+// Cheat codes are made of lines separated by '+', ';' or newlines, see SetCheat.
+static bool ParseCheatLine(wxString line, IniPatch& iPatch)
+{
+	line.Trim(true).Trim(false);
+
+	// pnach patch line, "patch=" being optional
+	if (line.Lower().StartsWith(L"patch="))
+		line = line.Mid(6);
+	if (line.Contains(L","))
+		return PatchFunc::parsePatch(L"patch", line, iPatch);
+
+	// raw "aaaaaaaa vvvvvvvv" code
+	line.Replace(L":", L" ");
+	wxString addr = line.BeforeFirst(L' ');
+	wxString value = line.AfterFirst(L' ').Trim(false);
+	unsigned long a;
+	wxULongLong_t v;
+	if (addr.IsEmpty() || value.IsEmpty() || !addr.ToULong(&a, 16) || !value.ToULongLong(&v, 16))
+	{
+		log_cb(RETRO_LOG_ERROR, "(Cheat) Error Parsing: %s\n", WX_STR(line));
+		return false;
+	}
+
+	iPatch = {0};
+	iPatch.enabled = 1;
+	iPatch.type = EXTENDED_T;
+	iPatch.cpu = CPU_EE;
+	iPatch.placetopatch = PPT_CONTINUOUSLY;
+	iPatch.addr = a;
+	iPatch.data = v;
+	return true;
+}
+
+int SetCheat(uint index, bool enabled, const std::string& code)
+{
+	std::vector<IniPatch> lines;
+	if (enabled)
+	{
+		wxString all = fromUTF8(code.c_str());
+		all.Replace(L"+", L"\n");
+		all.Replace(L";", L"\n");
+		all.Replace(L"\r", L"\n");
+
+		wxArrayString pieces;
+		SplitString(pieces, all, L"\n");
+		for (const wxString& piece : pieces)
+		{
+			IniPatch iPatch;
+			if (!piece.IsEmpty() && ParseCheatLine(piece, iPatch))
+				lines.push_back(iPatch);
+		}
+	}
+
+	const int count = lines.size();
+	{
+		std::lock_guard<std::mutex> lock(CheatMutex);
+		if (lines.empty())
+			Cheats.erase(index);
+		else
+			Cheats[index] = std::move(lines);
+	}
+	CheatChanged = true;
+
+	return count;
+}
+
+void ForgetCheats()
+{
+	{
+		std::lock_guard<std::mutex> lock(CheatMutex);
+		Cheats.clear();
+	}
+	CheatChanged = true;
+}
+
 // This is for applying patches directly to memory
 void ApplyLoadedPatches(patch_place_type place)
 {
-	for (auto& i : Patch)
+	if (PatchChanged || CheatChanged.exchange(false))
 	{
-		if (i.placetopatch == place)
-			_ApplyPatch(&i);
+		std::vector<IniPatch> patches(Patch);
+		{
+			std::lock_guard<std::mutex> lock(CheatMutex);
+			for (const auto& cheat : Cheats)
+				patches.insert(patches.end(), cheat.second.begin(), cheat.second.end());
+		}
+
+		for (int i = 0; i < _PPT_END_MARKER; i++)
+			_CompilePatches((patch_place_type)i, patches);
+		PatchChanged = false;
 	}
+
+	_RunPatches(place);
 }
@@ -120,6 +120,15 @@ extern void ApplyLoadedPatches(patch_place_type place);
 // Following ApplyLoadedPatches calls will do nothing until some LoadPatchesFrom* are invoked.
 extern void ForgetLoadedPatches();
 
+// Cheats set by the frontend, kept apart from the loaded patches so ForgetLoadedPatches()
+// leaves them alone.  Applied along with the loaded patches, setting them again with the
+// same index replaces them and disabling removes them.  A code is made of lines separated
+// by '+', ';' or newlines, each one either a pnach patch line ("patch=" being optional) or
+// a raw "aaaaaaaa vvvvvvvv" code applied continuously as an extended EE patch.
+// Returns the number of lines parsed from the code.  Thread safe.
+extern int SetCheat(uint index, bool enabled, const std::string& code);
+extern void ForgetCheats();
+
 // Patch loading is verbose only once after the crc changes, this makes it think that the crc changed.
 extern void PatchesVerboseReset();
 
@@ -20,6 +20,10 @@
 #include "IopCommon.h"
 #include "Patch.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 u32 SkipCount = 0, IterationCount = 0;
 u32 IterationIncrement = 0, ValueIncrement = 0;
 u32 PrevCheatType = 0, PrevCheatAddr = 0, LastType = 0;
@@ -383,69 +387,373 @@ void handle_extended_t(IniPatch *p)
 	}
 }
 
+// --------------------------------------------------------------------------------------
+//  Compiled patches
+// --------------------------------------------------------------------------------------
+// The continuous patches are applied every vsync, so instead of going through _ApplyPatch
+// one line at a time the loaded patches are compiled into a list of steps:
+//  - runs of plain byte/short/word/double writes.
+//  - runs of extended codes, which keep going through handle_extended_t in order since
+//    they depend on each other.
+// A run of writes is split whenever a write overlaps an earlier one of the same run at a
+// different address or width.
+//
+// The writes of a run are resolved to host pointers when they target EE or IOP main ram.
+// Only those are grouped by width and sorted by address, with the IOP recompiler blocks of
+// the patched words cleared once per group instead of once per write.  Anything else
+// (hardware registers, ...) goes through memWrite/iopMemWrite in pnach order: the ram
+// writes before it in the pnach are done before it and the ones after it are done after,
+// since a register write can start a transfer reading or writing that ram.
+
+namespace
+{
+	template <typename T>
+	struct PatchWrite
+	{
+		u32 addr;
+		T value;
+		T* ptr; // main ram target
+	};
+
+	struct PatchWrites
+	{
+		std::vector<PatchWrite<u8>> w8;
+		std::vector<PatchWrite<u16>> w16;
+		std::vector<PatchWrite<u32>> w32;
+		std::vector<PatchWrite<u64>> w64;
+	};
+
+	struct PatchWriteAny
+	{
+		u32 addr;
+		u8 width; // 0 when none
+		u64 value;
+	};
+
+	// Main ram writes, followed by a write that has to go through the memory handlers.
+	struct PatchRun
+	{
+		PatchWrites ram;
+		PatchWriteAny other;
+	};
+
+	struct PatchStep
+	{
+		patch_cpu_type cpu;
+		std::vector<PatchWriteAny> writes; // pnach order
+		std::vector<PatchRun> runs; // the writes once resolved
+		std::vector<IniPatch> extended;
+	};
+
+	struct PatchProgram
+	{
+		std::vector<PatchStep> steps;
+		u32 generation = 0;
+		bool resolved = false;
+	};
+
+	PatchProgram s_programs[_PPT_END_MARKER];
+} // namespace
+
+static void* _ResolveEE(u32 addr)
+{
+	u8* ptr = (u8*)vtlb_GetVirtPtr(addr);
+	if (!ptr || (uptr)(ptr - eeMem->Main) >= Ps2MemSize::MainRam)
+		return NULL;
+	return ptr;
+}
+
+static void* _ResolveIOP(u32 addr)
+{
+	u8* ptr = iopVirtMemW<u8>(addr & 0x1fffffff);
+	if (!ptr || (uptr)(ptr - iopMem->Main) >= Ps2MemSize::IopRam)
+		return NULL;
+	return ptr;
+}
+
+// Returns false if the write has to go through the memory handlers.
+template <typename T>
+static bool _ResolveWrite(std::vector<PatchWrite<T>>& writes, const PatchWriteAny& w, patch_cpu_type cpu)
+{
+	// EE mappings are per 4k page, IOP ones per 64k.
+	const u32 pageMask = cpu == CPU_EE ? ~(u32)vtlb_private::VTLB_PAGE_MASK : ~0xffffu;
+
+	// A write straddling the end of a page could land in another mapping.
+	if ((w.addr ^ (w.addr + sizeof(T) - 1)) & pageMask)
+		return false;
+
+	T* ptr = (T*)(cpu == CPU_EE ? _ResolveEE(w.addr) : _ResolveIOP(w.addr));
+	if (!ptr)
+		return false;
+
+	writes.push_back({w.addr, (T)w.value, ptr});
+	return true;
+}
+
+template <typename T>
+static void _SortWrites(std::vector<PatchWrite<T>>& writes)
+{
+	std::stable_sort(writes.begin(), writes.end(),
+		[](const PatchWrite<T>& a, const PatchWrite<T>& b) { return a.addr < b.addr; });
+}
+
+static void _ResolveStep(PatchStep& step)
+{
+	step.runs.clear();
+	step.runs.emplace_back();
+
+	for (const PatchWriteAny& w : step.writes)
+	{
+		PatchWrites& ram = step.runs.back().ram;
+		bool resolved = false;
+		switch (w.width)
+		{
+			case 1: resolved = _ResolveWrite(ram.w8, w, step.cpu); break;
+			case 2: resolved = _ResolveWrite(ram.w16, w, step.cpu); break;
+			case 4: resolved = _ResolveWrite(ram.w32, w, step.cpu); break;
+			case 8: resolved = _ResolveWrite(ram.w64, w, step.cpu); break;
+		}
+		if (!resolved)
+		{
+			step.runs.back().other = w;
+			step.runs.emplace_back();
+		}
+	}
+
+	for (PatchRun& run : step.runs)
+	{
+		_SortWrites(run.ram.w8);
+		_SortWrites(run.ram.w16);
+		_SortWrites(run.ram.w32);
+		_SortWrites(run.ram.w64);
+	}
+}
+
+static u8 _EEMemRead(u32 addr, u8) { return memRead8(addr); }
+static u16 _EEMemRead(u32 addr, u16) { return memRead16(addr); }
+static u32 _EEMemRead(u32 addr, u32) { return memRead32(addr); }
+static u64 _EEMemRead(u32 addr, u64)
+{
+	u64 mem;
+	memRead64(addr, &mem);
+	return mem;
+}
+
+static void _EEMemWrite(u32 addr, u8 value) { memWrite8(addr, value); }
+static void _EEMemWrite(u32 addr, u16 value) { memWrite16(addr, value); }
+static void _EEMemWrite(u32 addr, u32 value) { memWrite32(addr, value); }
+static void _EEMemWrite(u32 addr, u64 value) { memWrite64(addr, &value); }
+
+template <typename T>
+static void _RunEEWrites(const std::vector<PatchWrite<T>>& writes)
+{
+	for (const PatchWrite<T>& w : writes)
+	{
+		if (*w.ptr != w.value)
+			*w.ptr = w.value;
+	}
+}
+
+template <typename T>
+static void _RunEEWrite(u32 addr, T value)
+{
+	if (_EEMemRead(addr, T()) != value)
+		_EEMemWrite(addr, value);
+}
+
+static u8 _IopMemRead(u32 addr, u8) { return iopMemRead8(addr); }
+static u16 _IopMemRead(u32 addr, u16) { return iopMemRead16(addr); }
+static u32 _IopMemRead(u32 addr, u32) { return iopMemRead32(addr); }
+
+static void _IopMemWrite(u32 addr, u8 value) { iopMemWrite8(addr, value); }
+static void _IopMemWrite(u32 addr, u16 value) { iopMemWrite16(addr, value); }
+static void _IopMemWrite(u32 addr, u32 value) { iopMemWrite32(addr, value); }
+
+template <typename T>
+static void _RunIOPWrites(const std::vector<PatchWrite<T>>& writes)
+{
+	// Writes to ram while the IOP cache is isolated are dropped by iopMemWrite.
+	const bool direct = !(psxRegs.CP0.n.Status & 0x10000);
+
+	// Pending range of words to clear, the writes are sorted by address.
+	u32 clearStart = 0, clearEnd = 0;
+
+	for (const PatchWrite<T>& w : writes)
+	{
+		if (direct)
+		{
+			if (*w.ptr == w.value)
+				continue;
+			*w.ptr = w.value;
+
+			const u32 start = w.addr & 0x1ffffffc;
+			const u32 end = ((w.addr & 0x1fffffff) + sizeof(T) + 3) & ~3;
+			if (clearEnd != clearStart && start <= clearEnd)
+				clearEnd = std::max(clearEnd, end);
+			else
+			{
+				if (clearEnd != clearStart)
+					psxCpu->Clear(clearStart, (clearEnd - clearStart) / 4);
+				clearStart = start;
+				clearEnd = end;
+			}
+		}
+		else if (_IopMemRead(w.addr, T()) != w.value)
+			_IopMemWrite(w.addr, w.value);
+	}
+
+	if (clearEnd != clearStart)
+		psxCpu->Clear(clearStart, (clearEnd - clearStart) / 4);
+}
+
+template <typename T>
+static void _RunIOPWrite(u32 addr, T value)
+{
+	if (_IopMemRead(addr, T()) != value)
+		_IopMemWrite(addr, value);
+}
+
+static void _RunOtherWrite(const PatchWriteAny& w, patch_cpu_type cpu)
+{
+	if (cpu == CPU_EE)
+	{
+		switch (w.width)
+		{
+			case 1: _RunEEWrite(w.addr, (u8)w.value); break;
+			case 2: _RunEEWrite(w.addr, (u16)w.value); break;
+			case 4: _RunEEWrite(w.addr, (u32)w.value); break;
+			case 8: _RunEEWrite(w.addr, w.value); break;
+		}
+	}
+	else
+	{
+		switch (w.width)
+		{
+			case 1: _RunIOPWrite(w.addr, (u8)w.value); break;
+			case 2: _RunIOPWrite(w.addr, (u16)w.value); break;
+			case 4: _RunIOPWrite(w.addr, (u32)w.value); break;
+		}
+	}
+}
+
 // Only used from Patch.cpp and we don't export this in any h file.
 // Patch.cpp itself declares this prototype, so make sure to keep in sync.
-void _ApplyPatch(IniPatch *p)
+void _CompilePatches(patch_place_type place, const std::vector<IniPatch>& patches)
 {
-	if (p->enabled == 0) return;
+	PatchProgram& program = s_programs[place];
+	program.steps.clear();
+	program.resolved = false;
 
-	switch (p->cpu)
+	// Bytes touched by the current run of writes, keyed by 8 byte block: address and width
+	// of the write(s) touching each byte.
+	struct Touch
 	{
-	case CPU_EE:
-		switch (p->type)
+		u32 addr;
+		u8 width;
+	};
+	std::unordered_map<u32, Touch> touched;
+
+	auto newStep = [&](patch_cpu_type cpu) -> PatchStep& {
+		touched.clear();
+		program.steps.emplace_back();
+		program.steps.back().cpu = cpu;
+		return program.steps.back();
+	};
+
+	// Returns false if the write overlaps another one of the run differently.
+	auto touch = [&](u32 addr, u8 width) {
+		for (u32 block = addr >> 3; block <= (addr + width - 1) >> 3; block++)
 		{
-		case BYTE_T:
-			if (memRead8(p->addr) != (u8)p->data)
-				memWrite8(p->addr, (u8)p->data);
-			break;
-
-		case SHORT_T:
-			if (memRead16(p->addr) != (u16)p->data)
-				memWrite16(p->addr, (u16)p->data);
-			break;
-
-		case WORD_T:
-			if (memRead32(p->addr) != (u32)p->data)
-				memWrite32(p->addr, (u32)p->data);
-			break;
-
-		case DOUBLE_T:
-			u64 mem;
-			memRead64(p->addr, &mem);
-			if (mem != p->data)
-				memWrite64(p->addr, &p->data);
-			break;
-
-		case EXTENDED_T:
-			handle_extended_t(p);
-			break;
-
-		default:
-			break;
+			auto it = touched.find(block);
+			if (it != touched.end() && (it->second.addr != addr || it->second.width != width))
+				return false;
 		}
-		break;
+		for (u32 block = addr >> 3; block <= (addr + width - 1) >> 3; block++)
+			touched[block] = {addr, width};
+		return true;
+	};
+
+	for (const IniPatch& p : patches)
+	{
+		if (!p.enabled || p.placetopatch != place)
+			continue;
 
-	case CPU_IOP:
-		switch (p->type)
+		if (p.type == EXTENDED_T)
 		{
-		case BYTE_T:
-			if (iopMemRead8(p->addr) != (u8)p->data)
-				iopMemWrite8(p->addr, (u8)p->data);
-			break;
-		case SHORT_T:
-			if (iopMemRead16(p->addr) != (u16)p->data)
-				iopMemWrite16(p->addr, (u16)p->data);
-			break;
-		case WORD_T:
-			if (iopMemRead32(p->addr) != (u32)p->data)
-				iopMemWrite32(p->addr, (u32)p->data);
-			break;
-		default:
-			break;
+			if (p.cpu != CPU_EE)
+				continue;
+			if (program.steps.empty() || program.steps.back().extended.empty())
+				newStep(p.cpu);
+			program.steps.back().extended.push_back(p);
+			continue;
 		}
-		break;
 
-	default:
-		break;
+		u8 width;
+		switch (p.type)
+		{
+			case BYTE_T: width = 1; break;
+			case SHORT_T: width = 2; break;
+			case WORD_T: width = 4; break;
+			case DOUBLE_T: width = 8; break;
+			default: continue;
+		}
+		if (p.cpu == CPU_IOP && width == 8)
+			continue;
+		if (p.cpu != CPU_EE && p.cpu != CPU_IOP)
+			continue;
+
+		PatchStep* step = program.steps.empty() ? NULL : &program.steps.back();
+		if (!step || !step->extended.empty() || step->cpu != p.cpu || !touch(p.addr, width))
+		{
+			step = &newStep(p.cpu);
+			touch(p.addr, width);
+		}
+
+		step->writes.push_back({p.addr, width, p.data});
+	}
+}
+
+// Only used from Patch.cpp and we don't export this in any h file.
+// Patch.cpp itself declares this prototype, so make sure to keep in sync.
+void _RunPatches(patch_place_type place)
+{
+	PatchProgram& program = s_programs[place];
+	if (program.steps.empty())
+		return;
+
+	// Host pointers follow the TLB, resolve them again whenever the mappings changed.
+	const u32 generation = vtlb_GetVMapGeneration();
+	if (!program.resolved || program.generation != generation)
+	{
+		for (PatchStep& step : program.steps)
+			_ResolveStep(step);
+		program.generation = generation;
+		program.resolved = true;
+	}
+
+	for (PatchStep& step : program.steps)
+	{
+		for (IniPatch& p : step.extended)
+			handle_extended_t(&p);
+
+		for (const PatchRun& run : step.runs)
+		{
+			if (step.cpu == CPU_EE)
+			{
+				_RunEEWrites(run.ram.w8);
+				_RunEEWrites(run.ram.w16);
+				_RunEEWrites(run.ram.w32);
+				_RunEEWrites(run.ram.w64);
+			}
+			else
+			{
+				_RunIOPWrites(run.ram.w8);
+				_RunIOPWrites(run.ram.w16);
+				_RunIOPWrites(run.ram.w32);
+			}
+
+			if (run.other.width)
+				_RunOtherWrite(run.other, step.cpu);
+		}
 	}
 }
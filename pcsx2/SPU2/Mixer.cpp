@@ -15,9 +15,7 @@
 
 #include "PrecompiledHeader.h"
 #include "Global.h"
-
-/* Forward declaration */
-extern retro_audio_sample_t sample_cb;
+#include "MixerSIMD.h"
 
 static const s32 tbl_XA_Factor[16][2] =
 	{
@@ -109,11 +107,14 @@ static void __forceinline IncrementNextA(V_Core& thiscore, uint voiceidx)
 	// Important!  Both cores signal IRQ when an address is read, regardless of
 	// which core actually reads the address.
 
-	for (int i = 0; i < 2; i++)
+	if (!irq_checks_deferred)
 	{
-		if (Cores[i].IRQEnable && (vc.NextA == Cores[i].IRQA))
+		for (int i = 0; i < 2; i++)
 		{
-			SetIrqCall(i);
+			if (Cores[i].IRQEnable && (vc.NextA == Cores[i].IRQA))
+			{
+				SetIrqCall(i);
+			}
 		}
 	}
 
@@ -163,9 +164,12 @@ static __forceinline s32 GetNextDataBuffered(V_Core& thiscore, uint voiceidx)
 
 		// We'll need the loop flags and buffer pointers regardless of cache status:
 
-		for (int i = 0; i < 2; i++)
-			if (Cores[i].IRQEnable && Cores[i].IRQA == (vc.NextA & 0xFFFF8))
-				SetIrqCall(i);
+		if (!irq_checks_deferred)
+		{
+			for (int i = 0; i < 2; i++)
+				if (Cores[i].IRQEnable && Cores[i].IRQA == (vc.NextA & 0xFFFF8))
+					SetIrqCall(i);
+		}
 
 		s16* memptr = GetMemPtr(vc.NextA & 0xFFFF8);
 		vc.LoopFlags = *memptr >> 8; // grab loop flags from the upper byte.
@@ -219,9 +223,12 @@ static __forceinline void GetNextDataDummy(V_Core& thiscore, uint voiceidx)
 
 	if (vc.SCurrent == 28)
 	{
-		for (int i = 0; i < 2; i++)
-			if (Cores[i].IRQEnable && Cores[i].IRQA == (vc.NextA & 0xFFFF8))
-				SetIrqCall(i);
+		if (!irq_checks_deferred)
+		{
+			for (int i = 0; i < 2; i++)
+				if (Cores[i].IRQEnable && Cores[i].IRQA == (vc.NextA & 0xFFFF8))
+					SetIrqCall(i);
+		}
 
 		vc.LoopFlags = *GetMemPtr(vc.NextA & 0xFFFF8) >> 8; // grab loop flags from the upper byte.
 
@@ -380,7 +387,7 @@ __forceinline static s32 CubicInterpolate(
 // Uses standard template-style optimization techniques to statically generate five different
 // versions of this function (one for each type of interpolation).
 template <int InterpType>
-static __forceinline s32 GetVoiceValues(V_Core& thiscore, uint voiceidx)
+static __forceinline void FetchVoiceValues(V_Core& thiscore, uint voiceidx)
 {
 	V_Voice& vc(thiscore.Voices[voiceidx]);
 
@@ -395,6 +402,14 @@ static __forceinline s32 GetVoiceValues(V_Core& thiscore, uint voiceidx)
 		vc.PV1 = GetNextDataBuffered(thiscore, voiceidx);
 		vc.SP -= 0x1000;
 	}
+}
+
+template <int InterpType>
+static __forceinline s32 GetVoiceValues(V_Core& thiscore, uint voiceidx)
+{
+	V_Voice& vc(thiscore.Voices[voiceidx]);
+
+	FetchVoiceValues<InterpType>(thiscore, voiceidx);
 
 	const s32 mu = vc.SP + 0x1000;
 
@@ -429,10 +444,13 @@ static __forceinline s32 GetVoiceValues(V_Core& thiscore, uint voiceidx)
 static __forceinline void spu2M_WriteFast(u32 addr, s16 value)
 {
 	// Fixes some of the oldest hangs in pcsx2's history! :p
-	for (int i = 0; i < 2; i++)
+	if (!irq_checks_deferred)
 	{
-		if (Cores[i].IRQEnable && Cores[i].IRQA == addr)
-			SetIrqCall(i);
+		for (int i = 0; i < 2; i++)
+		{
+			if (Cores[i].IRQEnable && Cores[i].IRQA == addr)
+				SetIrqCall(i);
+		}
 	}
 	*GetMemPtr(addr) = value;
 }
@@ -522,11 +540,102 @@ static __forceinline StereoOut32 MixVoice(uint coreidx, uint voiceidx)
 
 const VoiceMixSet VoiceMixSet::Empty((StereoOut32()), (StereoOut32())); // Don't use SteroOut32::Empty because C++ doesn't make any dep/order checks on global initializers.
 
+// --------------------------------------------------------------------------------------
+//  Lane mixing
+// --------------------------------------------------------------------------------------
+// Voices are mixed in two passes: the first one runs in voice order and does everything
+// that can raise IRQs or depends on the previous voice (volume slides, pitch, sample
+// fetch, noise, ADSR), gathering the results into VoiceLanes.  The second pass does the
+// interpolation (cubic, like MixVoice), envelope, volume and gates for all of them with
+// a SIMD kernel.
+//
+// Voices 1 and 3 write their output back to SPU2 ram, which the voices after them could
+// be reading in the same sample, so the first voices are always mixed one by one.  A voice
+// whose pitch is modulated needs the previous voice's output in the first pass, the whole
+// core falls back to per-voice mixing when one of the lane voices uses it.
+
+static const uint LaneFirstVoice = 4;
+
+static MixVoiceLanesFn* SelectVoiceLanesMixer()
+{
+	if (x86caps.hasAVX2)
+		return MixVoiceLanes_AVX2;
+
+	if (x86caps.hasStreamingSIMD4Extensions)
+		return MixVoiceLanes_SSE4;
+
+	return nullptr;
+}
+
+static __forceinline bool CanMixVoiceLanes(const V_Core& thiscore)
+{
+	for (uint voiceidx = LaneFirstVoice + 1; voiceidx < NUM_VOICES; ++voiceidx)
+	{
+		if (thiscore.Voices[voiceidx].Modulated)
+			return false;
+	}
+	return true;
+}
+
+static __forceinline void GatherVoiceLane(VoiceLanes& lanes, uint coreidx, uint voiceidx)
+{
+	V_Core& thiscore(Cores[coreidx]);
+	V_Voice& vc(thiscore.Voices[voiceidx]);
+
+	// Same order of operations as MixVoice.
+	vc.Volume.Update();
+	UpdatePitch(coreidx, voiceidx);
+
+	const bool active = vc.ADSR.Phase > 0;
+	lanes.ActiveMask[voiceidx] = active ? -1 : 0;
+	lanes.NoiseMask[voiceidx] = 0;
+
+	if (active)
+	{
+		if (vc.Noise)
+		{
+			lanes.Noise[voiceidx] = GetNoiseValues();
+			lanes.NoiseMask[voiceidx] = -1;
+		}
+		else
+			FetchVoiceValues<Interpolation>(thiscore, voiceidx);
+
+		CalculateADSR(thiscore, voiceidx);
+	}
+	else
+	{
+		while (vc.SP >= 0)
+			GetNextDataDummy(thiscore, voiceidx); // Dummy is enough
+	}
+
+	lanes.PV4[voiceidx] = vc.PV4;
+	lanes.PV3[voiceidx] = vc.PV3;
+	lanes.PV2[voiceidx] = vc.PV2;
+	lanes.PV1[voiceidx] = vc.PV1;
+	lanes.Mu[voiceidx] = vc.SP + 0x1000;
+	lanes.Envelope[voiceidx] = vc.ADSR.Value;
+	lanes.VolL[voiceidx] = vc.Volume.Left.Value;
+	lanes.VolR[voiceidx] = vc.Volume.Right.Value;
+
+	const V_VoiceGates& gates(thiscore.VoiceGates[voiceidx]);
+	lanes.DryL[voiceidx] = gates.DryL;
+	lanes.DryR[voiceidx] = gates.DryR;
+	lanes.WetL[voiceidx] = gates.WetL;
+	lanes.WetR[voiceidx] = gates.WetR;
+}
+
 static __forceinline void MixCoreVoices(VoiceMixSet& dest, const uint coreidx)
 {
+	static MixVoiceLanesFn* const mixLanes = SelectVoiceLanesMixer();
+	static VoiceLanes lanes;
+
 	V_Core& thiscore(Cores[coreidx]);
 
-	for (uint voiceidx = 0; voiceidx < NUM_VOICES; ++voiceidx)
+	uint laneFirst = NUM_VOICES;
+	if (mixLanes && CanMixVoiceLanes(thiscore))
+		laneFirst = LaneFirstVoice;
+
+	for (uint voiceidx = 0; voiceidx < laneFirst; ++voiceidx)
 	{
 		StereoOut32 VVal(MixVoice(coreidx, voiceidx));
 
@@ -537,6 +646,20 @@ static __forceinline void MixCoreVoices(VoiceMixSet& dest, const uint coreidx)
 		dest.Wet.Left += VVal.Left & thiscore.VoiceGates[voiceidx].WetL;
 		dest.Wet.Right += VVal.Right & thiscore.VoiceGates[voiceidx].WetR;
 	}
+
+	if (laneFirst == NUM_VOICES)
+		return;
+
+	for (uint voiceidx = laneFirst; voiceidx < NUM_VOICES; ++voiceidx)
+		GatherVoiceLane(lanes, coreidx, voiceidx);
+
+	mixLanes(lanes, laneFirst, NUM_VOICES, dest);
+
+	for (uint voiceidx = laneFirst; voiceidx < NUM_VOICES; ++voiceidx)
+	{
+		if (lanes.ActiveMask[voiceidx])
+			thiscore.Voices[voiceidx].OutX = lanes.Value[voiceidx];
+	}
 }
 
 StereoOut32 V_Core::Mix(const VoiceMixSet& inVoices, const StereoOut32& Input, const StereoOut32& Ext)
@@ -674,7 +797,7 @@ __forceinline
 
 		Out = clamp_mix(Out, SndOutVolumeShift);
 	}
-	sample_cb(Out.Left >> 12, Out.Right >> 12);
+	SndBuffer::Write(StereoOut16(Out.Left >> SndOutVolumeShift, Out.Right >> SndOutVolumeShift));
 
 	// Update AutoDMA output positioning
 	OutPos++;
@@ -0,0 +1,220 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PrecompiledHeader.h"
+#include "Global.h"
+#include "MixerSIMD.h"
+
+#include <immintrin.h>
+
+// The core is not built for SSE4/AVX2, the kernels are only called after checking the
+// host cpu, so each of them is compiled for its own instruction set.
+#if defined(__GNUC__)
+#define SPU2_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SPU2_TARGET(isa)
+#endif
+
+// Scalar version of the lane math, used for the lanes left over after the vector loops.
+// Mirrors CatmullRomInterpolate, MulShr32 and ApplyVolume in Mixer.cpp.
+static void MixVoiceLane(VoiceLanes& lanes, uint i, VoiceMixSet& dest)
+{
+	const s32 y0 = lanes.PV4[i], y1 = lanes.PV3[i], y2 = lanes.PV2[i], y3 = lanes.PV1[i];
+	const s32 mu = lanes.Mu[i];
+
+	const s32 a3 = (-y0 + 3 * y1 - 3 * y2 + y3);
+	const s32 a2 = (2 * y0 - 5 * y1 + 4 * y2 - y3);
+	const s32 a1 = (-y0 + y2);
+	const s32 a0 = (2 * y1);
+
+	s32 val = (a3 * mu) >> 12;
+	val = ((a2 + val) * mu) >> 12;
+	val = ((a1 + val) * mu) >> 12;
+	val += a0;
+
+	if (lanes.NoiseMask[i])
+		val = lanes.Noise[i];
+	val &= lanes.ActiveMask[i];
+
+	val = (s64)val * lanes.Envelope[i] >> 32;
+	lanes.Value[i] = val;
+
+	const s32 left = (s64)(val << 1) * lanes.VolL[i] >> 32;
+	const s32 right = (s64)(val << 1) * lanes.VolR[i] >> 32;
+
+	dest.Dry.Left += left & lanes.DryL[i];
+	dest.Dry.Right += right & lanes.DryR[i];
+	dest.Wet.Left += left & lanes.WetL[i];
+	dest.Wet.Right += right & lanes.WetR[i];
+}
+
+// --------------------------------------------------------------------------------------
+//  SSE4.1
+// --------------------------------------------------------------------------------------
+
+// (s64)a * b >> 32 for each lane
+SPU2_TARGET("sse4.1")
+static inline __m128i MulShr32_SSE4(__m128i a, __m128i b)
+{
+	const __m128i even = _mm_srli_epi64(_mm_mul_epi32(a, b), 32);
+	const __m128i odd = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+SPU2_TARGET("sse4.1")
+static inline s32 HorizontalAdd_SSE4(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+SPU2_TARGET("sse4.1")
+void MixVoiceLanes_SSE4(VoiceLanes& lanes, uint first, uint end, VoiceMixSet& dest)
+{
+#define LOAD(member) _mm_loadu_si128((const __m128i*)&lanes.member[i])
+
+	__m128i dryL = _mm_setzero_si128();
+	__m128i dryR = _mm_setzero_si128();
+	__m128i wetL = _mm_setzero_si128();
+	__m128i wetR = _mm_setzero_si128();
+
+	uint i = first;
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128i y0 = LOAD(PV4);
+		const __m128i y1 = LOAD(PV3);
+		const __m128i y2 = LOAD(PV2);
+		const __m128i y3 = LOAD(PV1);
+		const __m128i mu = LOAD(Mu);
+
+		const __m128i a3 = _mm_add_epi32(_mm_sub_epi32(y3, y0), _mm_mullo_epi32(_mm_sub_epi32(y1, y2), _mm_set1_epi32(3)));
+		const __m128i a2 = _mm_sub_epi32(
+			_mm_add_epi32(_mm_slli_epi32(y0, 1), _mm_slli_epi32(y2, 2)),
+			_mm_add_epi32(_mm_mullo_epi32(y1, _mm_set1_epi32(5)), y3));
+		const __m128i a1 = _mm_sub_epi32(y2, y0);
+		const __m128i a0 = _mm_slli_epi32(y1, 1);
+
+		__m128i val = _mm_srai_epi32(_mm_mullo_epi32(a3, mu), 12);
+		val = _mm_srai_epi32(_mm_mullo_epi32(_mm_add_epi32(a2, val), mu), 12);
+		val = _mm_srai_epi32(_mm_mullo_epi32(_mm_add_epi32(a1, val), mu), 12);
+		val = _mm_add_epi32(a0, val);
+
+		val = _mm_blendv_epi8(val, LOAD(Noise), LOAD(NoiseMask));
+		val = _mm_and_si128(val, LOAD(ActiveMask));
+
+		val = MulShr32_SSE4(val, LOAD(Envelope));
+		_mm_storeu_si128((__m128i*)&lanes.Value[i], val);
+
+		const __m128i val2 = _mm_slli_epi32(val, 1);
+		const __m128i left = MulShr32_SSE4(val2, LOAD(VolL));
+		const __m128i right = MulShr32_SSE4(val2, LOAD(VolR));
+
+		dryL = _mm_add_epi32(dryL, _mm_and_si128(left, LOAD(DryL)));
+		dryR = _mm_add_epi32(dryR, _mm_and_si128(right, LOAD(DryR)));
+		wetL = _mm_add_epi32(wetL, _mm_and_si128(left, LOAD(WetL)));
+		wetR = _mm_add_epi32(wetR, _mm_and_si128(right, LOAD(WetR)));
+	}
+
+	dest.Dry.Left += HorizontalAdd_SSE4(dryL);
+	dest.Dry.Right += HorizontalAdd_SSE4(dryR);
+	dest.Wet.Left += HorizontalAdd_SSE4(wetL);
+	dest.Wet.Right += HorizontalAdd_SSE4(wetR);
+
+	for (; i < end; ++i)
+		MixVoiceLane(lanes, i, dest);
+
+#undef LOAD
+}
+
+// --------------------------------------------------------------------------------------
+//  AVX2
+// --------------------------------------------------------------------------------------
+
+SPU2_TARGET("avx2")
+static inline __m256i MulShr32_AVX2(__m256i a, __m256i b)
+{
+	const __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(a, b), 32);
+	const __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+	return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+SPU2_TARGET("avx2")
+static inline s32 HorizontalAdd_AVX2(__m256i v)
+{
+	__m128i v128 = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	v128 = _mm_add_epi32(v128, _mm_shuffle_epi32(v128, _MM_SHUFFLE(1, 0, 3, 2)));
+	v128 = _mm_add_epi32(v128, _mm_shuffle_epi32(v128, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v128);
+}
+
+SPU2_TARGET("avx2")
+void MixVoiceLanes_AVX2(VoiceLanes& lanes, uint first, uint end, VoiceMixSet& dest)
+{
+#define LOAD(member) _mm256_loadu_si256((const __m256i*)&lanes.member[i])
+
+	__m256i dryL = _mm256_setzero_si256();
+	__m256i dryR = _mm256_setzero_si256();
+	__m256i wetL = _mm256_setzero_si256();
+	__m256i wetR = _mm256_setzero_si256();
+
+	uint i = first;
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256i y0 = LOAD(PV4);
+		const __m256i y1 = LOAD(PV3);
+		const __m256i y2 = LOAD(PV2);
+		const __m256i y3 = LOAD(PV1);
+		const __m256i mu = LOAD(Mu);
+
+		const __m256i a3 = _mm256_add_epi32(_mm256_sub_epi32(y3, y0), _mm256_mullo_epi32(_mm256_sub_epi32(y1, y2), _mm256_set1_epi32(3)));
+		const __m256i a2 = _mm256_sub_epi32(
+			_mm256_add_epi32(_mm256_slli_epi32(y0, 1), _mm256_slli_epi32(y2, 2)),
+			_mm256_add_epi32(_mm256_mullo_epi32(y1, _mm256_set1_epi32(5)), y3));
+		const __m256i a1 = _mm256_sub_epi32(y2, y0);
+		const __m256i a0 = _mm256_slli_epi32(y1, 1);
+
+		__m256i val = _mm256_srai_epi32(_mm256_mullo_epi32(a3, mu), 12);
+		val = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_add_epi32(a2, val), mu), 12);
+		val = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_add_epi32(a1, val), mu), 12);
+		val = _mm256_add_epi32(a0, val);
+
+		val = _mm256_blendv_epi8(val, LOAD(Noise), LOAD(NoiseMask));
+		val = _mm256_and_si256(val, LOAD(ActiveMask));
+
+		val = MulShr32_AVX2(val, LOAD(Envelope));
+		_mm256_storeu_si256((__m256i*)&lanes.Value[i], val);
+
+		const __m256i val2 = _mm256_slli_epi32(val, 1);
+		const __m256i left = MulShr32_AVX2(val2, LOAD(VolL));
+		const __m256i right = MulShr32_AVX2(val2, LOAD(VolR));
+
+		dryL = _mm256_add_epi32(dryL, _mm256_and_si256(left, LOAD(DryL)));
+		dryR = _mm256_add_epi32(dryR, _mm256_and_si256(right, LOAD(DryR)));
+		wetL = _mm256_add_epi32(wetL, _mm256_and_si256(left, LOAD(WetL)));
+		wetR = _mm256_add_epi32(wetR, _mm256_and_si256(right, LOAD(WetR)));
+	}
+
+	dest.Dry.Left += HorizontalAdd_AVX2(dryL);
+	dest.Dry.Right += HorizontalAdd_AVX2(dryR);
+	dest.Wet.Left += HorizontalAdd_AVX2(wetL);
+	dest.Wet.Right += HorizontalAdd_AVX2(wetR);
+
+	// 4 voice leftovers are common (24 voices minus the ones mixed in order)
+	if (i < end)
+		MixVoiceLanes_SSE4(lanes, i, end, dest);
+
+#undef LOAD
+}
@@ -0,0 +1,55 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// --------------------------------------------------------------------------------------
+//  VoiceLanes
+// --------------------------------------------------------------------------------------
+// Structure-of-arrays copy of the per-sample voice state needed to finish mixing a voice
+// once its sample data has been fetched and its envelope updated.  The mixer fills it one
+// voice at a time (fetching, ADSR and noise keep their scalar order, they touch IRQs and
+// shared state), then a lane kernel does the interpolation, envelope, volume and gating
+// of several voices at once.
+//
+// All masks are 0 or -1, gates are the V_VoiceGates values sign extended.
+struct VoiceLanes
+{
+	alignas(32) s32 PV4[NUM_VOICES];
+	alignas(32) s32 PV3[NUM_VOICES];
+	alignas(32) s32 PV2[NUM_VOICES];
+	alignas(32) s32 PV1[NUM_VOICES];
+	alignas(32) s32 Mu[NUM_VOICES];			// 0.12 interpolation position (SP + 0x1000)
+	alignas(32) s32 Noise[NUM_VOICES];		// noise value, used instead of the interpolation
+	alignas(32) s32 NoiseMask[NUM_VOICES];
+	alignas(32) s32 ActiveMask[NUM_VOICES];	// ADSR phase was non-zero
+	alignas(32) s32 Envelope[NUM_VOICES];	// ADSR value after this sample's update
+	alignas(32) s32 VolL[NUM_VOICES];
+	alignas(32) s32 VolR[NUM_VOICES];
+	alignas(32) s32 DryL[NUM_VOICES];
+	alignas(32) s32 DryR[NUM_VOICES];
+	alignas(32) s32 WetL[NUM_VOICES];
+	alignas(32) s32 WetR[NUM_VOICES];
+
+	// Output: post-ADSR voice value (the scalar mixer's OutX).
+	alignas(32) s32 Value[NUM_VOICES];
+};
+
+// Mixes voices [first, end) of 'lanes' into 'dest', using Catmull-Rom interpolation.
+// Results are bit-identical to the scalar MixVoice path.
+typedef void MixVoiceLanesFn(VoiceLanes& lanes, uint first, uint end, VoiceMixSet& dest);
+
+extern MixVoiceLanesFn MixVoiceLanes_SSE4;
+extern MixVoiceLanesFn MixVoiceLanes_AVX2;
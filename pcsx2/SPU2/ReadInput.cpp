@@ -100,9 +100,12 @@ StereoOut32 V_Core::ReadInput()
 
 	if ((Index != 1) || ((PlayMode & 2) == 0))
 	{
-		for (int i = 0; i < 2; i++)
-			if (Cores[i].IRQEnable && 0x2000 + (Index << 10) + InputPosRead == (Cores[i].IRQA & 0xfffffdff))
-				SetIrqCall(i);
+		if (!irq_checks_deferred)
+		{
+			for (int i = 0; i < 2; i++)
+				if (Cores[i].IRQEnable && 0x2000 + (Index << 10) + InputPosRead == (Cores[i].IRQA & 0xfffffdff))
+					SetIrqCall(i);
+		}
 
 		//retval = StereoOut32(
 		//	(s32)ADMATempBuffer[InputPosRead],
@@ -0,0 +1,78 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PrecompiledHeader.h"
+#include "Global.h"
+
+extern retro_audio_sample_t sample_cb;
+extern retro_audio_sample_batch_t batch_cb;
+
+StereoOut16 SndBuffer::m_ring[SndBuffer::RingSize];
+std::atomic<u32> SndBuffer::m_wpos(0);
+std::atomic<u32> SndBuffer::m_rpos(0);
+std::atomic_flag SndBuffer::m_flushing = ATOMIC_FLAG_INIT;
+std::atomic<int> SndBuffer::m_blockSize(0);
+
+void SndBuffer::Write(const StereoOut16& sample)
+{
+	const u32 wpos = m_wpos.load(std::memory_order_relaxed);
+	const u32 queued = wpos - m_rpos.load(std::memory_order_acquire);
+
+	// Nobody is draining the ring (frontend paused or not running frames), drop the sample
+	// rather than overwrite audio that may still be read.
+	if (queued >= RingSize)
+		return;
+
+	m_ring[wpos & (RingSize - 1)] = sample;
+	m_wpos.store(wpos + 1, std::memory_order_release);
+
+	const int block = m_blockSize.load(std::memory_order_relaxed);
+	if (block > 0 && (int)queued + 1 >= block)
+		Flush();
+}
+
+void SndBuffer::Flush()
+{
+	// The EE and frontend threads can both flush; whoever comes second has nothing to do.
+	if (m_flushing.test_and_set(std::memory_order_acquire))
+		return;
+
+	u32 rpos = m_rpos.load(std::memory_order_relaxed);
+	const u32 wpos = m_wpos.load(std::memory_order_acquire);
+
+	while (rpos != wpos)
+	{
+		const u32 start = rpos & (RingSize - 1);
+		const u32 count = std::min(wpos - rpos, RingSize - start);
+
+		if (batch_cb)
+			batch_cb(&m_ring[start].Left, count);
+		else
+		{
+			for (u32 i = 0; i < count; ++i)
+				sample_cb(m_ring[start + i].Left, m_ring[start + i].Right);
+		}
+
+		rpos += count;
+		m_rpos.store(rpos, std::memory_order_release);
+	}
+
+	m_flushing.clear(std::memory_order_release);
+}
+
+void SndBuffer::SetBlockSize(int samples)
+{
+	m_blockSize.store(std::min(std::max(samples, 0), RingSize / 2), std::memory_order_relaxed);
+}
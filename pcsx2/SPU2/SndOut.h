@@ -235,3 +235,29 @@ struct Stereo51Out32
 	s32 LeftBack;
 	s32 RightBack;
 };
+
+// --------------------------------------------------------------------------------------
+//  SndBuffer
+// --------------------------------------------------------------------------------------
+// Queues the mixer output and hands it to the frontend in blocks through the batch audio
+// callback, rather than one callback per sample.  Write() is called by the mixer on the
+// EE thread; blocks are sent from there once BlockSize samples are queued, and whatever is
+// left is sent by the frontend thread at the end of each retro_run.  A block size of 0
+// only flushes once per frame.
+class SndBuffer
+{
+protected:
+	static const int RingSize = 0x2000; // stereo samples, must be a power of two
+
+	static StereoOut16 m_ring[RingSize];
+	static std::atomic<u32> m_wpos;
+	static std::atomic<u32> m_rpos;
+	static std::atomic_flag m_flushing;
+	static std::atomic<int> m_blockSize;
+
+public:
+	static void Write(const StereoOut16& sample);
+	static void Flush();
+
+	static void SetBlockSize(int samples);
+};
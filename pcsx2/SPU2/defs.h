@@ -481,6 +481,9 @@ extern u32 Cycles;
 extern int PlayMode;
 
 extern void SetIrqCall(int core);
+// Set while TimeUpdate mixes a block of samples that was checked beforehand not to reach any
+// IRQA; the mixer skips its per-access IRQA tests then.
+extern bool irq_checks_deferred;
 extern void InitADSR();
 
 namespace SPU2Savestate
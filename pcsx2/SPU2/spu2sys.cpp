@@ -40,6 +40,7 @@ u32 Cycles;
 int PlayMode;
 
 bool has_to_call_irq = false;
+bool irq_checks_deferred = false;
 
 void SetIrqCall(int core)
 {
@@ -268,6 +269,49 @@ void V_Voice::Stop(void)
 
 #define TickInterval 768
 #define SanityInterval 4800
+#define MixBlockSize 64
+
+// Whether the next 'samples' samples can be mixed without any IRQA test firing, so that
+// the tests can be done once for the whole block here instead of on every access.
+//
+// Voices are assumed to move at most 8 halfwords per sample (pitch is clamped to 0x3fff,
+// so four ADPCM samples, plus a block header), starting from their current address or,
+// after a loop end, from their loop start.  Everything else the mixer touches (voice and
+// core output, ADMA input and the reverb work areas) is covered as a whole.
+static bool CanDeferIrqChecks(u32 samples)
+{
+	const u32 reach = (samples + 1) * 8;
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (!Cores[i].IRQEnable)
+			continue;
+
+		const u32 irqa = Cores[i].IRQA;
+
+		if (irqa >= 0x400 && irqa < 0x2800)
+			return false;
+
+		for (int c = 0; c < 2; c++)
+		{
+			const V_Core& thiscore(Cores[c]);
+
+			if (irqa >= thiscore.EffectsStartA && irqa <= thiscore.EffectsEndA)
+				return false;
+
+			for (int v = 0; v < NUM_VOICES; v++)
+			{
+				const V_Voice& vc(thiscore.Voices[v]);
+
+				if (((irqa - (vc.NextA & 0xFFFF8)) & 0xFFFFF) <= reach ||
+					((irqa - (vc.LoopStartA & 0xFFFF8)) & 0xFFFFF) <= reach)
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
 
 __forceinline void TimeUpdate(u32 cClocks)
 {
@@ -298,6 +342,28 @@ __forceinline void TimeUpdate(u32 cClocks)
 			spu2Irq();
 		}
 
+		// Block mixing: with no DMA counting down and no IRQ that can fire, nothing has to
+		// happen between samples, so mix as many as we can with the IRQA tests hoisted out.
+		if (Cores[0].DMAICounter <= 0 && Cores[1].DMAICounter <= 0)
+		{
+			const u32 samples = std::min<u32>(dClocks / TickInterval, MixBlockSize);
+
+			if (samples > 1 && CanDeferIrqChecks(samples))
+			{
+				irq_checks_deferred = true;
+				for (u32 i = 0; i < samples; i++)
+				{
+					Cycles++;
+					Mix();
+				}
+				irq_checks_deferred = false;
+
+				dClocks -= samples * TickInterval;
+				lClocks += samples * TickInterval;
+				continue;
+			}
+		}
+
 		//Update DMA4 interrupt delay counter
 		if (Cores[0].DMAICounter > 0)
 		{
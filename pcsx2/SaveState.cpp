@@ -263,6 +263,51 @@ memSavingState& memSavingState::FreezeAll()
 	return *this;
 }
 
+// --------------------------------------------------------------------------------------
+//  memDeltaSavingState (implementations)
+// --------------------------------------------------------------------------------------
+memDeltaSavingState::memDeltaSavingState( SafeArray<u8>& save_to, int prevsize, std::vector<u8>& changed )
+	: SaveStateBase( save_to )
+	, m_changed( changed )
+	, m_prevsize( prevsize )
+{
+	m_changed.assign( m_changed.size(), 0 );
+}
+
+void memDeltaSavingState::FreezeMem( void* data, int size )
+{
+	if (!size) return;
+
+	m_memory->MakeRoomFor( m_idx + size );
+	const uint pages = (m_idx + size + StatePageSize - 1) / StatePageSize;
+	if (m_changed.size() < pages)
+		m_changed.resize( pages, 0 );
+
+	const u8* src = (u8*)data;
+	u8* dest = m_memory->GetPtr(m_idx);
+
+	// Chunks never straddle a page of the state, and so never more than two pages of ram.
+	for (int off = 0; off < size; )
+	{
+		const int pos = m_idx + off;
+		const int len = std::min( size - off, StatePageSize - (pos % StatePageSize) );
+
+		bool stale = (pos + len > m_prevsize);
+		if (!stale && (mmap_IsRamPageDirty(src + off) || mmap_IsRamPageDirty(src + off + len - 1)))
+			stale = memcmp( dest + off, src + off, len ) != 0;
+
+		if (stale)
+		{
+			memcpy( dest + off, src + off, len );
+			m_changed[pos / StatePageSize] = 1;
+		}
+
+		off += len;
+	}
+
+	m_idx += size;
+}
+
 // --------------------------------------------------------------------------------------
 //  memLoadingState  (implementations)
 // --------------------------------------------------------------------------------------
@@ -185,6 +185,34 @@ public:
 	bool IsSaving() const { return true; }
 };
 
+// --------------------------------------------------------------------------------------
+//  memDeltaSavingState
+// --------------------------------------------------------------------------------------
+// Refreshes a memory state saved earlier by the same layout of Freeze calls, in place.
+// EE and IOP main ram only copy the pages written since the last refresh (see
+// mmap_EnableDirtyPageTracking), everything else is compared against the old contents.
+// Every StatePageSize block of the state that changed is flagged in 'changed', which is
+// what delta savestates are built from.
+class memDeltaSavingState : public SaveStateBase
+{
+	typedef SaveStateBase _parent;
+
+public:
+	static const int StatePageSize = _4kb;
+
+protected:
+	std::vector<u8>& m_changed;
+	int m_prevsize;		// bytes of the state that are valid from the previous refresh
+
+public:
+	virtual ~memDeltaSavingState() = default;
+	memDeltaSavingState( VmStateBuffer& save_to, int prevsize, std::vector<u8>& changed );
+
+	void FreezeMem( void* data, int size );
+
+	bool IsSaving() const { return true; }
+};
+
 class memLoadingState : public SaveStateBase
 {
 public:
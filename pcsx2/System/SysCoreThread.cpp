@@ -342,6 +342,15 @@ void SysCoreThread::OnSuspendInThread()
 	modules_close();
 }
 
+void SysCoreThread::OnPauseInThread()
+{
+#ifdef __LIBRETRO__
+	// The frontend thread may be running the MTGS until the EE gets here
+	// (see SysMtgsThread::FlushRingUntilEEPaused).
+	GetMTGS().NotifyEEPaused();
+#endif
+}
+
 void SysCoreThread::OnResumeInThread(bool isSuspended)
 {
 	modules_open(isSuspended);
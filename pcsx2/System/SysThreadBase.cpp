@@ -122,7 +122,11 @@ void SysThreadBase::Suspend( bool isBlocking )
 //   The previous suspension state; true if the thread was running or false if it was
 //   closed, not running, or paused.
 //
-void SysThreadBase::Pause()
+// Parameters:
+//   isBlocking - if set to false then the function only requests the pause and returns;
+//      the thread parks at its next state check.
+//
+void SysThreadBase::Pause( bool isBlocking )
 {
 	if( IsSelf() || !IsRunning() ) return;
 
@@ -145,7 +149,8 @@ void SysThreadBase::Pause()
 		m_sem_event.Post();
 	}
 
-	m_RunningLock.Wait();
+	if( isBlocking )
+		m_RunningLock.Wait();
 }
 
 // Resumes the core execution state, or does nothing is the core is already running.  If
@@ -112,7 +112,7 @@ public:
 
 	virtual void Suspend( bool isBlocking = true );
 	virtual void Resume();
-	virtual void Pause();
+	virtual void Pause( bool isBlocking = true );
 
 protected:
 	virtual void OnStart();
@@ -355,7 +355,7 @@ protected:
 	virtual void Start();
 	virtual void OnStart();
 	virtual void OnSuspendInThread();
-	virtual void OnPauseInThread() {}
+	virtual void OnPauseInThread();
 	virtual void OnResumeInThread( bool IsSuspended );
 	virtual void OnCleanupInThread();
 	virtual void ExecuteTaskInThread();
@@ -17,14 +17,23 @@
 
 #include "App.h"
 #include "AppGameDatabase.h"
+#ifdef PCSX2_GAMEINDEX_BIN
+#include "GameIndexBin.h"
+#else
 #include "GameIndex.h"
+#endif
 
 AppGameDatabase& AppGameDatabase::Load()
 {
+#ifdef PCSX2_GAMEINDEX_BIN
+	if (!this->initDatabase(GameIndex_bin, GameIndex_bin_len))
+		log_cb(RETRO_LOG_ERROR, "[GameDB] Database could not be loaded successfully\n");
+#else
 	std::string game_index(reinterpret_cast<const char*>(&GameIndex_yaml), GameIndex_yaml_len);
 	std::istringstream stream(game_index);
 	if (!this->initDatabase(stream))
 		log_cb(RETRO_LOG_ERROR, "[GameDB] Database could not be loaded successfully\n");
+#endif
 	return *this;
 }
 
@@ -19,7 +19,15 @@
 
 #include "AppConfig.h"
 
-class AppGameDatabase : public YamlGameDatabaseImpl
+// The build embeds the precompiled GameDB when it can run GameIndexCompiler, and
+// GameIndex.yaml otherwise.
+#ifdef PCSX2_GAMEINDEX_BIN
+typedef BinaryGameDatabaseImpl AppGameDatabaseImpl;
+#else
+typedef YamlGameDatabaseImpl AppGameDatabaseImpl;
+#endif
+
+class AppGameDatabase : public AppGameDatabaseImpl
 {
 public:
 	AppGameDatabase() {}
@@ -47,6 +47,7 @@ namespace vtlb_private
 }
 
 static vtlbHandler vtlbHandlerCount = 0;
+static u32 vtlbVMapGeneration = 0;
 
 static vtlbHandler DefaultPhyHandler;
 static vtlbHandler UnmappedVirtHandler0;
@@ -135,7 +136,10 @@ void __fastcall vtlb_memWrite(u32 addr, DataType data)
 	auto vmv = vtlbdata.vmap[addr>>VTLB_PAGE_BITS];
 
 	if (!vmv.isHandler(addr))
+	{
 		*reinterpret_cast<DataType*>(vmv.assumePtr(addr))=data;
+		return;
+	}
 	//has to: translate, find function, call function
 	paddr = vmv.assumeHandlerGetPAddr(addr);
 	return vmv.assumeHandler<sizeof(DataType)*8, true>()(paddr, data);
@@ -405,6 +409,22 @@ __fi void* vtlb_GetPhyPtr(u32 paddr)
 	return reinterpret_cast<void*>(vtlbdata.pmap[paddr>>VTLB_PAGE_BITS].assumePtr()+(paddr&VTLB_PAGE_MASK));
 }
 
+// Same as vtlb_GetPhyPtr for a virtual address, going through the current TLB mappings.
+void* vtlb_GetVirtPtr(u32 vaddr)
+{
+	auto vmv = vtlbdata.vmap[vaddr>>VTLB_PAGE_BITS];
+	if (vmv.isHandler(vaddr))
+		return NULL;
+	return reinterpret_cast<void*>(vmv.assumePtr(vaddr));
+}
+
+// Changes every time the virtual mappings do, pointers from vtlb_GetVirtPtr are only
+// valid for as long as it stays the same.
+u32 vtlb_GetVMapGeneration()
+{
+	return vtlbVMapGeneration;
+}
+
 __fi u32 vtlb_V2P(u32 vaddr)
 {
 	u32 paddr = vtlbdata.ppmap[vaddr>>VTLB_PAGE_BITS];
@@ -416,6 +436,8 @@ __fi u32 vtlb_V2P(u32 vaddr)
 //TODO: Add invalid paddr checks
 void vtlb_VMap(u32 vaddr,u32 paddr,u32 size)
 {
+	vtlbVMapGeneration++;
+
 	while (size > 0)
 	{
 		VTLBVirtual vmv;
@@ -442,6 +464,8 @@ void vtlb_VMap(u32 vaddr,u32 paddr,u32 size)
 
 void vtlb_VMapBuffer(u32 vaddr,void* buffer,u32 size)
 {
+	vtlbVMapGeneration++;
+
 	uptr bu8 = (uptr)buffer;
 	while (size > 0)
 	{
@@ -454,6 +478,8 @@ void vtlb_VMapBuffer(u32 vaddr,void* buffer,u32 size)
 
 void vtlb_VMapUnmap(u32 vaddr,u32 size)
 {
+	vtlbVMapGeneration++;
+
 	while (size > 0)
 	{
 
@@ -55,3 +55,119 @@ void BaseBlocks::Link(u32 pc, s32* jumpptr)
 	links.insert(std::pair<u32, uptr>(pc, (uptr)jumpptr));
 }
 
+
+int BaseBlocks::Evict(uptr begin, uptr end, void (*evicted)(const BASEBLOCKEX& block))
+{
+	auto inRange = [begin, end](const BASEBLOCKEX& block) {
+		return block.fnptr >= begin && block.fnptr < end;
+	};
+
+	int count = 0;
+	for (u32 idx = 0; idx < blocks.size(); idx++)
+	{
+		const BASEBLOCKEX& block = blocks[idx];
+		if (!inRange(block))
+			continue;
+
+		evicted(block);
+		std::pair<linkiter_t, linkiter_t> range = links.equal_range(block.startpc);
+		for (linkiter_t i = range.first; i != range.second; ++i)
+			*(u32*)i->second = recompiler - (i->second + 4);
+		count++;
+	}
+
+	if (count)
+		blocks.erase_if(inRange);
+
+	// Includes the jumps of blocks that were cleared before, their code gets overwritten too
+	for (linkiter_t i = links.begin(); i != links.end();)
+	{
+		if (i->second >= begin && i->second < end)
+			i = links.erase(i);
+		else
+			++i;
+	}
+
+	return count;
+}
+
+uptr BaseBlocks::GetCodeSize() const
+{
+	uptr size = 0;
+	for (u32 idx = 0; idx < blocks.size(); idx++)
+		size += blocks[idx].x86size;
+	return size;
+}
+
+RecCodeGenerations::RecCodeGenerations(const char* name, BaseBlocks& blocks)
+	: m_name(name)
+	, m_blocks(blocks)
+	, m_base(NULL)
+	, m_size(0)
+	, m_current(0)
+	, m_wrapped(false)
+	, m_compiled(0)
+	, m_lastLog(clock::now())
+{
+	memzero(m_stats);
+}
+
+void RecCodeGenerations::Reset(u8* base, u8* end)
+{
+	if (m_compiled)
+	{
+		m_stats.resets++;
+		LogStats("buffer reset");
+	}
+
+	m_base = base;
+	m_size = ((end - base) / Count) & ~(uptr)(__pagesize - 1);
+	pxAssert(m_size > _64kb);
+	m_current = 0;
+	m_wrapped = false;
+	m_compiled = 0;
+}
+
+u8* RecCodeGenerations::Evict(void (*evicted)(const BASEBLOCKEX& block))
+{
+	const clock::time_point start = clock::now();
+
+	m_current = (m_current + 1) % Count;
+	m_wrapped = m_wrapped || m_current == 0;
+
+	u8* begin = m_base + m_current * m_size;
+	const int count = m_blocks.Evict((uptr)begin, (uptr)(begin + m_size), evicted);
+
+	// The first round fills empty generations, it costs nothing
+	if (m_wrapped)
+	{
+		const u64 time = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+		m_stats.evictions++;
+		m_stats.evictedBlocks += count;
+		m_stats.evictTime += time;
+
+		char event[96];
+		snprintf(event, sizeof(event), "generation %u evicted (%d blocks, %.2f ms)", m_current, count, time / 1e6);
+		LogStats(event);
+	}
+
+	return begin;
+}
+
+void RecCodeGenerations::LogStats(const char* event)
+{
+	const clock::time_point now = clock::now();
+	const double seconds = std::chrono::duration<double>(now - m_lastLog).count();
+	if (seconds < LogInterval)
+		return;
+
+	const double minutes = seconds / 60;
+	log_cb(RETRO_LOG_INFO, "%s rec: %s, %.1f of %.1f MB of live code, over %.0f s: %.2f evictions/min (%llu blocks, %.1f ms), "
+						   "%.2f resets/min, %llu blocks compiled in %.1f ms\n",
+		m_name, event, m_blocks.GetCodeSize() / (double)_1mb, (m_size * Count) / (double)_1mb, seconds,
+		m_stats.evictions / minutes, (unsigned long long)m_stats.evictedBlocks, m_stats.evictTime / 1e6,
+		m_stats.resets / minutes, (unsigned long long)m_stats.blocks, m_stats.compileTime / 1e6);
+
+	memzero(m_stats);
+	m_lastLog = now;
+}
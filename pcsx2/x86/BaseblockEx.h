@@ -16,6 +16,8 @@
 #pragma once
 
 #include <map>			// used by BaseBlockEx
+#include <algorithm>
+#include <chrono>
 
 // Every potential jump point in the PS2's addressable memory has a BASEBLOCK
 // associated with it. So that means a BASEBLOCK for every 4 bytes of PS2
@@ -116,6 +118,13 @@ public:
 		_Size = 0;
 	}
 
+	// Removes the blocks for which pred returns true, the others keep their order
+	template <typename Pred>
+	__fi void erase_if(Pred pred)
+	{
+		_Size = std::remove_if(blocks, blocks + _Size, pred) - blocks;
+	}
+
 	__fi u32 size() const
 	{
 		return _Size;
@@ -204,6 +213,14 @@ public:
 
 	void Link(u32 pc, s32* jumpptr);
 
+	// Removes the blocks whose code is in [begin, end) and forgets the jumps that were
+	// emitted there, so this part of the code buffer can be reused.  evicted is called
+	// on each block before it goes (to reset its BASEBLOCK).  Returns the block count.
+	int Evict(uptr begin, uptr end, void (*evicted)(const BASEBLOCKEX& block));
+
+	// Size in bytes of the translated code of all the blocks
+	uptr GetCodeSize() const;
+
 	__fi void Reset()
 	{
 		blocks.clear();
@@ -211,6 +228,78 @@ public:
 	}
 };
 
+// The code buffer of a recompiler, split into generations which are filled in turn.
+//
+// When the current generation is full the recompiler moves on to the next one and only
+// evicts the blocks that were compiled there (the oldest ones), instead of resetting the
+// whole buffer and compiling the working set again all at once.  Evicted blocks that still
+// run get compiled again into the newest generation, so the hot code keeps moving forward
+// while the younger generations keep their blocks.
+//
+// It also keeps track of how the buffer copes: live code size, evictions and resets per
+// minute and the time spent compiling, which are logged when the buffer gets evicted or
+// reset (at most every LogInterval seconds).
+class RecCodeGenerations
+{
+public:
+	static const uint Count = 4;
+	static const uint LogInterval = 10;
+
+protected:
+	typedef std::chrono::steady_clock clock;
+
+	struct Stats
+	{
+		u64 blocks;			// compiled
+		u64 compileTime;	// ns
+		u64 evictions;
+		u64 evictedBlocks;
+		u64 evictTime;		// ns
+		u64 resets;
+	};
+
+	const char* m_name;
+	BaseBlocks& m_blocks;
+	u8* m_base;
+	uptr m_size;			// of a generation
+	uint m_current;
+	bool m_wrapped;			// all the generations were used since the reset
+	u64 m_compiled;			// blocks compiled since the reset
+	clock::time_point m_compileStart;
+	clock::time_point m_lastLog;
+	Stats m_stats;			// since m_lastLog
+
+	void LogStats(const char* event);
+
+public:
+	RecCodeGenerations(const char* name, BaseBlocks& blocks);
+
+	// The whole buffer [base, end) is free again, the recompiler starts at base.
+	// Must be called before the blocks are reset.
+	void Reset(u8* base, u8* end);
+
+	// True when a block starting at ptr could overflow the current generation
+	__fi bool IsFull(const u8* ptr) const
+	{
+		return ptr >= m_base + (m_current + 1) * m_size - _64kb;
+	}
+
+	// Evicts the next (oldest) generation and returns where the recompiler carries on
+	u8* Evict(void (*evicted)(const BASEBLOCKEX& block));
+
+	__fi void BeginCompile()
+	{
+		m_compileStart = clock::now();
+	}
+
+	__fi void EndCompile()
+	{
+		m_stats.blocks++;
+		m_stats.compileTime += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - m_compileStart).count();
+		m_compiled++;
+	}
+};
+
 #define PC_GETBLOCK_(x, reclut) ((BASEBLOCK*)(reclut[((u32)(x)) >> 16] + (x)*(sizeof(BASEBLOCK)/4)))
 
 /**
@@ -55,6 +55,7 @@ static BASEBLOCK *recROM = NULL;	// and here
 static BASEBLOCK *recROM1 = NULL;	// also here
 static BASEBLOCK *recROM2 = NULL;   // also here
 static BaseBlocks recBlocks;
+static RecCodeGenerations recCodeGens("IOP", recBlocks);
 static u8 *recPtr = NULL;
 u32 psxpc;			// recompiler psxpc
 int psxbranch;		// set for branch
@@ -607,6 +608,7 @@ void recResetIOP(void)
 	if( s_pInstCache )
 		memset( s_pInstCache, 0, sizeof(EEINST)*s_nInstCacheSize );
 
+	recCodeGens.Reset(*recMem, recMem->GetPtrEnd());
 	recBlocks.Reset();
 	g_psxMaxRecMem = 0;
 
@@ -630,6 +632,14 @@ static void iopClearRecLUT(BASEBLOCK* base, int count)
 		base[i].SetFnptr((uptr)iopJITCompile);
 }
 
+// The code of the block is about to be overwritten, it gets compiled again if it runs
+static void iopEvictBlock(const BASEBLOCKEX& block)
+{
+	BASEBLOCK* pblock = PSX_GETBLOCK(block.startpc);
+	if (pblock->GetFnptr() == block.fnptr)
+		pblock->SetFnptr((uptr)iopJITCompile);
+}
+
 static void recExecute(void)
 {
 	// note: this function is currently never used.
@@ -889,10 +899,11 @@ static void __fastcall iopRecRecompile( const u32 startpc )
 
 	pxAssert( startpc );
 
-	// if recPtr reached the mem limit reset whole mem
-	if (recPtr >= (recMem->GetPtrEnd() - _64kb)) {
-		recResetIOP();
-	}
+	// if recPtr reached the end of its generation, make room in the oldest one
+	if (recCodeGens.IsFull(recPtr))
+		recPtr = recCodeGens.Evict(iopEvictBlock);
+
+	recCodeGens.BeginCompile();
 
 	x86SetPtr( recPtr );
 	x86Align(16);
@@ -1075,6 +1086,8 @@ StartRecomp:
 
 	s_pCurBlock = NULL;
 	s_pCurBlockEx = NULL;
+
+	recCodeGens.EndCompile();
 }
 
 static void recSetCacheReserve( uint reserveInMegs )
@@ -0,0 +1,81 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Counts how many times each block of the EE recompiler runs.
+//
+// While enabled, recRecompile gives every block it compiles a BlockProfile and makes the
+// block's prologue increment its count.  Cycles are the EE cycles the block adds to
+// cpuRegs.cycle (scaled by the EE cycle rate), times its count.  Blocks that get cleared
+// and recompiled are added up by start address: when the recompiler drops a block (cleared
+// or evicted from the code buffer) its count goes to the totals and its profile is reused.
+//
+// Enabling or disabling it takes effect at the next block compilation, which resets the
+// recompiler so that all blocks are compiled the same way.
+class EEBlockProfiler
+{
+public:
+	struct BlockProfile
+	{
+		u64 count;	// incremented by the block
+		u32 startpc;
+		u32 size;	// in instructions
+		u32 cycles; // per execution
+	};
+
+protected:
+	struct Totals
+	{
+		u64 count;
+		u64 cycles;
+		u32 size;
+	};
+
+	std::atomic<bool> m_enabled;
+	std::mutex m_lock;
+	std::deque<BlockProfile> m_blocks;			// profiles of the recompiler's current blocks, or free
+	std::vector<BlockProfile*> m_free;			// of m_blocks, the blocks were dropped
+	std::unordered_map<uptr, BlockProfile*> m_live; // by the code of the block
+	std::unordered_map<u32, Totals> m_totals;	// blocks that were dropped, by startpc
+
+	void Fold(const BlockProfile& block, std::unordered_map<u32, Totals>& totals) const;
+
+public:
+	EEBlockProfiler();
+
+	bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+	void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+	// Recompiler side, from the EE thread
+	BlockProfile* Add(u32 startpc, uptr code);
+	void Remove(uptr code); // the block compiled at code was dropped, keeps its count
+	void Reset(); // the recompiler discarded its blocks, keeps their counts
+
+	// Discards all the counts.
+	void Clear();
+
+	// Writes the blocks and functions (from the SymbolMap) that took the most cycles.
+	bool WriteReport(const std::string& filename, u32 crc, uint maxBlocks = 256);
+};
+
+extern EEBlockProfiler eeBlockProfiler;
@@ -22,6 +22,7 @@
 #include "R5900OpcodeTables.h"
 #include "iR5900.h"
 #include "BaseblockEx.h"
+#include "iR5900Profiler.h"
 #include "System/RecTypes.h"
 
 #include "vtlb.h"
@@ -76,6 +77,7 @@ static BASEBLOCK *recROM1 	     = NULL;	// also here
 static BASEBLOCK *recROM2 	     = NULL;    // also here
 
 static BaseBlocks recBlocks;
+static RecCodeGenerations recCodeGens("EE", recBlocks);
 static u8* recPtr 		     = NULL;
 static u32 *recConstBufPtr 	     = NULL;
 EEINST* s_pInstCache		     = NULL;
@@ -83,6 +85,9 @@ static u32 s_nInstCacheSize	     = 0;
 
 static BASEBLOCK* s_pCurBlock	     = NULL;
 static BASEBLOCKEX* s_pCurBlockEx    = NULL;
+static EEBlockProfiler::BlockProfile* s_pCurBlockProfile = NULL;
+static bool s_profileBlocks          = false; // blocks are compiled with a BlockProfile
+static u32 s_nBlockClearedCycles     = 0;     // scaled cycles added to cpuRegs.cycle within the current block
 u32 s_nEndBlock			     = 0; // what pc the current block ends
 u32 s_branchTo;
 static bool s_nBlockFF;
@@ -530,9 +535,13 @@ static void recResetRaw(void)
 	if( s_pInstCache )
 		memset( s_pInstCache, 0, sizeof(EEINST)*s_nInstCacheSize );
 
+	recCodeGens.Reset(*recMem, recMem->GetPtrEnd());
 	recBlocks.Reset();
 	mmap_ResetBlockTracking();
 
+	eeBlockProfiler.Reset();
+	s_profileBlocks = eeBlockProfiler.IsEnabled();
+
 	x86SetPtr(*recMem);
 
 	recPtr = *recMem;
@@ -691,6 +700,17 @@ static void doPlace0Patches(void)
     ApplyLoadedPatches(PPT_ONCE_ON_LOAD);
 }
 
+// The code of the block is about to be overwritten, it gets compiled again if it runs
+static void recEvictBlock(const BASEBLOCKEX& block)
+{
+	BASEBLOCK* pblock = PC_GETBLOCK(block.startpc);
+	if (pblock->GetFnptr() == block.fnptr)
+		pblock->SetFnptr((uptr)JITCompile);
+
+	if (s_profileBlocks)
+		eeBlockProfiler.Remove(block.fnptr);
+}
+
 static void __fastcall recRecompile( const u32 startpc )
 {
 	u32 i = 0;
@@ -699,13 +719,18 @@ static void __fastcall recRecompile( const u32 startpc )
 
 	pxAssert( startpc );
 
-	// if recPtr reached the mem limit reset whole mem
-	if (recPtr >= (recMem->GetPtrEnd() - _64kb))
+	// the constants are shared by all the blocks, only a reset frees them
+	if ((recConstBufPtr - recConstBuf) >= RECCONSTBUF_SIZE - 64)
 		eeRecNeedsReset = true;
-	else if ((recConstBufPtr - recConstBuf) >= RECCONSTBUF_SIZE - 64)
+	else if (eeBlockProfiler.IsEnabled() != s_profileBlocks)
 		eeRecNeedsReset = true;
 
 	if (eeRecNeedsReset) recResetRaw();
+	// if recPtr reached the end of its generation, make room in the oldest one
+	else if (recCodeGens.IsFull(recPtr))
+		recPtr = recCodeGens.Evict(recEvictBlock);
+
+	recCodeGens.BeginCompile();
 
 	xSetPtr( recPtr );
 	recPtr = xGetAlignedCallTarget();
@@ -722,6 +747,15 @@ static void __fastcall recRecompile( const u32 startpc )
 
 	pxAssert(s_pCurBlockEx);
 
+	if (s_profileBlocks)
+	{
+		// the block is entered at recPtr, registers aren't live yet
+		s_pCurBlockProfile = eeBlockProfiler.Add(HWADDR(startpc), (uptr)recPtr);
+		xLoadFarAddr(rax, &s_pCurBlockProfile->count);
+		xADD(ptr32[rax], 1);
+		xADC(ptr32[rax + 4], 0);
+	}
+
 	if (HWADDR(startpc) == EELOAD_START)
 	{
 		// The EELOAD _start function is the same across all BIOS versions
@@ -772,6 +806,7 @@ static void __fastcall recRecompile( const u32 startpc )
 
 	// reset recomp state variables
 	s_nBlockCycles   = 0;
+	s_nBlockClearedCycles = 0;
 	pc               = startpc;
 	g_cpuHasConstReg = g_cpuFlushedConstReg = 1;
 	pxAssert( g_cpuConstRegs[0].UD[0] == 0 );
@@ -1040,6 +1075,12 @@ StartRecomp:
 	pxAssert( (pc-startpc)>>2 <= 0xffff );
 	s_pCurBlockEx->size = (pc-startpc)>>2;
 
+	if (s_pCurBlockProfile)
+	{
+		s_pCurBlockProfile->size = s_pCurBlockEx->size;
+		s_pCurBlockProfile->cycles = s_nBlockClearedCycles + scaleblockcycles_calculation();
+	}
+
 	if (HWADDR(pc) <= Ps2MemSize::MainRam) {
 		BASEBLOCKEX *oldBlock;
 		int i = recBlocks.LastIndex(HWADDR(pc) - 4);
@@ -1124,6 +1165,21 @@ StartRecomp:
 
 	s_pCurBlock = NULL;
 	s_pCurBlockEx = NULL;
+	s_pCurBlockProfile = NULL;
+
+	recCodeGens.EndCompile();
+}
+
+// Removes the blocks [first, last], their profiles are folded into the totals
+static void recRemoveBlocks(int first, int last)
+{
+	if (s_profileBlocks)
+	{
+		for (int i = first; i <= last; i++)
+			eeBlockProfiler.Remove(recBlocks[i]->fnptr);
+	}
+
+	recBlocks.Remove(first, last);
 }
 
 // Size is in dwords (4 bytes)
@@ -1154,7 +1210,7 @@ static void recClear(u32 addr, u32 size)
 		if (pblock == s_pCurBlock)
 		{
 			if(toRemoveLast != blockidx)
-				recBlocks.Remove((blockidx + 1), toRemoveLast);
+				recRemoveBlocks((blockidx + 1), toRemoveLast);
 			toRemoveLast = --blockidx;
 			continue;
 		}
@@ -1174,7 +1230,7 @@ static void recClear(u32 addr, u32 size)
 	}
 
 	if(toRemoveLast != blockidx)
-		recBlocks.Remove((blockidx + 1), toRemoveLast);
+		recRemoveBlocks((blockidx + 1), toRemoveLast);
 
 	upperextent = std::min(upperextent, ceiling);
 
@@ -1464,6 +1520,7 @@ u32 scaleblockcycles_clear(void)
 	else
 		s_nBlockCycles &= 0x7;
 
+	s_nBlockClearedCycles += scaled;
 	return scaled;
 }
 
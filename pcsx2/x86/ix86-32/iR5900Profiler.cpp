@@ -0,0 +1,203 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PrecompiledHeader.h"
+#include "iR5900Profiler.h"
+#include "DebugTools/SymbolMap.h"
+
+#include <algorithm>
+#include <vector>
+
+EEBlockProfiler eeBlockProfiler;
+
+EEBlockProfiler::EEBlockProfiler()
+	: m_enabled(false)
+{
+}
+
+EEBlockProfiler::BlockProfile* EEBlockProfiler::Add(u32 startpc, uptr code)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	BlockProfile* block;
+	if (!m_free.empty())
+	{
+		block = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		m_blocks.emplace_back();
+		block = &m_blocks.back();
+	}
+
+	block->count = 0;
+	block->startpc = startpc;
+	block->size = 0;
+	block->cycles = 0;
+
+	BlockProfile*& live = m_live[code];
+	if (live)
+	{
+		// a block the recompiler dropped without telling, its code is overwritten anyway
+		Fold(*live, m_totals);
+		live->count = 0;
+		m_free.push_back(live);
+	}
+	live = block;
+
+	return block;
+}
+
+void EEBlockProfiler::Remove(uptr code)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	auto it = m_live.find(code);
+	if (it == m_live.end())
+		return;
+
+	// The block's code won't run again, so the profile can be given to another block
+	BlockProfile* block = it->second;
+	Fold(*block, m_totals);
+	block->count = 0;
+	m_free.push_back(block);
+	m_live.erase(it);
+}
+
+void EEBlockProfiler::Fold(const BlockProfile& block, std::unordered_map<u32, Totals>& totals) const
+{
+	if (block.count == 0)
+		return;
+
+	Totals& t = totals[block.startpc];
+	t.count += block.count;
+	t.cycles += block.count * block.cycles;
+	t.size = std::max(t.size, block.size);
+}
+
+void EEBlockProfiler::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	for (const auto& it : m_live)
+		Fold(*it.second, m_totals);
+	m_blocks.clear();
+	m_free.clear();
+	m_live.clear();
+}
+
+void EEBlockProfiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	// The recompiled code still points to the current blocks, they are only zeroed
+	for (BlockProfile& block : m_blocks)
+		block.count = 0;
+	m_totals.clear();
+}
+
+bool EEBlockProfiler::WriteReport(const std::string& filename, u32 crc, uint maxBlocks)
+{
+	struct Entry
+	{
+		u32 address;
+		u32 start; // of the function
+		std::string name;
+		Totals totals;
+	};
+
+	std::vector<Entry> blocks;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		std::unordered_map<u32, Totals> totals(m_totals);
+		for (const auto& it : m_live)
+			Fold(*it.second, totals);
+
+		blocks.reserve(totals.size());
+		for (const auto& it : totals)
+			blocks.push_back({it.first, 0, std::string(), it.second});
+	}
+
+	u64 count = 0, cycles = 0;
+	std::unordered_map<std::string, Entry> functions;
+	for (Entry& block : blocks)
+	{
+		count += block.totals.count;
+		cycles += block.totals.cycles;
+
+		block.name = symbolMap.GetNearestLabel(block.address, block.start);
+		if (block.name.empty())
+			continue;
+
+		Entry& function = functions[block.name];
+		function.address = block.start;
+		function.name = block.name;
+		function.totals.count += block.totals.count;
+		function.totals.cycles += block.totals.cycles;
+		function.totals.size++; // blocks
+	}
+
+	auto byCycles = [](const Entry& a, const Entry& b) {
+		return a.totals.cycles != b.totals.cycles ? a.totals.cycles > b.totals.cycles : a.address < b.address;
+	};
+	std::sort(blocks.begin(), blocks.end(), byCycles);
+
+	std::vector<Entry> sortedFunctions;
+	sortedFunctions.reserve(functions.size());
+	for (auto& it : functions)
+		sortedFunctions.push_back(std::move(it.second));
+	std::sort(sortedFunctions.begin(), sortedFunctions.end(), byCycles);
+
+	FILE* fp = fopen(filename.c_str(), "w");
+	if (!fp)
+		return false;
+
+	const double total = std::max<double>(cycles, 1);
+
+	fprintf(fp, "EE block profile, game CRC %08X\n", crc);
+	fprintf(fp, "%zu blocks, %llu executions, %llu cycles\n", blocks.size(), (unsigned long long)count, (unsigned long long)cycles);
+
+	if (!sortedFunctions.empty())
+	{
+		fprintf(fp, "\nFunctions\n");
+		fprintf(fp, "%7s %14s %14s %6s  %-8s  %s\n", "cycles%", "cycles", "executions", "blocks", "address", "name");
+		for (uint i = 0; i < sortedFunctions.size() && i < maxBlocks; i++)
+		{
+			const Entry& f = sortedFunctions[i];
+			fprintf(fp, "%6.2f%% %14llu %14llu %6u  %08x  %s\n", f.totals.cycles * 100.0 / total,
+				(unsigned long long)f.totals.cycles, (unsigned long long)f.totals.count, f.totals.size, f.address, f.name.c_str());
+		}
+	}
+
+	fprintf(fp, "\nBlocks\n");
+	fprintf(fp, "%7s %14s %14s %8s %5s  %-8s  %s\n", "cycles%", "cycles", "executions", "cyc/exec", "insts", "address", "function");
+	for (uint i = 0; i < blocks.size() && i < maxBlocks; i++)
+	{
+		const Entry& b = blocks[i];
+		fprintf(fp, "%6.2f%% %14llu %14llu %8llu %5u  %08x  ", b.totals.cycles * 100.0 / total,
+			(unsigned long long)b.totals.cycles, (unsigned long long)b.totals.count,
+			(unsigned long long)(b.totals.cycles / std::max<u64>(b.totals.count, 1)), b.totals.size, b.address);
+		if (b.name.empty())
+			fprintf(fp, "\n");
+		else if (b.address != b.start)
+			fprintf(fp, "%s+0x%x\n", b.name.c_str(), b.address - b.start);
+		else
+			fprintf(fp, "%s\n", b.name.c_str());
+	}
+
+	return fclose(fp) == 0;
+}
@@ -18,6 +18,8 @@
 #include "PrecompiledHeader.h"
 #include "microVU.h"
 
+#include <chrono>
+
 //------------------------------------------------------------------
 // Micro VU - Private Functions
 //------------------------------------------------------------------
@@ -47,6 +49,7 @@ static __ri void mVUdeleteProg(microVU& mVU, microProgram*& prog) {
 	for (u32 i = 0; i < (mVU.progSize / 2); i++)
 		safe_delete(prog->block[i]);
 	safe_delete(prog->ranges);
+	safe_delete(prog->entries);
 	safe_aligned_free(prog);
 }
 
@@ -72,30 +75,186 @@ static __fi bool mVUcmpProg(microVU& mVU, microProgram& prog, const bool cmpWhol
 	return true;
 }
 
+// Hashes the micro memory under the given (sorted) ranges
+static u64 mVUhashRanges(const void* data, const std::vector<microRange>& ranges)
+{
+	u64 h[4] = { 0, 1, 2, 3 };
+	for (const microRange& range : ranges) {
+		const u64* p   = (const u64*)((const u8*)data + range.start);
+		const u64* end = (const u64*)((const u8*)data + range.end);
+		for ( ; p + 4 <= end; p += 4) {
+			for (int i = 0; i < 4; i++)
+				h[i] = (h[i] ^ p[i]) * 0x9e3779b97f4a7c15ull;
+		}
+		for ( ; p < end; p++)
+			h[0] = (h[0] ^ *p) * 0x9e3779b97f4a7c15ull;
+		h[1] ^= range.start;
+	}
+	return h[0] ^ (h[1] >> 7) ^ (h[2] << 9) ^ (h[3] >> 13) ^ (h[3] << 19);
+}
+
+// Adds a program to the index of its list (see microProgramIndex)
+static void mVUindexProg(microProgramIndex& index, microProgram* prog)
+{
+	std::vector<microRange> ranges(prog->ranges->begin(), prog->ranges->end());
+	std::sort(ranges.begin(), ranges.end(), [](const microRange& a, const microRange& b) {
+		return a.start != b.start ? a.start < b.start : a.end < b.end;
+	});
+	u64 key = 0;
+	bool valid = !ranges.empty();
+	for (const microRange& range : ranges) {
+		valid = valid && range.start <= range.end;
+		key = (key ^ ((u64)(u32)range.start << 32 | (u32)range.end)) * 0x100000001b3ull;
+	}
+	if (!valid) {
+		index.unindexed.push_back(prog);
+		index.entries[prog] = { -1, 0 };
+		return;
+	}
+
+	auto sameRanges = [&](const microProgramIndex::Group& group) {
+		return group.ranges.size() == ranges.size()
+			&& std::equal(ranges.begin(), ranges.end(), group.ranges.begin(),
+				[](const microRange& a, const microRange& b) { return a.start == b.start && a.end == b.end; });
+	};
+
+	size_t group;
+	auto it = index.keys.find(key);
+	if (it != index.keys.end() && sameRanges(index.groups[it->second]))
+		group = it->second;
+	else if (it != index.keys.end() && index.groups[it->second].progs.empty()) {
+		// Nothing left in there, the group gets the new ranges of the key
+		group = it->second;
+		index.groups[group].ranges = ranges;
+	}
+	else {
+		// Ranges colliding with another group's key just don't get the quick group lookup
+		if (it == index.keys.end())
+			index.keys.emplace(key, index.groups.size());
+		group = index.groups.size();
+		index.groups.emplace_back();
+		index.groups.back().ranges = ranges;
+	}
+
+	u64 hash = mVUhashRanges(prog->data, index.groups[group].ranges);
+	index.groups[group].progs.emplace(hash, prog);
+	index.entries[prog] = { (s32)group, hash };
+}
+
+// Removes a program from the index of its list
+static void mVUunindexProg(microProgramIndex& index, microProgram* prog)
+{
+	auto it = index.entries.find(prog);
+	if (it == index.entries.end())
+		return;
+
+	if (it->second.group < 0)
+		index.unindexed.erase(std::find(index.unindexed.begin(), index.unindexed.end(), prog));
+	else {
+		std::unordered_multimap<u64, microProgram*>& progs = index.groups[it->second.group].progs;
+		auto range = progs.equal_range(it->second.hash);
+		for (auto p = range.first; p != range.second; ++p) {
+			if (p->second == prog) {
+				progs.erase(p);
+				break;
+			}
+		}
+	}
+	index.entries.erase(it);
+}
+
+// Brings the index of a list up to date, only the dirty programs are indexed again unless the
+// whole index was invalidated
+static void mVUindexProgs(microVU& mVU, microProgramIndex& index, microProgramList& list)
+{
+	if (index.valid) {
+		for (microProgram* prog : index.dirty) {
+			mVUunindexProg(index, prog);
+			mVUindexProg(index, prog);
+			mVU.prog.stats.reindexed++;
+		}
+		index.dirty.clear();
+		return;
+	}
+
+	index.groups.clear();
+	index.keys.clear();
+	index.entries.clear();
+	index.unindexed.clear();
+	index.dirty.clear();
+
+	for (microProgram* prog : list)
+		mVUindexProg(index, prog);
+
+	index.valid = true;
+	mVU.prog.stats.rebuilds++;
+}
+
+// Looks up a program matching mVU.regs().Micro in the list of programs starting at 'idx'
+static microProgram* mVUlookupProg(microVU& mVU, u32 idx)
+{
+	microProgramList&  list  = *mVU.prog.prog[idx];
+	microProgramIndex& index = *mVU.prog.index[idx];
+	microProgStats&    stats = mVU.prog.stats;
+
+	stats.searches++;
+	if (list.empty()) {
+		stats.misses++;
+		return nullptr;
+	}
+
+	// Usually the program that last ran from here is being run again
+	microProgram* last = list.front();
+	stats.compares++;
+	if (mVUcmpProg(mVU, *last, 0))
+		return last;
+
+	if (!index.valid || !index.dirty.empty())
+		mVUindexProgs(mVU, index, list);
+
+	for (const microProgramIndex::Group& group : index.groups) {
+		if (group.progs.empty()) continue;
+		auto range = group.progs.equal_range(mVUhashRanges(mVU.regs().Micro, group.ranges));
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == last) continue;
+			stats.compares++;
+			if (mVUcmpProg(mVU, *it->second, 0))
+				return it->second;
+		}
+	}
+	for (microProgram* prog : index.unindexed) {
+		if (prog == last) continue;
+		stats.compares++;
+		if (mVUcmpProg(mVU, *prog, 0))
+			return prog;
+	}
+
+	stats.misses++;
+	return nullptr;
+}
+
 // Searches for Cached Micro Program and sets prog.cur to it (returns entry-point to program)
-_mVUt __fi void* mVUsearchProg(u32 startPC, uptr pState)
+_mVUt static __fi void* mVUfindProg(u32 startPC, uptr pState)
 {
 	microVU& mVU = mVUx;
 	microProgramQuick& quick = mVU.prog.quick[mVU.regs().start_pc / 8];
 	microProgramList* list = mVU.prog.prog[mVU.regs().start_pc / 8];
 
 	if(!quick.prog) { // If null, we need to search for new program
-		std::deque<microProgram*>::iterator it(list->begin());
-		for ( ; it != list->end(); ++it) {
-			bool b = mVUcmpProg(mVU, *it[0], 0);
-			if (b) {
-				quick.block = it[0]->block[startPC/8];
-				quick.prog  = it[0];
-				list->erase(it);
-				list->push_front(quick.prog);
-				// Sanity check, in case for some reason the program compilation aborted half way through (JALR for example)
-				if (quick.block == nullptr)
-				{
-					void* entryPoint = mVUblockFetch(mVU, startPC, pState);
-					return entryPoint;
-				}
-				return mVUentryGet(mVU, quick.block, startPC, pState);
+		if (microProgram* prog = mVUlookupProg(mVU, mVU.regs().start_pc / 8)) {
+			quick.block = prog->block[startPC/8];
+			quick.prog  = prog;
+			if (list->front() != prog) {
+				list->erase(std::find(list->begin(), list->end(), prog));
+				list->push_front(prog);
+			}
+			// Sanity check, in case for some reason the program compilation aborted half way through (JALR for example)
+			if (quick.block == nullptr)
+			{
+				void* entryPoint = mVUblockFetch(mVU, startPC, pState);
+				return entryPoint;
 			}
+			return mVUentryGet(mVU, quick.block, startPC, pState);
 		}
 
 		// If cleared and program not found, make a new program instance
@@ -106,6 +265,7 @@ _mVUt __fi void* mVUsearchProg(u32 startPC, uptr pState)
 		quick.block			= mVU.prog.cur->block[startPC/8];
 		quick.prog			= mVU.prog.cur;
 		list->push_front(mVU.prog.cur);
+		mVU.prog.index[mVU.regs().start_pc / 8]->markDirty(mVU.prog.cur);
 		return entryPoint;
 	}
 
@@ -125,6 +285,82 @@ _mVUt __fi void* mVUsearchProg(u32 startPC, uptr pState)
 	return mVUentryGet(mVU, quick.block, startPC, pState);
 }
 
+// Recompiles the programs of the program cache, up to half of the rec-cache
+static void mVUcachePrewarm(microVU& mVU)
+{
+	microProgCache& cache = *mVU.progCache;
+	if (cache.progs.empty())
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	u8* limit = mVU.prog.x86start + (mVU.prog.x86end - mVU.prog.x86start) / 2;
+	std::vector<u8> micro(mVU.regs().Micro, mVU.regs().Micro + mVU.microMemSize);
+	microProgram* cur = mVU.prog.cur;
+	int isSame = mVU.prog.isSame;
+	int progs = 0, blocks = 0;
+
+	// The recompiler reads the instructions from mVU.regs().Micro (and the code may refer to
+	// them there), so each program's memory is put back in place while it is recompiled
+	for (auto it = cache.progs.rbegin(); it != cache.progs.rend() && xGetPtr() < limit; ++it) {
+		memcpy(mVU.regs().Micro, it->data.data(), mVU.microMemSize);
+		mVU.prog.cur	= mVUcreateProg(mVU, it->startPC);
+		mVU.prog.isSame = 1;
+		for (microCacheEntry& entry : it->entries) {
+			if (xGetPtr() >= limit) break;
+			mVUblockFetch(mVU, entry.startPC, (uptr)&entry.pState);
+			blocks++;
+		}
+		mVU.prog.cur->entries = new std::vector<microCacheEntry>(it->entries);
+		mVU.prog.prog[it->startPC]->push_back(mVU.prog.cur);
+		mVU.prog.index[it->startPC]->markDirty(mVU.prog.cur);
+		progs++;
+	}
+
+	memcpy(mVU.regs().Micro, micro.data(), mVU.microMemSize);
+	mVU.prog.cur	= cur;
+	mVU.prog.isSame = isSame;
+
+	log_cb(RETRO_LOG_INFO, "microVU%d: prewarmed %d programs (%d blocks) in %.1f ms\n",
+		mVU.index, progs, blocks, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Reports the program lookup counters (and starts them over)
+static void mVUlogStats(microVU& mVU)
+{
+	microProgStats& stats = mVU.prog.stats;
+	if (stats.searches)
+		log_cb(RETRO_LOG_INFO, "microVU%d: %llu program lookups, %.2f compares per lookup, %llu misses, %llu index rebuilds, %llu programs reindexed\n",
+			mVU.index, (unsigned long long)stats.searches, (double)stats.compares / stats.searches,
+			(unsigned long long)stats.misses, (unsigned long long)stats.rebuilds, (unsigned long long)stats.reindexed);
+	memzero(stats);
+}
+
+// Saves the program cache of the previous game and loads the one of the current game
+static void mVUcacheSwitch(microVU& mVU, u32 crc)
+{
+	mVUlogStats(mVU);
+	mVUcacheCollect(mVU);
+	mVUcacheSave(mVU);
+	if (mVUcacheLoad(mVU, crc))
+		mVUcachePrewarm(mVU);
+}
+
+// Searches for the program (see mVUfindProg), and keeps track of the entries that had to be
+// compiled for the program cache
+_mVUt __fi void* mVUsearchProg(u32 startPC, uptr pState)
+{
+	microVU& mVU = mVUx;
+	if (mVU.progCache->crc != ElfCRC)
+		mVUcacheSwitch(mVU, ElfCRC);
+
+	u8* x86ptr = xGetPtr();
+	void* entryPoint = mVUfindProg<vuIndex>(startPC, pState);
+	mVU.prog.cur->used = true;
+	if (xGetPtr() != x86ptr)
+		mVUcacheRecord(mVU, startPC, pState);
+	return entryPoint;
+}
+
 
 //------------------------------------------------------------------
 // Micro VU - Main Functions
@@ -174,6 +410,8 @@ void mVUinit(microVU& mVU, uint vuIndex) {
 	else mVU.dispCache = vu0_RecDispatchers;
 
 	mVU.regAlloc.reset(new microRegAlloc(mVU.index));
+	mVU.progCache.reset(new microProgCache());
+	mVU.progCache->crc = 0;
 }
 
 // Resets Rec Data
@@ -208,6 +446,9 @@ void mVUreset(microVU& mVU, bool resetReserve) {
 	mVU.prog.total		=  0;
 	mVU.prog.curFrame	=  0;
 
+	// Keep what the programs about to be deleted compiled for the program cache
+	mVUcacheCollect(mVU);
+
 	// Setup Dynarec Cache Limits for Each Program
 	u8* z = mVU.cache;
 	mVU.prog.x86start	= z;
@@ -216,9 +457,17 @@ void mVUreset(microVU& mVU, bool resetReserve) {
 
 	for(u32 i = 0; i < (mVU.progSize / 2); i++) {
 		if(!mVU.prog.prog[i]) {
-			mVU.prog.prog[i] = new std::deque<microProgram*>();
+			mVU.prog.prog[i]  = new std::deque<microProgram*>();
+			mVU.prog.index[i] = new microProgramIndex();
+			mVU.prog.index[i]->valid = false;
 			continue;
 		}
+		mVU.prog.index[i]->groups.clear();
+		mVU.prog.index[i]->keys.clear();
+		mVU.prog.index[i]->entries.clear();
+		mVU.prog.index[i]->unindexed.clear();
+		mVU.prog.index[i]->dirty.clear();
+		mVU.prog.index[i]->valid = false;
 		std::deque<microProgram*>::iterator it(mVU.prog.prog[i]->begin());
 		for ( ; it != mVU.prog.prog[i]->end(); ++it) {
 			mVUdeleteProg(mVU, it[0]);
@@ -236,6 +485,11 @@ void mVUclose(microVU& mVU) {
 
 	safe_delete  (mVU.cache_reserve);
 
+	mVUlogStats(mVU);
+	mVUcacheCollect(mVU);
+	mVUcacheSave(mVU);
+	mVU.progCache.reset();
+
 	// Delete Programs and Block Managers
 	for (u32 i = 0; i < (mVU.progSize / 2); i++) {
 		if (!mVU.prog.prog[i]) continue;
@@ -244,6 +498,7 @@ void mVUclose(microVU& mVU) {
 			mVUdeleteProg(mVU, it[0]);
 		}
 		safe_delete(mVU.prog.prog[i]);
+		safe_delete(mVU.prog.index[i]);
 	}
 }
 
@@ -20,6 +20,8 @@ using namespace x86Emitter;
 #include <deque>
 #include <algorithm>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 #include "Common.h"
 #include "VU.h"
 #include "MTVU.h"
@@ -113,17 +115,72 @@ struct microRange {
 	s32 end;   // End PC   (The opcode the block ends with)
 };
 
+struct microCacheEntry {
+	u32			 startPC; // PC the program was entered at
+	microRegInfo pState;  // Pipeline state it was entered with
+};
+
 #define mProgSize (0x4000/4)
 struct microProgram {
 	u32				   data [mProgSize];   // Holds a copy of the VU microProgram
 	microBlockManager* block[mProgSize/2]; // Array of Block Managers
 	std::deque<microRange>* ranges;			   // The ranges of the microProgram that have already been recompiled
+	std::vector<microCacheEntry>* entries;	   // Entries mVUsearchProg had to compile (saved to the program cache)
 	u32 startPC; // Start PC of this program
 	int idx;	 // Program index
+	bool used;	 // Run since it was created (prewarmed programs start out unused)
 };
 
 typedef std::deque<microProgram*> microProgramList;
 
+// The programs of a microProgramList grouped by their (sorted) ranges, and indexed in each group
+// by the hash of the micro memory under those ranges.  Looking a program up is then a hash of
+// the current micro memory per group, instead of a mVUcmpProg per program.
+//
+// Programs whose ranges or data change (and new ones) are only marked dirty, and indexed again
+// on their own by the next lookup, the whole list is only indexed after a reset.
+struct microProgramIndex {
+	struct Group {
+		std::vector<microRange> ranges;
+		std::unordered_multimap<u64, microProgram*> progs;
+	};
+	struct Entry {
+		s32 group; // -1 = unindexed
+		u64 hash;
+	};
+	std::vector<Group> groups;
+	std::unordered_map<u64, size_t> keys;			  // Group of each key of sorted ranges
+	std::unordered_map<microProgram*, Entry> entries; // Where each program is indexed
+	std::vector<microProgram*> unindexed;			  // Programs with a range that isn't finished
+	std::vector<microProgram*> dirty;				  // Programs to index again
+	bool valid;										  // Cleared when the whole list must be indexed again
+
+	void markDirty(microProgram* prog) {
+		if (valid && std::find(dirty.begin(), dirty.end(), prog) == dirty.end())
+			dirty.push_back(prog);
+	}
+};
+
+struct microProgStats {
+	u64 searches; // Programs looked up (the quick reference was cleared)
+	u64 compares; // mVUcmpProg calls made by those
+	u64 misses;	  // Lookups that had to create a new program
+	u64 rebuilds; // microProgramIndex rebuilds
+	u64 reindexed; // Programs indexed again on their own (marked dirty)
+};
+
+// A microProgram as kept by the program cache (see microVU_Cache.inl)
+struct microCacheProg {
+	u32 startPC;						 // microProgram::startPC
+	std::vector<u32> data;				 // Micro memory the program was compiled from
+	std::vector<microCacheEntry> entries; // Entries to recompile it with
+};
+
+struct microProgCache {
+	u32 crc;							 // Game the cache belongs to (0 = none)
+	std::vector<microCacheProg> progs;	 // Oldest first
+};
+
 struct microProgramQuick {
 	microBlockManager*    block; // Quick reference to valid microBlockManager for current startPC
 	microProgram*		  prog;	 // The microProgram who is the owner of 'block'
@@ -132,6 +189,7 @@ struct microProgramQuick {
 struct microProgManager {
 	microIR<mProgSize>	IRinfo;				// IR information
 	microProgramList*	prog [mProgSize/2];	// List of microPrograms indexed by startPC values
+	microProgramIndex*	index[mProgSize/2];	// Hash index of each of those lists
 	microProgramQuick	quick[mProgSize/2];	// Quick reference to valid microPrograms for current execution
 	microProgram*		cur;				// Pointer to currently running MicroProgram
 	int					total;				// Total Number of valid MicroPrograms
@@ -142,6 +200,7 @@ struct microProgManager {
 	u8*					x86start;			// Start of program's rec-cache
 	u8*					x86end;				// Limit of program's rec-cache
 	microRegInfo		lpState;			// Pipeline state from where program left off (useful for continuing execution)
+	microProgStats		stats;				// Program lookup counters
 };
 
 static const uint mVUdispCacheSize	= __pagesize; // Dispatcher Cache Size (in bytes)
@@ -166,6 +225,7 @@ struct microVU {
 
 	microProgManager		prog;		// Micro Program Data
 	std::unique_ptr<microRegAlloc>	regAlloc;	// Reg Alloc Class
+	std::unique_ptr<microProgCache>	progCache;	// Programs saved across sessions
 
 	RecompiledCodeReserve* cache_reserve;
 	u8*		cache;		  // Dynarec Cache Start (where we will start writing the recompiled code to)
@@ -229,5 +289,6 @@ typedef void (*mVUrecCallXG)(void);
 #include "microVU_Flags.inl"
 #include "microVU_Branch.inl"
 #include "microVU_Compile.inl"
+#include "microVU_Cache.inl"
 #include "microVU_Execute.inl"
 #include "microVU_Macro.inl"
@@ -0,0 +1,255 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Elfheader.h"
+#include "svnrev.h"
+#include <unordered_map>
+#include <zlib.h>
+
+//------------------------------------------------------------------
+// Persistent Program Cache
+//------------------------------------------------------------------
+
+// The recompiled code can't be saved as is, it embeds the addresses of the VU registers,
+// of the dispatchers and of other blocks.  What is saved instead is what the recompiler
+// was given: the micro memory of each program and the (startPC, pipeline state) pairs
+// mVUsearchProg had to compile for it.  Those programs are recompiled when the game boots
+// again (see mVUcachePrewarm), so mVUsearchProg finds them instead of compiling mid-frame.
+//
+// File: <save dir>/pcsx2/mvu<index>_<crc>.cache
+//   microCacheHeader
+//   per program: u32 startPC, u32 entry count, u32 packed size,
+//                u8[packed size] micro memory (zlib), microCacheEntry[entry count]
+//
+// The header holds the options the code depends on, a cache written with other clamp
+// or flag settings (or by another build) is thrown away.
+
+#define mVUcacheMagic	 0x4355564d // 'MVUC'
+#define mVUcacheVersion	 1
+static const uint mVUcacheMaxProgs = 512; // Programs kept per VU (oldest are dropped)
+
+struct microCacheHeader {
+	u32 magic;
+	u32 version;
+	u32 index;		// VU index
+	u32 crc;		// ElfCRC of the game
+	u32 recompiler; // EmuConfig.Cpu.Recompiler (clamp modes)
+	u32 gamefixes;	// EmuConfig.Gamefixes
+	u32 speedhacks; // EmuConfig.Speedhacks (flag hack)
+	u32 count;		// Number of programs
+	u64 build;		// Hash of GIT_REV
+};
+
+static u64 mVUcacheHash(const void* data, size_t size, u64 hash = 0xcbf29ce484222325ull)
+{
+	const u8* p = (const u8*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+static void mVUcacheSetHeader(microVU& mVU, microCacheHeader& header, u32 crc, u32 count)
+{
+	memzero(header);
+	header.magic	  = mVUcacheMagic;
+	header.version	  = mVUcacheVersion;
+	header.index	  = mVU.index;
+	header.crc		  = crc;
+	header.recompiler = EmuConfig.Cpu.Recompiler.bitset;
+	header.gamefixes  = EmuConfig.Gamefixes.bitset;
+	header.speedhacks = EmuConfig.Speedhacks.bitset;
+	header.count	  = count;
+	header.build	  = mVUcacheHash(GIT_REV, strlen(GIT_REV));
+}
+
+static std::string mVUcacheFile(microVU& mVU, u32 crc)
+{
+	const char* dir = NULL;
+
+	if (environ_cb == NULL || !environ_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &dir) || dir == NULL)
+		return {};
+
+	char name[32];
+	snprintf(name, sizeof(name), "/pcsx2/mvu%u_%08X.cache", mVU.index, crc);
+	return std::string(dir) + name;
+}
+
+// Called by mVUsearchProg when it had to compile an entry of the current program
+static void mVUcacheRecord(microVU& mVU, u32 startPC, uptr pState)
+{
+	if (!mVU.prog.cur->entries)
+		mVU.prog.cur->entries = new std::vector<microCacheEntry>();
+	microCacheEntry entry;
+	entry.startPC = startPC;
+	memcpy(&entry.pState, (void*)pState, sizeof(microRegInfo));
+	mVU.prog.cur->entries->push_back(entry);
+}
+
+// Merges the entries of the live programs into the cache (before they get deleted)
+static void mVUcacheCollect(microVU& mVU)
+{
+	microProgCache& cache = *mVU.progCache;
+	if (!cache.crc)
+		return;
+
+	const u32 words = mVU.microMemSize / 4;
+	std::unordered_multimap<u64, size_t> known;
+	std::vector<bool> touched(cache.progs.size(), false);
+	for (size_t i = 0; i < cache.progs.size(); i++) {
+		const microCacheProg& cp = cache.progs[i];
+		known.emplace(mVUcacheHash(cp.data.data(), mVU.microMemSize, cp.startPC), i);
+	}
+
+	for (u32 i = 0; i < (mVU.progSize / 2); i++) {
+		if (!mVU.prog.prog[i]) continue;
+		for (microProgram* prog : *mVU.prog.prog[i]) {
+			if (!prog->entries || prog->entries->empty()) continue;
+
+			const u64 hash = mVUcacheHash(prog->data, mVU.microMemSize, prog->startPC);
+			microCacheProg* cp = nullptr;
+			auto range = known.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it) {
+				microCacheProg& other = cache.progs[it->second];
+				if (other.startPC == prog->startPC && !memcmp(other.data.data(), prog->data, mVU.microMemSize)) {
+					cp = &other;
+					if (prog->used)
+						touched[it->second] = true;
+					break;
+				}
+			}
+			if (!cp) {
+				known.emplace(hash, cache.progs.size());
+				touched.push_back(prog->used);
+				cache.progs.emplace_back();
+				cp = &cache.progs.back();
+				cp->startPC = prog->startPC;
+				cp->data.assign(prog->data, prog->data + words);
+			}
+
+			for (const microCacheEntry& entry : *prog->entries) {
+				bool found = false;
+				for (const microCacheEntry& e : cp->entries) {
+					if (e.startPC == entry.startPC && !memcmp(&e.pState, &entry.pState, sizeof(microRegInfo))) {
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+					cp->entries.push_back(entry);
+			}
+		}
+	}
+
+	// Programs run this session go last, so the ones dropped are the least recently used.
+	// Prewarmed programs that never ran keep their place and age out like the others.
+	std::vector<microCacheProg> progs;
+	progs.reserve(cache.progs.size());
+	for (size_t i = 0; i < cache.progs.size(); i++)
+		if (!touched[i]) progs.push_back(std::move(cache.progs[i]));
+	for (size_t i = 0; i < cache.progs.size(); i++)
+		if (touched[i]) progs.push_back(std::move(cache.progs[i]));
+	if (progs.size() > mVUcacheMaxProgs)
+		progs.erase(progs.begin(), progs.begin() + (progs.size() - mVUcacheMaxProgs));
+	cache.progs = std::move(progs);
+}
+
+static bool mVUcacheSave(microVU& mVU)
+{
+	microProgCache& cache = *mVU.progCache;
+	if (!cache.crc || cache.progs.empty())
+		return false;
+
+	const std::string filename = mVUcacheFile(mVU, cache.crc);
+	if (filename.empty())
+		return false;
+
+	FILE* fp = fopen(filename.c_str(), "wb");
+	if (!fp)
+		return false;
+
+	microCacheHeader header;
+	mVUcacheSetHeader(mVU, header, cache.crc, cache.progs.size());
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+	std::vector<u8> packed(compressBound(mVU.microMemSize));
+	for (const microCacheProg& cp : cache.progs) {
+		uLongf size = packed.size();
+		ok = ok && compress2(packed.data(), &size, (const Bytef*)cp.data.data(), mVU.microMemSize, 1) == Z_OK;
+		const u32 rec[3] = { cp.startPC, (u32)cp.entries.size(), (u32)size };
+		ok = ok && fwrite(rec, sizeof(rec), 1, fp) == 1
+			&& fwrite(packed.data(), size, 1, fp) == 1
+			&& (cp.entries.empty() || fwrite(cp.entries.data(), sizeof(microCacheEntry), cp.entries.size(), fp) == cp.entries.size());
+		if (!ok) break;
+	}
+
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok)
+		remove(filename.c_str());
+	return ok;
+}
+
+// Replaces the cache with the one saved for 'crc' (the cache is left empty if there is none)
+static bool mVUcacheLoad(microVU& mVU, u32 crc)
+{
+	microProgCache& cache = *mVU.progCache;
+	cache.crc = crc;
+	cache.progs.clear();
+
+	const std::string filename = crc ? mVUcacheFile(mVU, crc) : std::string();
+	if (filename.empty())
+		return false;
+
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (!fp)
+		return false;
+
+	microCacheHeader header, expected;
+	mVUcacheSetHeader(mVU, expected, crc, 0);
+	bool valid = fread(&header, sizeof(header), 1, fp) == 1;
+	expected.count = header.count;
+	valid = valid && !memcmp(&header, &expected, sizeof(header)) && header.count <= mVUcacheMaxProgs;
+
+	std::vector<u8> packed(compressBound(mVU.microMemSize));
+	std::vector<microCacheProg> progs;
+	for (u32 i = 0; valid && i < header.count; i++) {
+		u32 rec[3];
+		valid = fread(rec, sizeof(rec), 1, fp) == 1
+			&& rec[0] < (mVU.progSize / 2) && rec[1] <= mVU.progSize && rec[2] <= packed.size()
+			&& fread(packed.data(), rec[2], 1, fp) == 1;
+		if (!valid) break;
+
+		microCacheProg cp;
+		cp.startPC = rec[0];
+		cp.data.resize(mVU.microMemSize / 4);
+		cp.entries.resize(rec[1]);
+		uLongf size = mVU.microMemSize;
+		valid = uncompress((Bytef*)cp.data.data(), &size, packed.data(), rec[2]) == Z_OK && size == mVU.microMemSize
+			&& (rec[1] == 0 || fread(cp.entries.data(), sizeof(microCacheEntry), rec[1], fp) == rec[1]);
+
+		for (const microCacheEntry& entry : cp.entries)
+			valid = valid && entry.startPC < mVU.microMemSize && !(entry.startPC & 7);
+		progs.push_back(std::move(cp));
+	}
+
+	fclose(fp);
+
+	if (!valid)
+		return false;
+
+	cache.progs = std::move(progs);
+	return true;
+}
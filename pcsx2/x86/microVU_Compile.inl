@@ -55,6 +55,7 @@ static void mVUsetupRange(microVU& mVU, s32 pc, bool isStartPC)
 		return;
 
 	mVUcheckIsSame(mVU);
+	mVU.prog.index[mVUcurProg.startPC]->markDirty(mVU.prog.cur);
 
 	if (isStartPC) {
 		microRange mRange = {pc, -1};
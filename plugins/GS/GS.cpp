@@ -21,7 +21,9 @@
 
 #include "GS.h"
 #include "GSUtil.h"
+#include "GSDump.h"
 #include "Renderers/SW/GSRendererSW.h"
+#include "Renderers/SW/GSDeviceSW.h"
 #include "Renderers/Null/GSRendererNull.h"
 #include "Renderers/Null/GSDeviceNull.h"
 #include "Renderers/OpenGL/GSDeviceOGL.h"
@@ -37,6 +39,8 @@
 static bool is_d3d                  = false;
 GSRenderer* s_gs                    = NULL;
 static u8* s_basemem                = NULL;
+static std::unique_ptr<GSDump> s_dump;
+static std::string s_dump_file;
 
 GSdxApp theApp;
 
@@ -103,8 +107,30 @@ EXPORT_C GSshutdown()
 	theApp.SetCurrentRendererType(GSRendererType::Undefined);
 }
 
+static void GSstartRecording()
+{
+	GSFreezeData fd = {0, nullptr};
+	s_gs->Freeze(&fd, true);
+
+	std::vector<u8> state(fd.size);
+	fd.data = state.data();
+	s_gs->Freeze(&fd, false);
+
+	s_dump.reset(new GSDump(s_dump_file, s_gs->m_crc, fd, (const GSPrivRegSet*)s_basemem));
+	if (!s_dump->IsOpen())
+	{
+		log_cb(RETRO_LOG_ERROR, "GS: can't create trace file %s\n", s_dump_file.c_str());
+		s_dump.reset();
+	}
+
+	s_dump_file.clear();
+}
+
 EXPORT_C GSclose()
 {
+	s_dump.reset();
+	s_dump_file.clear();
+
 	if(s_gs == NULL) return;
 
 	s_gs->ResetDevice();
@@ -172,6 +198,9 @@ static int _GSopen(GSRendererType renderer, int threads)
 		case GSRendererType::OGL_SW:
 			dev = new GSDeviceOGL();
 			break;
+		case GSRendererType::SW:
+			dev = new GSDeviceSW();
+			break;
 		case GSRendererType::Null:
 			dev = new GSDeviceNull();
 			break;
@@ -197,6 +226,7 @@ static int _GSopen(GSRendererType renderer, int threads)
 				s_gs = (GSRenderer*)new GSRendererOGL();
 				break;
 			case GSRendererType::OGL_SW:
+			case GSRendererType::SW:
 				if(threads == -1)
 					threads = theApp.GetConfigI("extrathreads");
 				s_gs = new GSRendererSW(threads);
@@ -217,6 +247,9 @@ static int _GSopen(GSRendererType renderer, int threads)
 		return -1;
 	}
 
+	if (!s_dump_file.empty())
+		GSstartRecording();
+
 	return 0;
 }
 
@@ -237,7 +270,10 @@ EXPORT_C_(int) GSopen2(u32 flags)
 			theApp.SetCurrentRendererType(GSRendererType::DX1011_HW);
 			break;
 		case RETRO_HW_CONTEXT_NONE:
-			theApp.SetCurrentRendererType(GSRendererType::Null);
+			if (! std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software (Headless)"))
+				theApp.SetCurrentRendererType(GSRendererType::SW);
+			else
+				theApp.SetCurrentRendererType(GSRendererType::Null);
 			break;
 		default:
 			if (! std::strcmp(option_value(STRING_PCSX2_OPT_RENDERER, KeyOptionString::return_type), "Software"))
@@ -265,6 +301,9 @@ EXPORT_C_(int) GSopen2(u32 flags)
 			case GSRendererType::OGL_HW:
 				current_renderer = GSRendererType::OGL_SW;
 				break;
+			case GSRendererType::SW:
+				// no gpu context to switch to
+				break;
 			default:
 				current_renderer = GSRendererType::OGL_SW;
 				break;
@@ -277,47 +316,76 @@ EXPORT_C_(int) GSopen2(u32 flags)
 
 EXPORT_C GSreset()
 {
+	if (s_dump)
+		s_dump->Reset();
+
 	s_gs->Reset();
 }
 
 EXPORT_C GSgifSoftReset(u32 mask)
 {
+	if (s_dump)
+		s_dump->SoftReset(mask);
+
 	s_gs->SoftReset(mask);
 }
 
 EXPORT_C GSreadFIFO2(u8* mem, u32 size)
 {
+	if (s_dump)
+		s_dump->ReadFIFO2(size);
+
 	s_gs->ReadFIFO(mem, size);
 }
 
 EXPORT_C GSinitReadFIFO2(u8* mem, u32 size)
 {
 	if (size > 0)
+	{
+		if (s_dump)
+			s_dump->InitReadFIFO2(size);
+
 		s_gs->InitReadFIFO(mem, size);
+	}
 }
 
 EXPORT_C GSgifTransfer(const u8* mem, u32 size)
 {
+	if (s_dump)
+		s_dump->Transfer(3, mem, size * 16);
+
 	s_gs->Transfer<3>(mem, size);
 }
 
 EXPORT_C GSgifTransfer1(u8* mem, u32 addr)
 {
+	if (s_dump)
+		s_dump->Transfer(0, mem + addr, 0x4000 - addr);
+
 	s_gs->Transfer<0>(const_cast<u8*>(mem) + addr, (0x4000 - addr) / 16);
 }
 
 EXPORT_C GSgifTransfer2(u8* mem, u32 size)
 {
+	if (s_dump)
+		s_dump->Transfer(1, mem, size * 16);
+
 	s_gs->Transfer<1>(const_cast<u8*>(mem), size);
 }
 
 EXPORT_C GSgifTransfer3(u8* mem, u32 size)
 {
+	if (s_dump)
+		s_dump->Transfer(2, mem, size * 16);
+
 	s_gs->Transfer<2>(const_cast<u8*>(mem), size);
 }
 
 EXPORT_C GSvsync(int field)
 {
+	if (s_dump)
+		s_dump->VSync(field, (const GSPrivRegSet*)s_basemem);
+
    s_gs->VSync(field);
 }
 
@@ -330,6 +398,12 @@ EXPORT_C_(int) GSfreeze(int mode, GSFreezeData* data)
 		case FREEZE_SIZE:
 			return s_gs->Freeze(data, true);
 		case FREEZE_LOAD:
+			if (s_dump)
+			{
+				// the trace can't follow the state jumping around
+				log_cb(RETRO_LOG_WARN, "GS: state loaded, trace recording stopped\n");
+				s_dump.reset();
+			}
 			return s_gs->Defrost(data);
 	}
 
@@ -338,9 +412,23 @@ EXPORT_C_(int) GSfreeze(int mode, GSFreezeData* data)
 
 EXPORT_C GSsetGameCRC(u32 crc, int options)
 {
+	if (s_dump)
+		s_dump->GameCRC(crc);
+
 	s_gs->SetGameCRC(crc, options);
 }
 
+// Starts recording a GS trace to 'filename' (see GSDump.h), or stops the current one
+// when 'filename' is null.  If the GS isn't open yet, recording starts when it is.
+EXPORT_C GSsetupRecording(const char* filename)
+{
+	s_dump.reset();
+	s_dump_file = filename ? filename : "";
+
+	if (s_gs && s_gs->m_dev && !s_dump_file.empty())
+		GSstartRecording();
+}
+
 std::string format(const char* fmt, ...)
 {
 	int size;
@@ -140,6 +140,7 @@ enum class GSRendererType : int8_t
 	Null = 11,
 	OGL_HW,
 	OGL_SW,
+	SW, // GSRendererSW without any gpu context (GSDeviceSW)
 
 #ifdef _WIN32
 	Default = Undefined
@@ -0,0 +1,235 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GSDump.h"
+
+GSDump::GSDump(const std::string& filename, u32 crc, const GSFreezeData& fd, const GSPrivRegSet* regs)
+{
+	m_fp = fopen(filename.c_str(), "wb");
+	if (!m_fp)
+		return;
+
+	// Transfers come in small pieces, keep them from hitting the disk one by one
+	setvbuf(m_fp, nullptr, _IOFBF, 1 << 20);
+
+	GSDumpHeader header;
+	header.magic = GSDUMP_MAGIC;
+	header.version = GSDUMP_VERSION;
+	header.crc = crc;
+	header.state_size = fd.size;
+
+	Write(&header, sizeof(header));
+	Write(fd.data, fd.size);
+	Write(regs, sizeof(m_regs));
+
+	memcpy(&m_regs, regs, sizeof(m_regs));
+}
+
+GSDump::~GSDump()
+{
+	if (m_fp)
+		fclose(m_fp);
+}
+
+void GSDump::Write(const void* data, size_t size)
+{
+	if (m_fp && fwrite(data, 1, size, m_fp) != size)
+	{
+		// Disk full or similar, a truncated trace is still replayable up to here
+		fclose(m_fp);
+		m_fp = nullptr;
+	}
+}
+
+void GSDump::WritePacket(GSDumpPacketType type)
+{
+	Write(&type, sizeof(type));
+}
+
+void GSDump::Transfer(int index, const u8* mem, size_t size)
+{
+	if (size == 0)
+		return;
+
+	const u8 path = index;
+	const u32 bytes = size;
+
+	WritePacket(GSDumpPacketType::Transfer);
+	Write(&path, sizeof(path));
+	Write(&bytes, sizeof(bytes));
+	Write(mem, bytes);
+}
+
+void GSDump::VSync(int field, const GSPrivRegSet* regs)
+{
+	if (memcmp(&m_regs, regs, sizeof(m_regs)) != 0)
+	{
+		memcpy(&m_regs, regs, sizeof(m_regs));
+
+		WritePacket(GSDumpPacketType::Registers);
+		Write(&m_regs, sizeof(m_regs));
+	}
+
+	const u8 f = field;
+
+	WritePacket(GSDumpPacketType::VSync);
+	Write(&f, sizeof(f));
+}
+
+void GSDump::ReadFIFO2(u32 size)
+{
+	WritePacket(GSDumpPacketType::ReadFIFO2);
+	Write(&size, sizeof(size));
+}
+
+void GSDump::InitReadFIFO2(u32 size)
+{
+	WritePacket(GSDumpPacketType::InitReadFIFO2);
+	Write(&size, sizeof(size));
+}
+
+void GSDump::SoftReset(u32 mask)
+{
+	WritePacket(GSDumpPacketType::SoftReset);
+	Write(&mask, sizeof(mask));
+}
+
+void GSDump::GameCRC(u32 crc)
+{
+	WritePacket(GSDumpPacketType::GameCRC);
+	Write(&crc, sizeof(crc));
+}
+
+void GSDump::Reset()
+{
+	WritePacket(GSDumpPacketType::Reset);
+}
+
+//
+
+bool GSDumpFile::Load(const std::string& filename, std::string& error)
+{
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (!fp)
+	{
+		error = "can't open " + filename;
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	const long file_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	m_data.resize(std::max(file_size, 0L));
+	const bool read = fread(m_data.data(), 1, m_data.size(), fp) == m_data.size();
+	fclose(fp);
+
+	if (!read || m_data.size() < sizeof(Header))
+	{
+		error = "can't read " + filename;
+		return false;
+	}
+
+	memcpy(&Header, m_data.data(), sizeof(Header));
+
+	if (Header.magic != GSDUMP_MAGIC || Header.version != GSDUMP_VERSION)
+	{
+		error = filename + " is not a GS trace (or an unsupported version)";
+		return false;
+	}
+
+	m_regs_offset = sizeof(Header) + Header.state_size;
+
+	const size_t end = m_data.size();
+	size_t pos = m_regs_offset + sizeof(GSPrivRegSet);
+
+	if (pos > end)
+	{
+		error = filename + " is truncated";
+		return false;
+	}
+
+	Packets.clear();
+
+	// A trace whose recording got cut short ends in a partial packet, just drop it
+	while (pos < end)
+	{
+		Packet p = {};
+		p.type = (GSDumpPacketType)m_data[pos++];
+
+		size_t param_size = 0;
+		switch (p.type)
+		{
+			case GSDumpPacketType::Transfer:
+				param_size = sizeof(u8) + sizeof(u32);
+				break;
+			case GSDumpPacketType::VSync:
+				param_size = sizeof(u8);
+				break;
+			case GSDumpPacketType::ReadFIFO2:
+			case GSDumpPacketType::InitReadFIFO2:
+			case GSDumpPacketType::SoftReset:
+			case GSDumpPacketType::GameCRC:
+				param_size = sizeof(u32);
+				break;
+			case GSDumpPacketType::Registers:
+			case GSDumpPacketType::Reset:
+				break;
+			default:
+				error = format("unknown packet type %d at offset %zu", (int)p.type, pos - 1);
+				return false;
+		}
+
+		if (end - pos < param_size)
+			break;
+
+		switch (p.type)
+		{
+			case GSDumpPacketType::Transfer:
+				p.param = m_data[pos];
+				memcpy(&p.size, &m_data[pos + 1], sizeof(u32));
+				// path 1 is sent from the end of the 16K of VU1 memory
+				if (p.param > 3 || (p.param == 0 && p.size > 0x4000))
+				{
+					error = format("bad transfer packet (path %d, %u bytes) at offset %zu", p.param, p.size, pos - 1);
+					return false;
+				}
+				break;
+			case GSDumpPacketType::VSync:
+				p.param = m_data[pos];
+				break;
+			case GSDumpPacketType::Registers:
+				p.size = sizeof(GSPrivRegSet);
+				break;
+			default:
+				memcpy(&p.size, &m_data[pos], sizeof(u32));
+				break;
+		}
+
+		pos += param_size;
+		p.offset = pos;
+
+		if (p.type == GSDumpPacketType::Transfer || p.type == GSDumpPacketType::Registers)
+		{
+			if (end - pos < p.size)
+				break;
+			pos += p.size;
+		}
+
+		Packets.push_back(p);
+	}
+
+	return true;
+}
@@ -0,0 +1,118 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "GS.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * GS packet trace
+ *
+ * Header:
+ *   u32 magic ('GSTR'), u32 version, u32 crc, u32 state size
+ *   u8[state size]        GSState::Freeze snapshot taken when recording started
+ *   u8[0x2000]            privileged registers (GSPrivRegSet) at the same point
+ *
+ * Followed by packets until the end of the file, each starting with a u8 GSDumpPacketType:
+ *   Transfer        u8 path (0..3, see GSgifTransfer*), u32 size in bytes, u8[size] data
+ *   VSync           u8 field
+ *   ReadFIFO2       u32 size in qwords
+ *   InitReadFIFO2   u32 size in qwords
+ *   Registers       u8[0x2000] privileged registers
+ *   SoftReset       u32 mask
+ *   GameCRC         u32 crc
+ *   Reset
+ *
+ * Registers packets are only written before a VSync when the registers changed, which is
+ * when the GS looks at them.
+ */
+
+enum class GSDumpPacketType : u8
+{
+	Transfer,
+	VSync,
+	ReadFIFO2,
+	InitReadFIFO2,
+	Registers,
+	SoftReset,
+	GameCRC,
+	Reset,
+};
+
+#define GSDUMP_MAGIC   0x52545347 // 'GSTR'
+#define GSDUMP_VERSION 1
+
+struct GSDumpHeader
+{
+	u32 magic;
+	u32 version;
+	u32 crc;
+	u32 state_size;
+};
+
+// Records the calls made to the GS plugin to a trace file.
+class GSDump
+{
+	FILE* m_fp;
+	GSPrivRegSet m_regs; // last registers written to the trace
+
+	void Write(const void* data, size_t size);
+	void WritePacket(GSDumpPacketType type);
+
+public:
+	GSDump(const std::string& filename, u32 crc, const GSFreezeData& fd, const GSPrivRegSet* regs);
+	virtual ~GSDump();
+
+	bool IsOpen() const { return m_fp != nullptr; }
+
+	void Transfer(int index, const u8* mem, size_t size);
+	void VSync(int field, const GSPrivRegSet* regs);
+	void ReadFIFO2(u32 size);
+	void InitReadFIFO2(u32 size);
+	void SoftReset(u32 mask);
+	void GameCRC(u32 crc);
+	void Reset();
+};
+
+// A trace loaded in memory, split into packets for replaying.
+class GSDumpFile
+{
+public:
+	struct Packet
+	{
+		GSDumpPacketType type;
+		u8 param;   // Transfer: path, VSync: field
+		u32 size;   // Transfer: bytes, ReadFIFO2/InitReadFIFO2: qwords, SoftReset: mask, GameCRC: crc
+		size_t offset; // Transfer/Registers: data offset in m_data
+	};
+
+protected:
+	std::vector<u8> m_data; // whole file
+	size_t m_regs_offset;
+
+public:
+	GSDumpHeader Header;
+	std::vector<Packet> Packets;
+
+	// Returns false and leaves the error in 'error' if the file isn't a valid trace.
+	bool Load(const std::string& filename, std::string& error);
+
+	const u8* GetState() const { return &m_data[sizeof(GSDumpHeader)]; }
+	const u8* GetData(const Packet& packet) const { return &m_data[packet.offset]; }
+	const u8* GetRegs() const { return &m_data[m_regs_offset]; }
+};
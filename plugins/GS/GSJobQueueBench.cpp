@@ -0,0 +1,185 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the worker wakeup of GSJobQueue (see GSEventCount): the time from Push to the
+// job starting on the worker thread, with the producer pushing at a few different rates,
+// and the cost per item of pushing back to back into a small queue.  The last pass checks
+// that no wakeup gets lost when producer and worker hand items over one at a time.
+
+#include "GSThread_CXX11.h"
+
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static u64 Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct BenchItem
+{
+	u64 pushed;
+	u32 index;
+};
+
+static void Usage()
+{
+	fprintf(stderr,
+		"Usage: GSJobQueueBench [options]\n"
+		"  --items N     items per pass (default 20000)\n"
+		"  --delay N,... pause in us between pushes of the latency passes (default 0,50,500)\n");
+}
+
+// Pushes 'count' items 'delay_us' apart and prints the push to start latency.
+static void Latency(u32 count, u32 delay_us)
+{
+	std::vector<u64> latency(count);
+
+	{
+		GSJobQueue<BenchItem, 256> queue([&](BenchItem& item) {
+			latency[item.index] = Now() - item.pushed;
+		});
+
+		for (u32 i = 0; i < count; i++)
+		{
+			if (delay_us)
+			{
+				// Sleeping lets the worker go idle, which is the wakeup being measured.
+				std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+			}
+			else
+			{
+				// Back to back the worker may still be busy, so only time the items pushed
+				// into an empty queue.
+				queue.Wait();
+			}
+
+			queue.Push({Now(), i});
+		}
+
+		queue.Wait();
+	}
+
+	std::sort(latency.begin(), latency.end());
+
+	printf("delay %4uus: push to start median %7.2fus, p90 %7.2fus, p99 %7.2fus, max %8.2fus\n",
+		delay_us,
+		latency[count / 2] / 1000.0,
+		latency[count * 90 / 100] / 1000.0,
+		latency[count * 99 / 100] / 1000.0,
+		latency[count - 1] / 1000.0);
+}
+
+// Pushes 'count' items without pausing into a queue of 16, which keeps filling up.
+static void Throughput(u32 count)
+{
+	std::atomic<u32> done(0);
+
+	const u64 start = Now();
+
+	{
+		GSJobQueue<BenchItem, 16> queue([&](BenchItem& item) {
+			done.fetch_add(1, std::memory_order_relaxed);
+		});
+
+		for (u32 i = 0; i < count; i++)
+			queue.Push({0, i});
+
+		queue.Wait();
+	}
+
+	const u64 time = Now() - start;
+
+	printf("back to back: %.1fns per item, %u/%u done\n", (double)time / count, done.load(), count);
+}
+
+// The worker pushes the reply to a second queue, the producer waits for it before sending
+// the next item.  A lost wakeup hangs here.
+static bool PingPong(u32 count)
+{
+	std::atomic<u32> received(0);
+
+	GSJobQueue<BenchItem, 16> pong([&](BenchItem& item) {
+		received.store(item.index + 1, std::memory_order_release);
+	});
+
+	GSJobQueue<BenchItem, 16> ping([&](BenchItem& item) {
+		pong.Push(item);
+	});
+
+	const u64 start = Now();
+
+	for (u32 i = 0; i < count; i++)
+	{
+		ping.Push({0, i});
+		ping.Wait();
+		pong.Wait();
+
+		if (received.load(std::memory_order_acquire) != i + 1)
+		{
+			printf("ping-pong: item %u lost\n", i);
+			return false;
+		}
+	}
+
+	printf("ping-pong: %u round trips, %.2fus each\n", count, (Now() - start) / 1000.0 / count);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	u32 items = 20000;
+	std::vector<u32> delays = {0, 50, 500};
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "--items" && has_value)
+		{
+			items = std::max(100, atoi(argv[++i]));
+		}
+		else if (arg == "--delay" && has_value)
+		{
+			delays.clear();
+			for (const char* p = argv[++i]; *p; p++)
+			{
+				delays.push_back(std::max(0, atoi(p)));
+				while (*p && *p != ',')
+					p++;
+				if (!*p)
+					break;
+			}
+		}
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+	for (u32 delay : delays)
+		Latency(delay >= 500 ? std::min(items, 2000u) : items, delay);
+
+	Throughput(items * 50);
+
+	return PingPong(items) ? 0 : 1;
+}
@@ -91,6 +91,7 @@ GSLocalMemory::GSLocalMemory()
 	m_use_fifo_alloc = theApp.GetConfigB("wrap_gs_mem");
 	switch (theApp.GetCurrentRendererType()) {
 		case GSRendererType::OGL_SW:
+		case GSRendererType::SW:
 			m_use_fifo_alloc = true;
 			break;
 		default:
@@ -1323,6 +1324,22 @@ void GSLocalMemory::WriteImage24Z(int& tx, int& ty, const u8* src, int len, GIFR
 	}
 }
 
+#if _M_SSE >= 0x301
+
+// The 8 pixels of a 32-bit column row (p points to the first one) get the low 8 bytes of c
+// in their top byte, only the bits of mask change (8H, 4HL and 4HH)
+
+static __forceinline void WriteColumn8H(u32* RESTRICT p, const GSVector4i& c, const GSVector4i& mask)
+{
+	GSVector4i c0 = c.shuffle8(GSVector4i(-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3));
+	GSVector4i c1 = c.shuffle8(GSVector4i(-1, -1, -1, 4, -1, -1, -1, 5, -1, -1, -1, 6, -1, -1, -1, 7));
+
+	GSVector4i::store(&p[0], &p[4], GSVector4i::load(&p[0], &p[4]).blend(c0, mask));
+	GSVector4i::store(&p[8], &p[12], GSVector4i::load(&p[8], &p[12]).blend(c1, mask));
+}
+
+#endif
+
 void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFRegBITBLTBUF& BITBLTBUF, GIFRegTRXPOS& TRXPOS, GIFRegTRXREG& TRXREG)
 {
 	if(len <= 0) return;
@@ -1352,6 +1369,21 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x++, pd++)
+			{
+				WritePixel32(addr + offset[x], *pd);
+			}
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 8 && x <= ex8; len -= 8, x += 8, pd += 8)
+			{
+				u32* RESTRICT p = &m_vm32[addr + offset[x]];
+
+				GSVector4i::store(&p[0], &p[4], GSVector4i::load<false>(&pd[0]));
+				GSVector4i::store(&p[8], &p[12], GSVector4i::load<false>(&pd[4]));
+			}
+
 			for(; len > 0 && x < ex; len--, x++, pd++)
 			{
 				WritePixel32(addr + offset[x], *pd);
@@ -1372,6 +1404,28 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x++, pb += 3)
+			{
+				WritePixel24(addr + offset[x], *(u32*)pb);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 8 && x <= ex8; len -= 8, x += 8, pb += 24)
+			{
+				u32* RESTRICT p = &m_vm32[addr + offset[x]];
+
+				GSVector4i c0 = GSVector4i::load<false>(&pb[0]).shuffle8(GSVector4i(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+				GSVector4i c1 = GSVector4i::load(&pb[8], &pb[16]).shuffle8(GSVector4i(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1));
+
+				GSVector4i::store(&p[0], &p[4], GSVector4i::load(&p[0], &p[4]).blend(c0, GSVector4i::x00ffffff()));
+				GSVector4i::store(&p[8], &p[12], GSVector4i::load(&p[8], &p[12]).blend(c1, GSVector4i::x00ffffff()));
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x++, pb += 3)
 			{
 				WritePixel24(addr + offset[x], *(u32*)pb);
@@ -1394,6 +1448,24 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 15); len--, x++, pw++)
+			{
+				WritePixel16(addr + offset[x], *pw);
+			}
+
+			// aligned to a column, pixels x and x + 8 are next to each other
+
+			for(int ex16 = ex - 16; len >= 16 && x <= ex16; len -= 16, x += 16, pw += 16)
+			{
+				u16* RESTRICT p = &m_vm16[addr + offset[x]];
+
+				GSVector4i c0 = GSVector4i::load<false>(&pw[0]);
+				GSVector4i c1 = GSVector4i::load<false>(&pw[8]);
+
+				GSVector4i::store(&p[0], &p[8], c0.upl16(c1));
+				GSVector4i::store(&p[16], &p[24], c0.uph16(c1));
+			}
+
 			for(; len > 0 && x < ex; len--, x++, pw++)
 			{
 				WritePixel16(addr + offset[x], *pw);
@@ -1446,6 +1518,22 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x++, pb++)
+			{
+				WritePixel8H(addr + offset[x], *pb);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 8 && x <= ex8; len -= 8, x += 8, pb += 8)
+			{
+				WriteColumn8H(&m_vm32[addr + offset[x]], GSVector4i::loadl(pb), GSVector4i::xff000000());
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x++, pb++)
 			{
 				WritePixel8H(addr + offset[x], *pb);
@@ -1463,6 +1551,25 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x += 2, pb++)
+			{
+				WritePixel4HL(addr + offset[x + 0], *pb & 0xf);
+				WritePixel4HL(addr + offset[x + 1], *pb >> 4);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 4 && x <= ex8; len -= 4, x += 8, pb += 4)
+			{
+				GSVector4i c = GSVector4i::load(*(int*)pb);
+
+				WriteColumn8H(&m_vm32[addr + offset[x]], c.upl8(c.srl16(4)), GSVector4i::xf0000000().srl32(4));
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x += 2, pb++)
 			{
 				WritePixel4HL(addr + offset[x + 0], *pb & 0xf);
@@ -1481,6 +1588,25 @@ void GSLocalMemory::WriteImageX(int& tx, int& ty, const u8* src, int len, GIFReg
 			u32 addr = psm->pa(0, y, bp, bw);
 			int* offset = psm->rowOffset[y & 7];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x += 2, pb++)
+			{
+				WritePixel4HH(addr + offset[x + 0], *pb & 0xf);
+				WritePixel4HH(addr + offset[x + 1], *pb >> 4);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 4 && x <= ex8; len -= 4, x += 8, pb += 4)
+			{
+				GSVector4i c = GSVector4i::load(*(int*)pb);
+
+				WriteColumn8H(&m_vm32[addr + offset[x]], c.upl8(c.srl16(4)).sll16(4), GSVector4i::xf0000000());
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x += 2, pb++)
 			{
 				WritePixel4HH(addr + offset[x + 0], *pb & 0xf);
@@ -1567,6 +1693,34 @@ void GSLocalMemory::ReadImageX(int& tx, int& ty, u8* dst, int len, GIFRegBITBLTB
 			int* RESTRICT offset = psm->rowOffset[y & 7];
 			u32* RESTRICT ps = &m_vm32[psm->pa(0, y, bp, bw)];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x++, pb += 3)
+			{
+				u32 c = ps[offset[x]];
+
+				pb[0] = (u8)(c);
+				pb[1] = (u8)(c >> 8);
+				pb[2] = (u8)(c >> 16);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 8 && x <= ex8; len -= 8, x += 8, pb += 24)
+			{
+				int off = offset[x];
+
+				GSVector4i mask(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+				GSVector4i c0 = GSVector4i::load(&ps[off + 0], &ps[off + 4]).shuffle8(mask);
+				GSVector4i c1 = GSVector4i::load(&ps[off + 8], &ps[off + 12]).shuffle8(mask);
+
+				GSVector4i::store<false>(&pb[0], c0 | c1.sll<12>());
+				GSVector4i::storel(&pb[16], c1.srl<4>());
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x++, pb += 3)
 			{
 				u32 c = ps[offset[x]];
@@ -1593,6 +1747,30 @@ void GSLocalMemory::ReadImageX(int& tx, int& ty, u8* dst, int len, GIFRegBITBLTB
 			int* RESTRICT offset = psm->rowOffset[y & 7];
 			u16* RESTRICT ps = &m_vm16[psm->pa(0, y, bp, bw)];
 
+			#if _M_SSE >= 0x301
+
+			for(; len > 0 && x < ex && (x & 15); len--, x++, pw++)
+			{
+				*pw = ps[offset[x]];
+			}
+
+			// aligned to a column, pixels x and x + 8 are next to each other
+
+			for(int ex16 = ex - 16; len >= 16 && x <= ex16; len -= 16, x += 16, pw += 16)
+			{
+				int off = offset[x];
+
+				GSVector4i mask(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+				GSVector4i c0 = GSVector4i::load(&ps[off + 0], &ps[off + 8]).shuffle8(mask);
+				GSVector4i c1 = GSVector4i::load(&ps[off + 16], &ps[off + 24]).shuffle8(mask);
+
+				GSVector4i::store<false>(&pw[0], c0.upl64(c1));
+				GSVector4i::store<false>(&pw[8], c0.uph64(c1));
+			}
+
+			#endif
+
 			for(int ex4 = ex - 4; len >= 4 && x <= ex4; len -= 4, x += 4, pw += 4)
 			{
 				pw[0] = ps[offset[x + 0]];
@@ -1660,12 +1838,21 @@ void GSLocalMemory::ReadImageX(int& tx, int& ty, u8* dst, int len, GIFRegBITBLTB
 			int* RESTRICT offset = psm->rowOffset[y & 7];
 			u32* RESTRICT ps = &m_vm32[psm->pa(0, y, bp, bw)];
 
-			for(int ex4 = ex - 4; len >= 4 && x <= ex4; len -= 4, x += 4, pb += 4)
+			for(; len > 0 && x < ex && (x & 7); len--, x++, pb++)
+			{
+				*pb = (u8)(ps[offset[x]] >> 24);
+			}
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 8 && x <= ex8; len -= 8, x += 8, pb += 8)
 			{
-				pb[0] = (u8)(ps[offset[x + 0]] >> 24);
-				pb[1] = (u8)(ps[offset[x + 1]] >> 24);
-				pb[2] = (u8)(ps[offset[x + 2]] >> 24);
-				pb[3] = (u8)(ps[offset[x + 3]] >> 24);
+				int off = offset[x];
+
+				GSVector4i c0 = GSVector4i::load(&ps[off + 0], &ps[off + 4]).srl32(24);
+				GSVector4i c1 = GSVector4i::load(&ps[off + 8], &ps[off + 12]).srl32(24);
+
+				GSVector4i::storel(pb, c0.ps32(c1).pu16());
 			}
 
 			for(; len > 0 && x < ex; len--, x++, pb++)
@@ -1685,6 +1872,33 @@ void GSLocalMemory::ReadImageX(int& tx, int& ty, u8* dst, int len, GIFRegBITBLTB
 			int* offset = psm->rowOffset[y & 7];
 			u32* RESTRICT ps = &m_vm32[psm->pa(0, y, bp, bw)];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x += 2, pb++)
+			{
+				u32 c0 = (ps[offset[x + 0]] >> 24) & 0x0f;
+				u32 c1 = (ps[offset[x + 1]] >> 20) & 0xf0;
+
+				*pb = (u8)(c0 | c1);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 4 && x <= ex8; len -= 4, x += 8, pb += 4)
+			{
+				int off = offset[x];
+
+				GSVector4i c0 = GSVector4i::load(&ps[off + 0], &ps[off + 4]).sll32(4).srl32(28);
+				GSVector4i c1 = GSVector4i::load(&ps[off + 8], &ps[off + 12]).sll32(4).srl32(28);
+
+				c0 = c0.ps32(c1);
+				c0 = c0 | c0.srl32(12);
+
+				*(u32*)pb = GSVector4i::store(c0.shuffle8(GSVector4i(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x += 2, pb++)
 			{
 				u32 c0 = (ps[offset[x + 0]] >> 24) & 0x0f;
@@ -1705,6 +1919,33 @@ void GSLocalMemory::ReadImageX(int& tx, int& ty, u8* dst, int len, GIFRegBITBLTB
 			int* RESTRICT offset = psm->rowOffset[y & 7];
 			u32* RESTRICT ps = &m_vm32[psm->pa(0, y, bp, bw)];
 
+			for(; len > 0 && x < ex && (x & 7); len--, x += 2, pb++)
+			{
+				u32 c0 = (ps[offset[x + 0]] >> 28) & 0x0f;
+				u32 c1 = (ps[offset[x + 1]] >> 24) & 0xf0;
+
+				*pb = (u8)(c0 | c1);
+			}
+
+			#if _M_SSE >= 0x301
+
+			// aligned to a column
+
+			for(int ex8 = ex - 8; len >= 4 && x <= ex8; len -= 4, x += 8, pb += 4)
+			{
+				int off = offset[x];
+
+				GSVector4i c0 = GSVector4i::load(&ps[off + 0], &ps[off + 4]).srl32(28);
+				GSVector4i c1 = GSVector4i::load(&ps[off + 8], &ps[off + 12]).srl32(28);
+
+				c0 = c0.ps32(c1);
+				c0 = c0 | c0.srl32(12);
+
+				*(u32*)pb = GSVector4i::store(c0.shuffle8(GSVector4i(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+			}
+
+			#endif
+
 			for(; len > 0 && x < ex; len--, x += 2, pb++)
 			{
 				u32 c0 = (ps[offset[x + 0]] >> 28) & 0x0f;
@@ -0,0 +1,320 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks GSLocalMemory::WriteImageX/ReadImageX against the per pixel writePixel/readPixel
+// path for every transfer format: random rectangles at unaligned positions, sent in random
+// chunks like the GIF does, must leave local memory and the read back data bit for bit the
+// same.  Then times a 632x448 upload and download of each format.
+
+#include "GS.h"
+#include "GSLocalMemory.h"
+
+#include <chrono>
+#include <random>
+#include <libretro_core_options.h>
+
+// Exported by GS.cpp
+EXPORT_C_(int) GSinit();
+
+// --------------------------------------------------------------------------------------
+//  Frontend stubs
+// --------------------------------------------------------------------------------------
+// As in GSReplay, every option takes its default value.
+
+retro_environment_t environ_cb;
+retro_video_refresh_t video_cb;
+retro_log_printf_t log_cb;
+retro_hw_render_callback hw_render;
+
+int option_upscale_mult = 1;
+bool option_palette_conversion = false;
+bool hack_fb_conversion = false;
+bool hack_AutoFlush = false;
+bool hack_fast_invalidation = false;
+
+static bool bench_environment(unsigned cmd, void* data)
+{
+	if (cmd != RETRO_ENVIRONMENT_GET_VARIABLE)
+		return false;
+
+	retro_variable* var = (retro_variable*)data;
+	for (const retro_core_option_v2_definition& def : option_defs_us)
+	{
+		if (def.key && !strcmp(var->key, def.key))
+		{
+			var->value = def.default_value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void bench_video_refresh(const void* data, unsigned width, unsigned height, size_t pitch)
+{
+}
+
+static void bench_log(enum retro_log_level level, const char* fmt, ...)
+{
+	if (level < RETRO_LOG_WARN)
+		return;
+
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+// --------------------------------------------------------------------------------------
+//  Transfers
+// --------------------------------------------------------------------------------------
+
+static const u32 s_psms[] =
+{
+	PSM_PSMCT32, PSM_PSMCT24, PSM_PSMCT16, PSM_PSMCT16S,
+	PSM_PSMZ32, PSM_PSMZ24, PSM_PSMZ16, PSM_PSMZ16S,
+	PSM_PSMT8, PSM_PSMT4, PSM_PSMT8H, PSM_PSMT4HL, PSM_PSMT4HH,
+};
+
+// Pixel i of a packed transfer buffer
+static u32 GetPixel(const u8* buff, int i, int bpp)
+{
+	switch (bpp)
+	{
+		case 32: return ((const u32*)buff)[i];
+		case 24: return buff[i * 3] | (buff[i * 3 + 1] << 8) | (buff[i * 3 + 2] << 16);
+		case 16: return ((const u16*)buff)[i];
+		case 8: return buff[i];
+		default: return (buff[i >> 1] >> ((i & 1) * 4)) & 0xf;
+	}
+}
+
+static void SetPixel(u8* buff, int i, int bpp, u32 c)
+{
+	switch (bpp)
+	{
+		case 32: ((u32*)buff)[i] = c; break;
+		case 24: buff[i * 3] = c; buff[i * 3 + 1] = c >> 8; buff[i * 3 + 2] = c >> 16; break;
+		case 16: ((u16*)buff)[i] = c; break;
+		case 8: buff[i] = c; break;
+		default: buff[i >> 1] = (buff[i >> 1] & ~(0xf << ((i & 1) * 4))) | ((c & 0xf) << ((i & 1) * 4)); break;
+	}
+}
+
+struct Transfer
+{
+	GIFRegBITBLTBUF BITBLTBUF;
+	GIFRegTRXPOS TRXPOS;
+	GIFRegTRXREG TRXREG;
+
+	Transfer(u32 psm, u32 bp, u32 bw, int sx, int w, int h)
+	{
+		BITBLTBUF.U64 = 0;
+		BITBLTBUF.SBP = BITBLTBUF.DBP = bp;
+		BITBLTBUF.SBW = BITBLTBUF.DBW = bw;
+		BITBLTBUF.SPSM = BITBLTBUF.DPSM = psm;
+		TRXPOS.U64 = 0;
+		TRXPOS.SSAX = TRXPOS.DSAX = sx;
+		TRXREG.U64 = 0;
+		TRXREG.RRW = w;
+		TRXREG.RRH = h;
+	}
+};
+
+// Size of the next chunk of a transfer: a whole number of pixels, sometimes all that's left
+static int NextChunk(std::mt19937& rng, int bpp, int left)
+{
+	const int unit = bpp == 24 ? 3 : bpp == 4 ? 1 : bpp / 8;
+	const int len = rng() % 4 == 0 ? left : unit * (1 + rng() % 200);
+	return std::min(len, left);
+}
+
+// Returns the number of mismatching transfers
+static int Compare(GSLocalMemory* mem, GSLocalMemory* ref, u32 psm, int count, std::mt19937& rng)
+{
+	const GSLocalMemory::psm_t& fmt = GSLocalMemory::m_psm[psm];
+	const int bpp = fmt.trbpp;
+
+	std::vector<u8> src(64 * 1024), out(src.size() + 64), expected(src.size() + 64);
+	int fails = 0;
+
+	for (int t = 0; t < count; t++)
+	{
+		for (u32 i = 0; i < GSLocalMemory::m_vmsize; i += 4)
+			*(u32*)&mem->m_vm8[i] = rng();
+		memcpy(ref->m_vm8, mem->m_vm8, GSLocalMemory::m_vmsize);
+
+		const u32 bw = 1 + rng() % 10;
+		const u32 bp = rng() % 0x2000;
+		int sx = rng() % 64;
+		const int sy = rng() % 64;
+		int w = 1 + rng() % 150;
+		const int h = 1 + rng() % 20;
+
+		// 4 bit transfers are made of whole bytes
+		if (bpp == 4)
+			sx &= ~1;
+		w = std::min<int>(w, bw * 64 - sx);
+		if (bpp == 4)
+			w &= ~1;
+		if (w <= 0)
+			continue;
+
+		const int n = w * h;
+		const int bytes = n * bpp / 8;
+		for (int i = 0; i < bytes; i++)
+			src[i] = rng();
+
+		Transfer trx(psm, bp, bw, sx, w, h);
+
+		int tx = sx, ty = sy;
+		for (int off = 0; off < bytes;)
+		{
+			const int len = NextChunk(rng, bpp, bytes - off);
+			mem->WriteImageX(tx, ty, &src[off], len, trx.BITBLTBUF, trx.TRXPOS, trx.TRXREG);
+			off += len;
+		}
+
+		for (int i = 0; i < n; i++)
+			(ref->*fmt.wp)(sx + i % w, sy + i / w, GetPixel(src.data(), i, bpp), bp, bw);
+
+		if (memcmp(mem->m_vm8, ref->m_vm8, GSLocalMemory::m_vmsize) != 0 && fails++ < 10)
+			printf("write mismatch: psm %02x bp %x bw %u x %d y %d w %d h %d\n", psm, bp, bw, sx, sy, w, h);
+
+		// The bytes past the end must be left alone
+		memset(out.data(), 0xcd, bytes + 64);
+		memset(expected.data(), 0xcd, bytes + 64);
+
+		tx = sx;
+		ty = sy;
+		for (int off = 0; off < bytes;)
+		{
+			const int len = NextChunk(rng, bpp, bytes - off);
+			mem->ReadImageX(tx, ty, &out[off], len, trx.BITBLTBUF, trx.TRXPOS, trx.TRXREG);
+			off += len;
+		}
+
+		for (int i = 0; i < n; i++)
+			SetPixel(expected.data(), i, bpp, (ref->*fmt.rp)(sx + i % w, sy + i / w, bp, bw));
+
+		if (memcmp(out.data(), expected.data(), bytes + 64) != 0 && fails++ < 10)
+			printf("read mismatch: psm %02x bp %x bw %u x %d y %d w %d h %d\n", psm, bp, bw, sx, sy, w, h);
+	}
+
+	return fails;
+}
+
+// Best of 'loops' times of a whole 632x448 transfer each way, in microseconds
+static void Time(GSLocalMemory* mem, u32 psm, int loops, double& write, double& read)
+{
+	const int bpp = GSLocalMemory::m_psm[psm].trbpp;
+	const int w = 632, h = 448;
+	const int bytes = w * h * bpp / 8;
+
+	std::vector<u8> buff(bytes);
+	for (int i = 0; i < bytes; i++)
+		buff[i] = (u8)(i * 7);
+
+	// Unaligned on purpose, the row ends aren't whole blocks
+	Transfer trx(psm, 0, 10, 8, w, h);
+
+	write = read = 1e30;
+
+	for (int i = 0; i < loops; i++)
+	{
+		int tx = 8, ty = 0;
+
+		const auto t0 = std::chrono::steady_clock::now();
+		mem->WriteImageX(tx, ty, buff.data(), bytes, trx.BITBLTBUF, trx.TRXPOS, trx.TRXREG);
+		const auto t1 = std::chrono::steady_clock::now();
+
+		tx = 8;
+		ty = 0;
+		mem->ReadImageX(tx, ty, buff.data(), bytes, trx.BITBLTBUF, trx.TRXPOS, trx.TRXREG);
+		const auto t2 = std::chrono::steady_clock::now();
+
+		write = std::min(write, std::chrono::duration<double, std::micro>(t1 - t0).count());
+		read = std::min(read, std::chrono::duration<double, std::micro>(t2 - t1).count());
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"Usage: GSLocalMemoryBench [options]\n"
+		"  --count N  random transfers compared per format (default 400)\n"
+		"  --loops N  timed transfers per format, 0 skips the timing (default 200)\n"
+		"  --seed N   random seed (default 1234)\n");
+}
+
+int main(int argc, char** argv)
+{
+	environ_cb = bench_environment;
+	video_cb = bench_video_refresh;
+	log_cb = bench_log;
+	hw_render.context_type = RETRO_HW_CONTEXT_NONE;
+
+	if (GSinit() != 0)
+	{
+		fprintf(stderr, "GSLocalMemoryBench: GSinit failed\n");
+		return 1;
+	}
+
+	int count = 400;
+	int loops = 200;
+	u32 seed = 1234;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "--count" && has_value)
+			count = std::max(0, atoi(argv[++i]));
+		else if (arg == "--loops" && has_value)
+			loops = std::max(0, atoi(argv[++i]));
+		else if (arg == "--seed" && has_value)
+			seed = strtoul(argv[++i], NULL, 0);
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	std::unique_ptr<GSLocalMemory> mem(new GSLocalMemory());
+	std::unique_ptr<GSLocalMemory> ref(new GSLocalMemory());
+	std::mt19937 rng(seed);
+
+	int fails = 0;
+
+	for (u32 psm : s_psms)
+	{
+		const int n = Compare(mem.get(), ref.get(), psm, count, rng);
+
+		if (loops > 0)
+		{
+			double write, read;
+			Time(mem.get(), psm, loops, write, read);
+			printf("psm %02x: %d/%d mismatches, 632x448 write %8.1fus read %8.1fus\n", psm, n, count, write, read);
+		}
+		else
+			printf("psm %02x: %d/%d mismatches\n", psm, n, count);
+
+		fails += n;
+	}
+
+	return fails ? 1 : 0;
+}
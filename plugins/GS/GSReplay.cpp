@@ -0,0 +1,358 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Standalone GS replayer: loads a trace recorded with GSsetupRecording (see GSDump.h) and
+// drives GSRendererSW (through the headless GSDeviceSW) or GSRendererNull from it, with
+// frame time statistics.  Nothing is displayed, so it runs without any GPU or frontend and
+// gives a reproducible CPU-only benchmark of the GS emulation.
+
+#include "GS.h"
+#include "GSDump.h"
+
+#include <algorithm>
+#include <chrono>
+#include <libretro_core_options.h>
+
+// Exported by GS.cpp
+EXPORT_C_(int) GSinit();
+EXPORT_C GSshutdown();
+EXPORT_C GSclose();
+EXPORT_C_(int) GSopen2(u32 flags);
+EXPORT_C GSsetBaseMem(u8* mem);
+EXPORT_C GSreset();
+EXPORT_C GSgifSoftReset(u32 mask);
+EXPORT_C GSreadFIFO2(u8* mem, u32 size);
+EXPORT_C GSinitReadFIFO2(u8* mem, u32 size);
+EXPORT_C GSgifTransfer(const u8* mem, u32 size);
+EXPORT_C GSgifTransfer1(u8* mem, u32 addr);
+EXPORT_C GSgifTransfer2(u8* mem, u32 size);
+EXPORT_C GSgifTransfer3(u8* mem, u32 size);
+EXPORT_C GSvsync(int field);
+EXPORT_C_(int) GSfreeze(int mode, GSFreezeData* data);
+EXPORT_C GSsetGameCRC(u32 crc, int options);
+
+// --------------------------------------------------------------------------------------
+//  Frontend stubs
+// --------------------------------------------------------------------------------------
+// The GS plugin is built for the libretro core, these stand in for what the core would
+// provide.  Options take their default value, except for the renderer.
+
+retro_environment_t environ_cb;
+retro_video_refresh_t video_cb;
+retro_log_printf_t log_cb;
+retro_hw_render_callback hw_render;
+
+int option_upscale_mult = 1;
+bool option_palette_conversion = false;
+bool hack_fb_conversion = false;
+bool hack_AutoFlush = false;
+bool hack_fast_invalidation = false;
+
+static const char* s_renderer = "Software (Headless)";
+static u64 s_presented = 0;
+static u64 s_hash = 0; // of every presented frame, to tell whether the output changed
+
+static bool replay_environment(unsigned cmd, void* data)
+{
+	if (cmd != RETRO_ENVIRONMENT_GET_VARIABLE)
+		return false;
+
+	retro_variable* var = (retro_variable*)data;
+	if (!strcmp(var->key, STRING_PCSX2_OPT_RENDERER))
+	{
+		var->value = s_renderer;
+		return true;
+	}
+
+	for (const retro_core_option_v2_definition& def : option_defs_us)
+	{
+		if (def.key && !strcmp(var->key, def.key))
+		{
+			var->value = def.default_value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void replay_video_refresh(const void* data, unsigned width, unsigned height, size_t pitch)
+{
+	s_presented++;
+
+	if (!data)
+		return;
+
+	// FNV-1a over the visible pixels
+	for (unsigned y = 0; y < height; y++)
+	{
+		const u32* row = (const u32*)((const u8*)data + y * pitch);
+		for (unsigned x = 0; x < width; x++)
+			s_hash = (s_hash ^ (row[x] & 0xffffff)) * 0x100000001b3ull;
+	}
+}
+
+static void replay_log(enum retro_log_level level, const char* fmt, ...)
+{
+	if (level < RETRO_LOG_WARN)
+		return;
+
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+// --------------------------------------------------------------------------------------
+//  Replay
+// --------------------------------------------------------------------------------------
+
+static void Usage()
+{
+	fprintf(stderr,
+		"Usage: GSReplay [options] <trace>\n"
+		"  --renderer sw|null  renderer to replay with (default sw)\n"
+		"  --threads N[,N...]  extra rasterizer threads for sw (default %d), a list replays\n"
+		"                      the trace with each count and prints the scaling\n"
+		"  --loops N           number of times the trace is replayed (default 1)\n"
+		"  --warmup N          frames left out of the statistics (default 0)\n",
+		theApp.GetConfigI("extrathreads"));
+}
+
+// Replays the trace once, appending the time spent on each frame (from one vsync to the
+// next) to 'frames'.
+static void Replay(const GSDumpFile& dump, u8* regs, std::vector<double>& frames)
+{
+	alignas(32) static u8 path1[0x4000];
+	std::vector<u8> state(dump.GetState(), dump.GetState() + dump.Header.state_size);
+	std::vector<u8> fifo;
+
+	memcpy(regs, dump.GetRegs(), sizeof(GSPrivRegSet));
+
+	GSFreezeData fd = {(int)state.size(), state.data()};
+	if (GSfreeze(FREEZE_LOAD, &fd) != 0)
+	{
+		fprintf(stderr, "GSReplay: the trace state doesn't load\n");
+		return;
+	}
+	GSsetGameCRC(dump.Header.crc, 0);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (const GSDumpFile::Packet& p : dump.Packets)
+	{
+		switch (p.type)
+		{
+			case GSDumpPacketType::Transfer:
+			{
+				const u8* data = dump.GetData(p);
+				const u32 qwc = p.size / 16;
+				switch (p.param)
+				{
+					case 0:
+						// path 1 data sits at the end of the VU1 memory, GSDumpFile::Load
+						// rejects anything larger
+						memcpy(path1 + sizeof(path1) - p.size, data, p.size);
+						GSgifTransfer1(path1, sizeof(path1) - p.size);
+						break;
+					case 1:
+						GSgifTransfer2(const_cast<u8*>(data), qwc);
+						break;
+					case 2:
+						GSgifTransfer3(const_cast<u8*>(data), qwc);
+						break;
+					case 3:
+						GSgifTransfer(data, qwc);
+						break;
+				}
+				break;
+			}
+			case GSDumpPacketType::VSync:
+			{
+				GSvsync(p.param);
+
+				const auto now = std::chrono::steady_clock::now();
+				frames.push_back(std::chrono::duration<double, std::milli>(now - start).count());
+				start = now;
+				break;
+			}
+			case GSDumpPacketType::ReadFIFO2:
+				fifo.resize(std::max<size_t>(fifo.size(), (size_t)p.size * 16));
+				GSreadFIFO2(fifo.data(), p.size);
+				break;
+			case GSDumpPacketType::InitReadFIFO2:
+				fifo.resize(std::max<size_t>(fifo.size(), (size_t)p.size * 16));
+				GSinitReadFIFO2(fifo.data(), p.size);
+				break;
+			case GSDumpPacketType::Registers:
+				memcpy(regs, dump.GetData(p), sizeof(GSPrivRegSet));
+				break;
+			case GSDumpPacketType::SoftReset:
+				GSgifSoftReset(p.size);
+				break;
+			case GSDumpPacketType::GameCRC:
+				GSsetGameCRC(p.size, 0);
+				break;
+			case GSDumpPacketType::Reset:
+				GSreset();
+				break;
+		}
+	}
+}
+
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char** argv)
+{
+	environ_cb = replay_environment;
+	video_cb = replay_video_refresh;
+	log_cb = replay_log;
+	hw_render.context_type = RETRO_HW_CONTEXT_NONE;
+
+	if (GSinit() != 0)
+	{
+		fprintf(stderr, "GSReplay: GSinit failed\n");
+		return 1;
+	}
+
+	const char* trace = nullptr;
+	std::vector<int> threads;
+	int loops = 1;
+	size_t warmup = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "--renderer" && has_value)
+		{
+			const std::string renderer = argv[++i];
+			if (renderer == "sw")
+				s_renderer = "Software (Headless)";
+			else if (renderer == "null")
+				s_renderer = "Null";
+			else
+			{
+				Usage();
+				return 1;
+			}
+		}
+		else if (arg == "--threads" && has_value)
+		{
+			for (const char* p = argv[++i]; *p; p++)
+			{
+				threads.push_back(std::max(0, atoi(p)));
+				while (p[1] && *p != ',')
+					p++;
+			}
+		}
+		else if (arg == "--loops" && has_value)
+			loops = std::max(1, atoi(argv[++i]));
+		else if (arg == "--warmup" && has_value)
+			warmup = std::max(0, atoi(argv[++i]));
+		else if (arg[0] != '-' && !trace)
+			trace = argv[i];
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (!trace)
+	{
+		Usage();
+		return 1;
+	}
+
+	GSDumpFile dump;
+	std::string error;
+	if (!dump.Load(trace, error))
+	{
+		fprintf(stderr, "GSReplay: %s\n", error.c_str());
+		return 1;
+	}
+
+	if (threads.empty())
+		threads.push_back(theApp.GetConfigI("extrathreads"));
+
+	printf("trace      %s (crc %08X, %zu packets)\n", trace, dump.Header.crc, dump.Packets.size());
+	printf("renderer   %s\n", s_renderer);
+
+	alignas(32) static u8 regs[sizeof(GSPrivRegSet)];
+	std::vector<double> fps;
+
+	for (int count : threads)
+	{
+		// a new renderer for each thread count
+		theApp.SetConfig("extrathreads", count);
+
+		memcpy(regs, dump.GetRegs(), sizeof(regs));
+		GSsetBaseMem(regs);
+
+		if (GSopen2(0) != 0)
+		{
+			fprintf(stderr, "GSReplay: can't open the GS\n");
+			return 1;
+		}
+
+		s_presented = 0;
+		s_hash = 0xcbf29ce484222325ull;
+
+		std::vector<double> frames;
+		for (int i = 0; i < loops; i++)
+			Replay(dump, regs, frames);
+
+		GSclose();
+		GSshutdown();
+
+		if (frames.size() <= warmup)
+		{
+			fprintf(stderr, "GSReplay: no frame to report (%zu frames, %zu warmup)\n", frames.size(), warmup);
+			return 1;
+		}
+
+		frames.erase(frames.begin(), frames.begin() + warmup);
+
+		double total = 0;
+		for (double ms : frames)
+			total += ms;
+
+		std::vector<double> sorted(frames);
+		std::sort(sorted.begin(), sorted.end());
+
+		fps.push_back(frames.size() * 1000 / total);
+
+		printf("\nthreads    %d\n", count);
+		printf("frames     %zu (%llu presented, hash %016llx)\n", frames.size(), (unsigned long long)s_presented, (unsigned long long)s_hash);
+		printf("total      %.3f s, %.2f fps\n", total / 1000, fps.back());
+		printf("frame time mean %.3f ms, min %.3f, median %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+			total / frames.size(), sorted.front(), Percentile(sorted, 0.5),
+			Percentile(sorted, 0.95), Percentile(sorted, 0.99), sorted.back());
+	}
+
+	if (threads.size() > 1)
+	{
+		printf("\nthreads        fps  speedup\n");
+		for (size_t i = 0; i < threads.size(); i++)
+			printf("%7d %10.2f %7.2fx\n", threads[i], fps[i], fps[i] / fps[0]);
+	}
+
+	return 0;
+}
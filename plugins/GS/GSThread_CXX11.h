@@ -22,6 +22,8 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
+#include <algorithm>
 #include <functional>
 #include <condition_variable>
 #include <mutex>
@@ -29,42 +31,126 @@
 #include "GS.h"
 #include "Utilities/boost_spsc_queue.hpp"
 
+// Eventcount: lets a thread sleep until some condition, which other threads change without
+// any lock, becomes true.  The waiter spins for a while first, then registers itself and
+// checks the condition once more before going to sleep.  Notify costs a single atomic
+// operation unless a thread is actually sleeping, only then are the mutex and the condition
+// variable involved.
+//
+// Registering and notifying are both read-modify-writes of m_waiters, so either the notifier
+// sees the waiter, or the waiter sees everything done before the notification.
+//
+// The spin adapts to how long the condition usually took to become true, see Await.
+class GSEventCount final
+{
+	static const int MaxSpin = 4096; // pauses
+
+	std::atomic<u32> m_epoch;
+	std::atomic<u32> m_waiters;
+	std::atomic<int> m_spin;
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+
+public:
+	GSEventCount()
+		: m_epoch(0)
+		, m_waiters(0)
+		, m_spin(64)
+	{
+	}
+
+	// After changing the condition
+	void NotifyAll()
+	{
+		if (m_waiters.fetch_add(0, std::memory_order_acq_rel) != 0) {
+			{
+				std::lock_guard<std::mutex> l(m_lock);
+				m_epoch.fetch_add(1, std::memory_order_relaxed);
+			}
+			m_cv.notify_all();
+		}
+	}
+
+	// Returns once pred (called from this thread only) returns true
+	template<class Pred> void Await(Pred pred)
+	{
+		if (pred())
+			return;
+
+		// glibc's adaptive mutex way: spin up to twice the average, which moves an eighth
+		// of the way to what this time took
+
+		// no point with a single cpu, the thread we wait for could not run meanwhile
+
+		static const bool smp = std::thread::hardware_concurrency() > 1;
+
+		const int spin = m_spin.load(std::memory_order_relaxed);
+		const int max = smp ? std::min(spin * 2 + 16, MaxSpin) : 0;
+
+		for (int i = 1; i <= max; i++) {
+			_mm_pause();
+
+			if (pred()) {
+				m_spin.store(spin + (i - spin) / 8, std::memory_order_relaxed);
+				return;
+			}
+		}
+
+		m_spin.store(spin + (max - spin) / 8, std::memory_order_relaxed);
+
+		while (true) {
+			m_waiters.fetch_add(1, std::memory_order_acq_rel);
+
+			const u32 epoch = m_epoch.load(std::memory_order_relaxed);
+
+			if (pred()) {
+				m_waiters.fetch_sub(1, std::memory_order_relaxed);
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> l(m_lock);
+
+				while (m_epoch.load(std::memory_order_relaxed) == epoch)
+					m_cv.wait(l);
+			}
+
+			m_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+			if (pred())
+				return;
+		}
+	}
+};
+
+// Single worker job queue.  Nothing in the GS uses it at the moment (the rasterizers have
+// their own pool), it's kept as the plain GSEventCount user that GSJobQueueBench measures.
 template<class T, int CAPACITY> class GSJobQueue final
 {
 private:
 	std::thread m_thread;
 	std::function<void(T&)> m_func;
-	bool m_exit;
+	std::atomic<bool> m_exit;
 	ringbuffer_base<T, CAPACITY> m_queue;
 
-	std::mutex m_lock;
-	std::mutex m_wait_lock;
-	std::condition_variable m_empty;
-	std::condition_variable m_notempty;
+	GSEventCount m_notempty;	// pushed or exiting
+	GSEventCount m_notfull;		// consumed
+	GSEventCount m_empty;
 
 	void ThreadProc() {
-		std::unique_lock<std::mutex> l(m_lock);
-
 		while (true) {
+			m_notempty.Await([this]() {return !m_queue.empty() || m_exit.load(std::memory_order_relaxed);});
 
-			while (m_queue.empty()) {
-				if (m_exit)
-					return;
+			if (m_queue.empty())
+				return;
 
-				m_notempty.wait(l);
-			}
-
-			l.unlock();
+			// a producer waiting for room is only woken once half of it is free, not per item
 
 			while (m_queue.consume_one(*this))
-				;
-
-			{
-				std::lock_guard<std::mutex> wait_guard(m_wait_lock);
-			}
-			m_empty.notify_one();
+				if (m_queue.size() <= CAPACITY / 2)
+					m_notfull.NotifyAll();
 
-			l.lock();
+			m_empty.NotifyAll();
 		}
 	}
 
@@ -78,11 +164,8 @@ public:
 
 	~GSJobQueue()
 	{
-		{
-			std::lock_guard<std::mutex> l(m_lock);
-			m_exit = true;
-		}
-		m_notempty.notify_one();
+		m_exit = true;
+		m_notempty.NotifyAll();
 
 		m_thread.join();
 	}
@@ -93,23 +176,15 @@ public:
 	}
 
 	void Push(const T& item) {
-		while(!m_queue.push(item))
-			std::this_thread::yield();
+		if (!m_queue.push(item))
+			m_notfull.Await([&]() {return m_queue.push(item);});
 
-		{
-			std::lock_guard<std::mutex> l(m_lock);
-		}
-		m_notempty.notify_one();
+		m_notempty.NotifyAll();
 	}
 
 	void Wait()
 	{
-		if (IsEmpty())
-			return;
-
-		std::unique_lock<std::mutex> l(m_wait_lock);
-		while (!IsEmpty())
-			m_empty.wait(l);
+		m_empty.Await([this]() {return IsEmpty();});
 
 		assert(IsEmpty());
 	}
@@ -0,0 +1,251 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GSFunctionMap.h"
+#include "svnrev.h"
+
+#include <algorithm>
+
+#define CACHE_MAGIC   0x544A5347 // 'GSJT'
+#define CACHE_VERSION 2
+
+struct CacheHeader
+{
+	u32 magic;
+	u32 version;
+	u32 isa;   // _M_SSE the functions were generated for
+	u32 count; // number of maps
+	u64 build; // hash of GIT_REV
+};
+
+static u64 BuildHash()
+{
+	u64 hash = 0xcbf29ce484222325ull;
+
+	for(const char* c = GIT_REV; *c; c++)
+	{
+		hash = (hash ^ (u8)*c) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+GSCodeGeneratorCache::GSCodeGeneratorCache()
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+GSCodeGeneratorCache& GSCodeGeneratorCache::Get()
+{
+	static GSCodeGeneratorCache cache;
+
+	return cache;
+}
+
+void GSCodeGeneratorCache::Add(const char* name, u64 key, u64 microseconds, bool prewarm)
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	// prewarmed functions keep their age until they are used
+
+	if(prewarm)
+		m_keys[name].emplace(key, 0);
+	else
+		m_keys[name][key] = 0;
+
+	m_stats.generated++;
+	m_stats.microseconds += microseconds;
+	m_stats.max_microseconds = std::max(m_stats.max_microseconds, microseconds);
+
+	if(prewarm)
+	{
+		m_stats.prewarmed++;
+	}
+}
+
+void GSCodeGeneratorCache::Hit(const char* name, u64 key)
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	auto i = m_keys.find(name);
+
+	if(i != m_keys.end())
+	{
+		auto j = i->second.find(key);
+
+		if(j != i->second.end())
+			j->second = 0;
+	}
+}
+
+std::vector<u64> GSCodeGeneratorCache::GetKeys(const char* name)
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	auto i = m_keys.find(name);
+
+	if(i == m_keys.end())
+		return {};
+
+	std::vector<u64> v;
+
+	v.reserve(i->second.size());
+
+	for(auto& j : i->second)
+		v.push_back(j.first);
+
+	return v;
+}
+
+bool GSCodeGeneratorCache::Load(const std::string& filename)
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	m_keys.clear();
+
+	FILE* fp = fopen(filename.c_str(), "rb");
+
+	if(fp == NULL)
+		return false;
+
+	std::map<std::string, std::map<u64, u32>> keys;
+
+	CacheHeader header;
+
+	bool valid = fread(&header, sizeof(header), 1, fp) == 1
+		&& header.magic == CACHE_MAGIC
+		&& header.version == CACHE_VERSION
+		&& header.isa == _M_SSE
+		&& header.build == BuildHash();
+
+	for(u32 i = 0; valid && i < header.count; i++)
+	{
+		u32 len, count;
+		char name[256];
+
+		valid = fread(&len, sizeof(len), 1, fp) == 1 && len < sizeof(name)
+			&& fread(name, len, 1, fp) == 1
+			&& fread(&count, sizeof(count), 1, fp) == 1
+			&& count <= MaxKeys;
+
+		if(!valid)
+			break;
+
+		std::vector<u64> v(count);
+		std::vector<u32> age(count);
+
+		valid = count == 0 || (fread(v.data(), sizeof(u64), count, fp) == count
+			&& fread(age.data(), sizeof(u32), count, fp) == count);
+
+		std::map<u64, u32>& m = keys[std::string(name, len)];
+
+		for(u32 j = 0; valid && j < count; j++)
+		{
+			// one more session, the functions not used for too long are dropped
+
+			if(age[j] + 1 < MaxAge)
+				m[v[j]] = age[j] + 1;
+		}
+	}
+
+	fclose(fp);
+
+	if(!valid)
+		return false;
+
+	m_keys = std::move(keys);
+
+	return true;
+}
+
+bool GSCodeGeneratorCache::Save(const std::string& filename)
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	FILE* fp = fopen(filename.c_str(), "wb");
+
+	if(fp == NULL)
+		return false;
+
+	CacheHeader header;
+
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.isa = _M_SSE;
+	header.count = m_keys.size();
+	header.build = BuildHash();
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+	for(auto& i : m_keys)
+	{
+		// the most recently used ones first, if there are too many
+
+		std::vector<std::pair<u32, u64>> keys;
+
+		keys.reserve(i.second.size());
+
+		for(auto& j : i.second)
+			keys.emplace_back(j.second, j.first);
+
+		if(keys.size() > MaxKeys)
+		{
+			std::nth_element(keys.begin(), keys.begin() + MaxKeys, keys.end());
+
+			keys.resize(MaxKeys);
+		}
+
+		std::vector<u64> v;
+		std::vector<u32> age;
+
+		for(auto& j : keys)
+		{
+			v.push_back(j.second);
+			age.push_back(j.first);
+		}
+
+		u32 len = i.first.size();
+		u32 count = v.size();
+
+		ok = ok && fwrite(&len, sizeof(len), 1, fp) == 1
+			&& fwrite(i.first.data(), len, 1, fp) == 1
+			&& fwrite(&count, sizeof(count), 1, fp) == 1
+			&& (count == 0 || (fwrite(v.data(), sizeof(u64), count, fp) == count
+				&& fwrite(age.data(), sizeof(u32), count, fp) == count));
+	}
+
+	ok = fclose(fp) == 0 && ok;
+
+	if(!ok)
+		remove(filename.c_str());
+
+	return ok;
+}
+
+void GSCodeGeneratorCache::Clear()
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	m_keys.clear();
+
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+GSCodeGeneratorCache::Stats GSCodeGeneratorCache::GetStats()
+{
+	std::lock_guard<std::mutex> l(m_lock);
+
+	return m_stats;
+}
@@ -30,6 +30,56 @@
 
 #include "../SW/GSScanlineEnvironment.h"
 
+#include <chrono>
+#include <mutex>
+#include <map>
+
+// Keys of the functions the code generators produced, by map name, with the time spent
+// generating them.  Shared by every map of the same name (each rasterizer thread has its
+// own), and saved across sessions (one file per game) so GSCodeGeneratorFunctionMap::Prewarm
+// can generate all previously seen functions upfront instead of in the middle of a frame.
+//
+// Only keys are stored, the code itself refers to per-instance data (the local data of its
+// GSDrawScanline) and has to be generated again anyway.  Each key also has the number of
+// sessions since it was last used, the ones unused for MaxAge sessions are dropped and at
+// most MaxKeys per map are saved (the most recently used), so the file cannot keep growing.
+class GSCodeGeneratorCache
+{
+public:
+	static const u32 MaxAge = 8;
+	static const size_t MaxKeys = 1024;
+
+	struct Stats
+	{
+		u64 generated;     // functions generated this session
+		u64 prewarmed;     // of which during Prewarm
+		u64 microseconds;  // time spent generating
+		u64 max_microseconds;
+	};
+
+private:
+	std::mutex m_lock;
+	std::map<std::string, std::map<u64, u32>> m_keys; // key, sessions since last used
+	Stats m_stats;
+
+	GSCodeGeneratorCache();
+
+public:
+	static GSCodeGeneratorCache& Get();
+
+	void Add(const char* name, u64 key, u64 microseconds, bool prewarm);
+	void Hit(const char* name, u64 key); // a prewarmed function got used
+	std::vector<u64> GetKeys(const char* name);
+
+	// The file is tied to the build and ISA level, anything else is ignored by Load.  Load
+	// replaces the keys (none if it fails) and starts a new session for them.
+	bool Load(const std::string& filename);
+	bool Save(const std::string& filename);
+	void Clear();
+
+	Stats GetStats();
+};
+
 template<class KEY, class VALUE> class GSFunctionMap
 {
 protected:
@@ -100,33 +150,57 @@ public:
 template<class CG, class KEY, class VALUE>
 class GSCodeGeneratorFunctionMap : public GSFunctionMap<KEY, VALUE>
 {
+	const char* m_name;
 	void* m_param;
 	std::unordered_map<u64, VALUE> m_cgmap;
 	GSCodeBuffer m_cb;
 
+	VALUE Generate(KEY key, bool prewarm)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		CG* cg = new CG(m_param, key, 
+				m_cb.GetBuffer(8192), 8192);
+
+		m_cb.ReleaseBuffer(cg->getSize());
+
+		VALUE ret = m_cgmap[key] = (VALUE)cg->getCode();
+
+		delete cg;
+
+		u64 us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+		GSCodeGeneratorCache::Get().Add(m_name, key, us, prewarm);
+
+		return ret;
+	}
+
 public:
 	GSCodeGeneratorFunctionMap(const char* name, void* param)
-		: m_param(param) { }
+		: m_name(name), m_param(param) { }
 	~GSCodeGeneratorFunctionMap() { }
 
 	VALUE GetDefaultFunction(KEY key)
 	{
-		VALUE ret = NULL;
-
 		auto i = m_cgmap.find(key);
 
 		if(i != m_cgmap.end())
-			return i->second;
-
-		CG* cg = new CG(m_param, key, 
-				m_cb.GetBuffer(8192), 8192);
-
-		m_cb.ReleaseBuffer(cg->getSize());
+		{
+			GSCodeGeneratorCache::Get().Hit(m_name, key);
 
-		ret = m_cgmap[key] = (VALUE)cg->getCode();
+			return i->second;
+		}
 
-		delete cg;
+		return Generate(key, false);
+	}
 
-		return ret;
+	// Generates the functions of every key in the cache, for this name, not generated yet
+	void Prewarm()
+	{
+		for(u64 key : GSCodeGeneratorCache::Get().GetKeys(m_name))
+		{
+			if(m_cgmap.find(key) == m_cgmap.end())
+				Generate(key, true);
+		}
 	}
 };
@@ -0,0 +1,310 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Pcsx2Types.h"
+
+#include "GSDeviceSW.h"
+
+extern retro_video_refresh_t video_cb;
+
+struct MergeParam
+{
+	bool const_alpha; // PMODE.MMOD
+	bool keep_alpha;  // PMODE.AMOD
+	int alpha;        // PMODE.ALP
+};
+
+static void CopyRow(u32* RESTRICT dst, const u32* RESTRICT src, const int* sx, int count, const void* param)
+{
+	for(int i = 0; i < count; i++)
+	{
+		dst[i] = src[sx[i]];
+	}
+}
+
+// GS memory is RGBA, frontends want XRGB8888
+static void PresentRow(u32* RESTRICT dst, const u32* RESTRICT src, const int* sx, int count, const void* param)
+{
+	for(int i = 0; i < count; i++)
+	{
+		const u32 c = src[sx[i]];
+
+		dst[i] = ((c & 0xff) << 16) | (c & 0x0000ff00) | ((c >> 16) & 0xff);
+	}
+}
+
+// Same as the merge shaders and blend state of the hw devices: the source alpha is either
+// the constant ALP or twice the texel alpha, and the result is Cs * a + Cd * (1 - a).
+static void MergeRow(u32* RESTRICT dst, const u32* RESTRICT src, const int* sx, int count, const void* param)
+{
+	const MergeParam* p = (const MergeParam*)param;
+
+	for(int i = 0; i < count; i++)
+	{
+		const u32 s = src[sx[i]];
+		const u32 d = dst[i];
+
+		const int sa = p->const_alpha ? p->alpha : std::min<int>((s >> 24) * 2, 255);
+		const int da = 255 - sa;
+
+		u32 c = 0;
+
+		for(int shift = 0; shift < 24; shift += 8)
+		{
+			c |= ((((s >> shift) & 0xff) * sa + ((d >> shift) & 0xff) * da + 127) / 255) << shift;
+		}
+
+		c |= p->keep_alpha ? d & 0xff000000 : (u32)((sa * sa + (d >> 24) * da + 127) / 255) << 24;
+
+		dst[i] = c;
+	}
+}
+
+static u32 ToRGBA8(const GSVector4& c)
+{
+	GSVector4i ci = GSVector4i(c * GSVector4(255.0f) + GSVector4(0.5f)).sat_i32(GSVector4i::zero(), GSVector4i(255));
+
+	return (u32)ci.x | ((u32)ci.y << 8) | ((u32)ci.z << 16) | ((u32)ci.w << 24);
+}
+
+bool GSDeviceSW::Create()
+{
+	if(!GSDevice::Create())
+		return false;
+
+	Reset(1, 1);
+
+	return true;
+}
+
+bool GSDeviceSW::Reset(int w, int h)
+{
+	if(!GSDevice::Reset(w, h))
+		return false;
+
+	m_backbuffer = new GSTextureSW(GSTexture::Backbuffer, w, h);
+
+	return true;
+}
+
+GSTexture* GSDeviceSW::CreateSurface(int type, int w, int h, int format)
+{
+	return new GSTextureSW(type, w, h);
+}
+
+void GSDeviceSW::Blit(GSTexture* sTex, const GSVector4& sRect, GSTexture* dTex, const GSVector4& dRect, RowOp op, const void* param, int row_step, int row_start)
+{
+	if(!sTex || !dTex || sTex == dTex)
+		return;
+
+	const GSVector2i ss = sTex->GetSize();
+	const GSVector2i ds = dTex->GetSize();
+
+	const float dw = dRect.z - dRect.x;
+	const float dh = dRect.w - dRect.y;
+
+	if(dw <= 0 || dh <= 0)
+		return;
+
+	// destination pixels whose center is inside dRect, point sampled from sRect
+
+	const int left = std::max<int>((int)floor(dRect.x + 0.5f), 0);
+	const int top = std::max<int>((int)floor(dRect.y + 0.5f), 0);
+	const int right = std::min<int>((int)floor(dRect.z + 0.5f), ds.x);
+	const int bottom = std::min<int>((int)floor(dRect.w + 0.5f), ds.y);
+
+	if(left >= right || top >= bottom)
+		return;
+
+	const float sx = sRect.x * ss.x;
+	const float sy = sRect.y * ss.y;
+	const float xscale = (sRect.z - sRect.x) * ss.x / dw;
+	const float yscale = (sRect.w - sRect.y) * ss.y / dh;
+
+	m_sx.resize(right - left);
+
+	for(int x = left; x < right; x++)
+	{
+		m_sx[x - left] = std::min(std::max((int)(sx + (x + 0.5f - dRect.x) * xscale), 0), ss.x - 1);
+	}
+
+	GSTexture::GSMap sm, dm;
+
+	if(!sTex->Map(sm))
+		return;
+
+	if(!dTex->Map(dm))
+	{
+		sTex->Unmap();
+		return;
+	}
+
+	int y = top + ((row_start - top) % row_step + row_step) % row_step;
+
+	for(; y < bottom; y += row_step)
+	{
+		const int v = std::min(std::max((int)(sy + (y + 0.5f - dRect.y) * yscale), 0), ss.y - 1);
+
+		op((u32*)(dm.bits + y * dm.pitch) + left, (const u32*)(sm.bits + v * sm.pitch), m_sx.data(), right - left, param);
+	}
+
+	dTex->Unmap();
+	sTex->Unmap();
+}
+
+void GSDeviceSW::Fill(GSTexture* t, u32 c)
+{
+	GSTexture::GSMap m;
+
+	if(t && t->Map(m))
+	{
+		for(int y = 0; y < t->GetHeight(); y++)
+		{
+			u32* RESTRICT row = (u32*)(m.bits + y * m.pitch);
+
+			std::fill(row, row + t->GetWidth(), c);
+		}
+
+		t->Unmap();
+	}
+}
+
+void GSDeviceSW::DoMerge(GSTexture* sTex[3], GSVector4* sRect, GSTexture* dTex, GSVector4* dRect, const GSRegPMODE& PMODE, const GSRegEXTBUF& EXTBUF, const GSVector4& c)
+{
+	// Note: the feedback write (EXTBUF) of the hw devices is not supported here.
+
+	Fill(dTex, ToRGBA8(c));
+
+	if(sTex[1] && PMODE.SLBG == 0)
+	{
+		Blit(sTex[1], sRect[1], dTex, dRect[1], CopyRow);
+	}
+
+	if(sTex[0])
+	{
+		MergeParam p;
+
+		p.const_alpha = PMODE.MMOD == 1;
+		p.keep_alpha = PMODE.AMOD == 1;
+		p.alpha = PMODE.ALP;
+
+		Blit(sTex[0], sRect[0], dTex, dRect[0], MergeRow, &p);
+	}
+}
+
+void GSDeviceSW::DoInterlace(GSTexture* sTex, GSTexture* dTex, int shader, bool linear, float yoffset)
+{
+	const GSVector4 s = GSVector4(dTex->GetSize());
+
+	const GSVector4 sRect(0, 0, 1, 1);
+	const GSVector4 dRect(0.0f, yoffset, s.x, s.y + yoffset);
+
+	switch(shader)
+	{
+		case 0: // weave, odd lines
+			Blit(sTex, sRect, dTex, dRect, CopyRow, NULL, 2, 1);
+			break;
+
+		case 1: // weave, even lines
+			Blit(sTex, sRect, dTex, dRect, CopyRow, NULL, 2, 0);
+			break;
+
+		case 2: // blend, (prev + 2 * cur + next) / 4
+		{
+			GSTexture::GSMap sm, dm;
+
+			if(sTex == dTex || sTex->GetSize() != dTex->GetSize() || !sTex->Map(sm))
+				break;
+
+			if(!dTex->Map(dm))
+			{
+				sTex->Unmap();
+				break;
+			}
+
+			const int w = dTex->GetWidth();
+			const int h = dTex->GetHeight();
+
+			for(int y = 0; y < h; y++)
+			{
+				const u32* RESTRICT r0 = (const u32*)(sm.bits + std::max(y - 1, 0) * sm.pitch);
+				const u32* RESTRICT r1 = (const u32*)(sm.bits + y * sm.pitch);
+				const u32* RESTRICT r2 = (const u32*)(sm.bits + std::min(y + 1, h - 1) * sm.pitch);
+				u32* RESTRICT d = (u32*)(dm.bits + y * dm.pitch);
+
+				for(int x = 0; x < w; x++)
+				{
+					u32 c = 0;
+
+					for(int shift = 0; shift < 32; shift += 8)
+					{
+						c |= ((((r0[x] >> shift) & 0xff) + ((r1[x] >> shift) & 0xff) * 2 + ((r2[x] >> shift) & 0xff)) >> 2) << shift;
+					}
+
+					d[x] = c;
+				}
+			}
+
+			dTex->Unmap();
+			sTex->Unmap();
+
+			break;
+		}
+
+		default: // bob
+			Blit(sTex, sRect, dTex, dRect, CopyRow);
+			break;
+	}
+}
+
+void GSDeviceSW::Present(GSTexture* sTex, GSTexture* dTex, const GSVector4& dRect, int shader)
+{
+	// The post filters are not emulated, the frame is only converted to the frontend format.
+	Blit(sTex, GSVector4(0, 0, 1, 1), dTex, dRect, PresentRow);
+}
+
+void GSDeviceSW::Flip()
+{
+	GSTexture::GSMap m;
+
+	if(m_backbuffer && m_backbuffer->Map(m))
+	{
+		video_cb(m.bits, m_backbuffer->GetWidth(), m_backbuffer->GetHeight(), m.pitch);
+
+		m_backbuffer->Unmap();
+	}
+}
+
+void GSDeviceSW::ClearRenderTarget(GSTexture* t, const GSVector4& c)
+{
+	Fill(t, ToRGBA8(c));
+}
+
+void GSDeviceSW::ClearRenderTarget(GSTexture* t, u32 c)
+{
+	Fill(t, c);
+}
+
+void GSDeviceSW::CopyRect(GSTexture* sTex, GSTexture* dTex, const GSVector4i& r)
+{
+	const GSVector4 s = GSVector4(sTex->GetSize()).xyxy();
+
+	Blit(sTex, GSVector4(r) / s, dTex, GSVector4(r), CopyRow);
+}
+
+void GSDeviceSW::StretchRect(GSTexture* sTex, const GSVector4& sRect, GSTexture* dTex, const GSVector4& dRect, int shader, bool linear)
+{
+	Blit(sTex, sRect, dTex, dRect, CopyRow);
+}
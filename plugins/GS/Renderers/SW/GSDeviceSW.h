@@ -0,0 +1,56 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../Common/GSDevice.h"
+#include "GSTextureSW.h"
+
+#include <vector>
+
+// CPU-only device for GSRendererSW.  Every surface lives in host memory, merging,
+// interlacing and presenting are done on the CPU, and the backbuffer is handed to the
+// frontend as a software frame, so no GPU context is needed at all.
+class GSDeviceSW final : public GSDevice
+{
+	// Called for each destination row of a blit with the source row and the source column of
+	// each destination pixel.
+	typedef void (*RowOp)(u32* RESTRICT dst, const u32* RESTRICT src, const int* sx, int count, const void* param);
+
+	std::vector<int> m_sx;
+
+	GSTexture* CreateSurface(int type, int w, int h, int format);
+
+	void Blit(GSTexture* sTex, const GSVector4& sRect, GSTexture* dTex, const GSVector4& dRect, RowOp op, const void* param = NULL, int row_step = 1, int row_start = 0);
+	void Fill(GSTexture* t, u32 c);
+
+	void DoMerge(GSTexture* sTex[3], GSVector4* sRect, GSTexture* dTex, GSVector4* dRect, const GSRegPMODE& PMODE, const GSRegEXTBUF& EXTBUF, const GSVector4& c);
+	void DoInterlace(GSTexture* sTex, GSTexture* dTex, int shader, bool linear, float yoffset = 0);
+	u16 ConvertBlendEnum(u16 generic) { return 0xFFFF; }
+
+public:
+	GSDeviceSW() {}
+
+	bool Create();
+	bool Reset(int w, int h);
+	void Present(GSTexture* sTex, GSTexture* dTex, const GSVector4& dRect, int shader = 0);
+	void Flip();
+
+	void ClearRenderTarget(GSTexture* t, const GSVector4& c);
+	void ClearRenderTarget(GSTexture* t, u32 c);
+
+	void CopyRect(GSTexture* sTex, GSTexture* dTex, const GSVector4i& r);
+	void StretchRect(GSTexture* sTex, const GSVector4& sRect, GSTexture* dTex, const GSVector4& dRect, int shader = 0, bool linear = true);
+};
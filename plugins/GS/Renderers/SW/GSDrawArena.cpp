@@ -0,0 +1,121 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "GSDrawArena.h"
+
+GSDrawArena::GSDrawArena()
+	: m_chunk(0)
+	, m_ptr(NULL)
+	, m_end(NULL)
+	, m_used(0)
+	, m_live(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+GSDrawArena::~GSDrawArena()
+{
+	ASSERT(m_live == 0);
+
+	for(const Chunk& c : m_chunks)
+	{
+		_aligned_free(c.buff);
+	}
+}
+
+void GSDrawArena::NextChunk(size_t size)
+{
+	size_t next = 0;
+
+	if(!m_chunks.empty())
+	{
+		m_used += m_ptr - m_chunks[m_chunk].buff;
+
+		next = m_chunk + 1;
+	}
+
+	// a chunk too small for this allocation is skipped for the rest of the frame
+
+	while(next < m_chunks.size() && m_chunks[next].size < size)
+	{
+		next++;
+	}
+
+	if(next == m_chunks.size())
+	{
+		Chunk c;
+
+		c.size = std::max<size_t>(size, ChunkSize);
+		c.buff = (u8*)_aligned_malloc(c.size, 64);
+
+		m_chunks.push_back(c);
+
+		m_stats.chunks++;
+	}
+
+	Chunk& c = m_chunks[next];
+
+	c.used = m_stats.recycles;
+
+	m_chunk = next;
+	m_ptr = c.buff;
+	m_end = c.buff + c.size;
+}
+
+bool GSDrawArena::Recycle()
+{
+	if(m_chunks.empty())
+	{
+		return true;
+	}
+
+	if(m_live.load(std::memory_order_acquire) != 0)
+	{
+		m_stats.deferred++;
+
+		return false;
+	}
+
+	m_stats.peak = std::max<u64>(m_stats.peak, GetUsed());
+	m_stats.recycles++;
+
+	// the first chunk always stays
+
+	for(size_t i = 1; i < m_chunks.size(); )
+	{
+		if(m_stats.recycles - m_chunks[i].used > KeepChunks)
+		{
+			_aligned_free(m_chunks[i].buff);
+
+			m_chunks.erase(m_chunks.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	Chunk& c = m_chunks[0];
+
+	c.used = m_stats.recycles;
+
+	m_chunk = 0;
+	m_ptr = c.buff;
+	m_end = c.buff + c.size;
+	m_used = 0;
+
+	return true;
+}
@@ -0,0 +1,127 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Pcsx2Types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Memory for the draws of a frame: the SharedData of GSRendererSW (with their shared_ptr
+// control block), their vertex/index buffers and their CLUT and dithering copies.  Every
+// allocation is bumped out of chunks that are kept from one frame to the next, instead of
+// a few malloc/free per draw.
+//
+// Only the MTGS thread allocates.  The memory of a draw lives as long as its SharedData,
+// which may die on any rasterizer thread, so only the objects (see Allocator) are counted.
+// Everything is reclaimed at once by Recycle, after the rasterizers synced at vsync.  If a
+// draw were still alive by then, the arena would just go on growing until the next one.
+class GSDrawArena
+{
+public:
+	static const size_t ChunkSize = 1024 * 1024;
+
+	struct Stats
+	{
+		u64 objects;	// draws
+		u64 allocs;
+		u64 bytes;
+		u64 chunks;		// malloc'd
+		u64 recycles;
+		u64 deferred;	// recycles that had to wait, draws were alive
+		u64 peak;		// bytes used by a frame
+	};
+
+	// For std::allocate_shared, the objects are counted
+	template<class T> class Allocator
+	{
+	public:
+		typedef T value_type;
+
+		GSDrawArena* m_arena;
+
+		explicit Allocator(GSDrawArena* arena) : m_arena(arena) {}
+		template<class U> Allocator(const Allocator<U>& a) : m_arena(a.m_arena) {}
+
+		T* allocate(size_t n)
+		{
+			m_arena->m_live.fetch_add(1, std::memory_order_relaxed);
+			m_arena->m_stats.objects++;
+			return (T*)m_arena->Allocate(sizeof(T) * n, std::max<size_t>(alignof(T), 16));
+		}
+
+		void deallocate(T* p, size_t n)
+		{
+			m_arena->m_live.fetch_sub(1, std::memory_order_release);
+		}
+
+		template<class U> bool operator==(const Allocator<U>& a) const {return m_arena == a.m_arena;}
+		template<class U> bool operator!=(const Allocator<U>& a) const {return m_arena != a.m_arena;}
+	};
+
+protected:
+	static const u64 KeepChunks = 60; // recycles a chunk is kept without being used
+
+	struct Chunk
+	{
+		u8* buff;
+		size_t size;
+		u64 used;		// last recycle it was used for
+	};
+
+	std::vector<Chunk> m_chunks;
+	size_t m_chunk;		// current one
+	u8* m_ptr;
+	u8* m_end;
+	size_t m_used;		// by the chunks before the current one
+	std::atomic<int> m_live;
+	Stats m_stats;
+
+	void NextChunk(size_t size);
+
+public:
+	GSDrawArena();
+	~GSDrawArena();
+
+	void* Allocate(size_t size, size_t align = 64)
+	{
+		u8* p = (u8*)(((uptr)m_ptr + align - 1) & ~(uptr)(align - 1));
+
+		if(p + size > m_end)
+		{
+			NextChunk(size + align);
+
+			p = (u8*)(((uptr)m_ptr + align - 1) & ~(uptr)(align - 1));
+		}
+
+		m_ptr = p + size;
+
+		m_stats.allocs++;
+		m_stats.bytes += size;
+
+		return p;
+	}
+
+	// Bytes handed out since the last recycle
+	size_t GetUsed() const {return m_used + (m_chunks.empty() ? 0 : m_ptr - m_chunks[m_chunk].buff);}
+
+	// Starts over from the first chunk if no draw is alive, and frees the chunks that
+	// went unused for a while.  Returns false if draws were alive.
+	bool Recycle();
+
+	const Stats& GetStats() const {return m_stats;}
+};
@@ -112,6 +112,12 @@ void GSDrawScanline::EndDraw(u64 frame, int actual, int total)
 {
 }
 
+void GSDrawScanline::Prewarm()
+{
+	m_sp_map.Prewarm();
+	m_ds_map.Prewarm();
+}
+
 void GSDrawScanline::DrawRect(const GSVector4i& r, const GSVertexSW& v)
 {
 	ASSERT(r.y >= 0);
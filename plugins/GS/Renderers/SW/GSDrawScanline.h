@@ -71,6 +71,7 @@ public:
 
 	void BeginDraw(const GSRasterizerData* data);
 	void EndDraw(u64 frame, int actual, int total);
+	void Prewarm();
 
 	void DrawRect(const GSVector4i& r, const GSVertexSW& v);
 };
@@ -127,9 +127,9 @@ int GSRasterizer::GetPixels(bool reset)
 	return pixels;
 }
 
-void GSRasterizer::Draw(GSRasterizerData* data)
+void GSRasterizer::Draw(GSRasterizerData* data, const u32* index, int index_count, const GSVector4i& scissor)
 {
-	if(data->vertex != NULL && data->vertex_count == 0 || data->index != NULL && data->index_count == 0) return;
+	if(data->vertex != NULL && data->vertex_count == 0 || index != NULL && index_count == 0) return;
 
 	m_pixels.actual = 0;
 	m_pixels.total = 0;
@@ -139,16 +139,15 @@ void GSRasterizer::Draw(GSRasterizerData* data)
 	const GSVertexSW* vertex = data->vertex;
 	const GSVertexSW* vertex_end = data->vertex + data->vertex_count;
 
-	const u32* index = data->index;
-	const u32* index_end = data->index + data->index_count;
+	const u32* index_end = index + index_count;
 
 	u32 tmp_index[] = {0, 1, 2};
 
-	bool scissor_test = !data->bbox.eq(data->bbox.rintersect(data->scissor));
+	bool scissor_test = !data->bbox.eq(data->bbox.rintersect(scissor));
 
-	m_scissor = data->scissor;
-	m_fscissor_x = GSVector4(data->scissor).xzxz();
-	m_fscissor_y = GSVector4(data->scissor).ywyw();
+	m_scissor = scissor;
+	m_fscissor_x = GSVector4(scissor).xzxz();
+	m_fscissor_y = GSVector4(scissor).ywyw();
 
 	switch(data->primclass)
 	{
@@ -156,11 +155,11 @@ void GSRasterizer::Draw(GSRasterizerData* data)
 
 		if(scissor_test)
 		{
-			DrawPoint<true>(vertex, data->vertex_count, index, data->index_count);
+			DrawPoint<true>(vertex, data->vertex_count, index, index_count);
 		}
 		else
 		{
-			DrawPoint<false>(vertex, data->vertex_count, index, data->index_count);
+			DrawPoint<false>(vertex, data->vertex_count, index, index_count);
 		}
 
 		break;
@@ -1127,27 +1126,169 @@ void GSRasterizer::DrawEdge(int pixels, int left, int top, const GSVertexSW& sca
 
 //
 
-GSRasterizerList::GSRasterizerList(int threads)
+GSRasterizerList::GSRasterizerList(int threads, GSDrawArena* arena)
+	: m_arena(arena)
+	, m_queued(0)
+	, m_done(0)
+	, m_task(NULL)
+	, m_task_count(0)
+	, m_task_next(0)
+	, m_task_done(0)
+	, m_task_users(0)
+	, m_task_active(false)
+	, m_exit(false)
 {
 	m_thread_height = compute_best_thread_height(threads);
 
-	int rows = (2048 >> m_thread_height) + 16;
-	m_scanline = (u8*)_aligned_malloc(rows, 64);
+	m_band_count = 2048 >> m_thread_height;
+	m_bands.reset(new Band[m_band_count]);
+	m_bin_count.resize(m_band_count + 1);
 
-	int row = 0;
+	for(int i = 0; i < m_band_count; i++)
+	{
+		m_bands[i].busy = false;
+	}
+}
 
-	while(row < rows)
+GSRasterizerList::~GSRasterizerList()
+{
+	m_exit = true;
+	m_notempty.NotifyAll();
+
+	for(std::thread& t : m_workers)
 	{
-		for(int i = 0; i < threads; i++, row++)
+		t.join();
+	}
+}
+
+void GSRasterizerList::ThreadProc(int id)
+{
+	const int threads = (int)m_r.size();
+
+	while(true)
+	{
+		// Read the counter before looking for work, so a job queued during the search
+		// keeps us from going to sleep.
+		u64 queued = m_queued.load(std::memory_order_acquire);
+
+		// the MTGS waits for the task, it goes first
+
+		if(HasTask())
 		{
-			m_scanline[row] = (u8)i;
+			RunTask();
 		}
+
+		bool found = false;
+
+		// own bands first, then steal
+		for(int band = id; band < m_band_count; band += threads)
+		{
+			found |= RunBand(id, band);
+		}
+
+		for(int band = 0; band < m_band_count; band++)
+		{
+			if(band % threads != id)
+			{
+				found |= RunBand(id, band);
+			}
+		}
+
+		if(found)
+			continue;
+
+		m_notempty.Await([this, queued]() {return m_exit || m_queued.load(std::memory_order_acquire) != queued || HasTask();});
+
+		if(m_exit)
+			return;
 	}
 }
 
-GSRasterizerList::~GSRasterizerList()
+bool GSRasterizerList::RunBand(int id, int band)
 {
-	_aligned_free(m_scanline);
+	Band& b = m_bands[band];
+
+	if(b.queue.empty() || b.busy.load(std::memory_order_relaxed) || b.busy.exchange(true, std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	GSRasterizer* r = m_r[id].get();
+
+	int count = 0;
+
+	Job job;
+
+	while(b.queue.pop(job))
+	{
+		const Bins& bins = *job;
+		GSRasterizerData* data = bins.data.get();
+
+		GSVector4i scissor = data->scissor;
+		scissor.top = std::max<int>(scissor.top, band << m_thread_height);
+		scissor.bottom = std::min<int>(scissor.bottom, (band + 1) << m_thread_height);
+
+		if(bins.index == NULL)
+		{
+			r->Draw(data, data->index, data->index_count, scissor);
+		}
+		else
+		{
+			const u32 begin = bins.offset[band - bins.top];
+			const u32 end = bins.offset[band - bins.top + 1];
+
+			r->Draw(data, &bins.index[begin], end - begin, scissor);
+		}
+
+		job.reset();
+
+		count++;
+	}
+
+	b.busy.store(false, std::memory_order_release);
+
+	// the last job of a draw released its pages when it was reset, which SyncUntil may wait for
+
+	m_done.fetch_add(count, std::memory_order_acq_rel);
+
+	m_empty.NotifyAll();
+
+	return count > 0;
+}
+
+void GSRasterizerList::RunTask()
+{
+	m_task_users.fetch_add(1);
+
+	if(m_task_active)
+	{
+		const int count = m_task_count.load(std::memory_order_relaxed);
+
+		for(int i; (i = m_task_next.fetch_add(1, std::memory_order_relaxed)) < count; )
+		{
+			(*m_task)(i);
+
+			if(m_task_done.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+			{
+				m_empty.NotifyAll();
+			}
+		}
+	}
+
+	m_task_users.fetch_sub(1);
+}
+
+bool GSRasterizerList::HasTask() const
+{
+	return m_task_active && m_task_next.load(std::memory_order_relaxed) < m_task_count.load(std::memory_order_relaxed);
+}
+
+void GSRasterizerList::Push(int band, const Job& job)
+{
+	while(!m_bands[band].queue.push(job))
+	{
+		std::this_thread::yield();
+	}
 }
 
 void GSRasterizerList::Queue(const std::shared_ptr<GSRasterizerData>& data)
@@ -1156,43 +1297,212 @@ void GSRasterizerList::Queue(const std::shared_ptr<GSRasterizerData>& data)
 
 	ASSERT(r.top >= 0 && r.top < 2048 && r.bottom >= 0 && r.bottom < 2048);
 
-	int top = r.top >> m_thread_height;
-	int bottom = std::min<int>((r.bottom + (1 << m_thread_height) - 1) >> m_thread_height, top + m_workers.size());
+	if(r.rempty())
+	{
+		return;
+	}
+
+	int n;
 
-	while(top < bottom)
+	switch(data->primclass)
 	{
-		m_workers[m_scanline[top++]]->Push(data);
+	case GS_POINT_CLASS: n = 1; break;
+	case GS_LINE_CLASS: n = 2; break;
+	case GS_TRIANGLE_CLASS: n = 3; break;
+	case GS_SPRITE_CLASS: n = 2; break;
+	default: return;
 	}
+
+	const int top = r.top >> m_thread_height;
+	const int bottom = (r.bottom + (1 << m_thread_height) - 1) >> m_thread_height;
+
+	// Only this thread allocates from the arena, see GSDrawArena
+
+	std::shared_ptr<Bins> bins = std::allocate_shared<Bins>(GSDrawArena::Allocator<Bins>(m_arena));
+
+	bins->data = data;
+	bins->index = NULL;
+	bins->offset = NULL;
+	bins->top = top;
+
+	int jobs = 0;
+
+	if(bottom - top > 1 && data->index != NULL)
+	{
+		// Counting sort of the primitives by band, they stay in drawing order inside a band.
+		// Their vertical extent is padded by a line each way, getting a few primitives into
+		// a band they end up not touching is harmless since the scissor clips them anyway.
+
+		const GSVertexSW* RESTRICT vertex = data->vertex;
+		const u32* RESTRICT index = data->index;
+		const int prims = data->index_count / n;
+		const int bands = bottom - top;
+
+		u32* RESTRICT count = m_bin_count.data();
+
+		memset(count, 0, sizeof(u32) * bands);
+
+		m_bin_range.resize(prims);
+
+		u32* RESTRICT range = m_bin_range.data(); // first band | last band << 16
+
+		const GSVector4 ftop((float)(top << m_thread_height));
+		const GSVector4 fbottom((float)((bottom << m_thread_height) - 1));
+
+		for(int i = 0; i < prims; i++)
+		{
+			const u32* RESTRICT idx = &index[i * n];
+
+			GSVector4 ymin = vertex[idx[0]].p.yyyy();
+			GSVector4 ymax = ymin;
+
+			for(int j = 1; j < n; j++)
+			{
+				GSVector4 y = vertex[idx[j]].p.yyyy();
+
+				ymin = ymin.min(y);
+				ymax = ymax.max(y);
+			}
+
+			ymin = (ymin - GSVector4(1.0f)).floor().max(ftop).min(fbottom);
+			ymax = (ymax + GSVector4(1.0f)).ceil().max(ftop).min(fbottom);
+
+			const int b0 = ((int)ymin.x >> m_thread_height) - top;
+			const int b1 = ((int)ymax.x >> m_thread_height) - top;
+
+			range[i] = b0 | (b1 << 16);
+
+			for(int b = b0; b <= b1; b++)
+			{
+				count[b]++;
+			}
+		}
+
+		u32* RESTRICT offset = (u32*)m_arena->Allocate(sizeof(u32) * (bands + 1), 16);
+
+		u32 sum = 0;
+
+		for(int b = 0; b < bands; b++)
+		{
+			offset[b] = sum * n;
+			sum += count[b];
+			count[b] = offset[b];
+		}
+
+		offset[bands] = sum * n;
+
+		u32* RESTRICT dst = (u32*)m_arena->Allocate(sizeof(u32) * std::max<u32>(sum * n, 1), 16);
+
+		bins->index = dst;
+		bins->offset = offset;
+
+		for(int i = 0; i < prims; i++)
+		{
+			const u32* RESTRICT idx = &index[i * n];
+
+			for(int b = range[i] & 0xffff, b1 = range[i] >> 16; b <= b1; b++)
+			{
+				u32* RESTRICT d = &dst[count[b]];
+
+				for(int j = 0; j < n; j++)
+				{
+					d[j] = idx[j];
+				}
+
+				count[b] += n;
+			}
+		}
+
+		for(int b = 0; b < bands; b++)
+		{
+			if(offset[b] != offset[b + 1])
+			{
+				Push(top + b, bins);
+				jobs++;
+			}
+		}
+	}
+	else
+	{
+		// a single band (or nothing to sort by), every band gets the whole draw
+
+		for(int b = top; b < bottom; b++)
+		{
+			Push(b, bins);
+			jobs++;
+		}
+	}
+
+	m_queued.fetch_add(jobs, std::memory_order_acq_rel);
+
+	m_notempty.NotifyAll();
 }
 
 void GSRasterizerList::Sync()
 {
-	if(!IsSynced())
-	{
-		for(size_t i = 0; i < m_workers.size(); i++)
-			m_workers[i]->Wait();
-	}
+	m_empty.Await([this]() {return IsSynced();});
 }
 
-bool GSRasterizerList::IsSynced() const
+void GSRasterizerList::SyncUntil(const std::function<bool()>& done)
+{
+	m_empty.Await([this, &done]() {return done() || IsSynced();});
+}
+
+void GSRasterizerList::Parallel(int count, const std::function<void(int)>& func)
 {
-	for(size_t i = 0; i < m_workers.size(); i++)
+	if(count <= 1)
 	{
-		if(!m_workers[i]->IsEmpty())
-			return false;
+		if(count == 1) func(0);
+
+		return;
 	}
 
-	return true;
+	m_task = &func;
+	m_task_count = count;
+	m_task_next = 0;
+	m_task_done = 0;
+	m_task_active = true;
+
+	m_notempty.NotifyAll();
+
+	RunTask();
+
+	m_empty.Await([this, count]() {return m_task_done.load(std::memory_order_acquire) == count;});
+
+	// a worker that saw the task active may still be about to claim an item, which fails
+
+	m_task_active = false;
+
+	while(m_task_users.load() != 0)
+	{
+		std::this_thread::yield();
+	}
+}
+
+bool GSRasterizerList::IsSynced() const
+{
+	return m_done.load(std::memory_order_acquire) == m_queued.load(std::memory_order_acquire);
 }
 
 int GSRasterizerList::GetPixels(bool reset)
 {
 	int pixels = 0;
 
-	for(size_t i = 0; i < m_workers.size(); i++)
+	for(size_t i = 0; i < m_r.size(); i++)
 	{
 		pixels += m_r[i]->GetPixels(reset);
 	}
 
 	return pixels;
 }
+
+void GSRasterizerList::Prewarm()
+{
+	// before any draw, the workers don't touch their rasterizer yet
+	ASSERT(IsSynced());
+
+	for(size_t i = 0; i < m_r.size(); i++)
+	{
+		m_r[i]->Prewarm();
+	}
+}
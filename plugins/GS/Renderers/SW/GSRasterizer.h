@@ -27,6 +27,7 @@
 #include "GSVertexSW.h"
 #include "../../GSAlignedClass.h"
 #include "../../GSThread_CXX11.h"
+#include "GSDrawArena.h"
 
 class alignas(32) GSRasterizerData : public GSAlignedClass<32>
 {
@@ -85,6 +86,7 @@ public:
 
 	virtual void BeginDraw(const GSRasterizerData* data) = 0;
 	virtual void EndDraw(u64 frame, int actual, int total) = 0;
+	virtual void Prewarm() {}
 
 	__forceinline void SetupPrim(const GSVertexSW* vertex, const u32* index, const GSVertexSW& dscan) {m_sp(vertex, index, dscan);}
 	__forceinline void DrawScanline(int pixels, int left, int top, const GSVertexSW& scan) {m_ds(pixels, left, top, scan);}
@@ -104,7 +106,14 @@ public:
 	virtual void Queue(const std::shared_ptr<GSRasterizerData>& data) = 0;
 	virtual void Sync() = 0;
 	virtual bool IsSynced() const = 0;
+	// Waits until done returns true, which has to happen once some queued data is drawn, or
+	// until everything is drawn.  done is checked after each batch of jobs.
+	virtual void SyncUntil(const std::function<bool()>& done) = 0;
+	// Runs func(0) .. func(count - 1) on the worker threads and this one, in any order, and
+	// returns once they are all done.  Queued draws keep running meanwhile.
+	virtual void Parallel(int count, const std::function<void(int)>& func) = 0;
 	virtual int GetPixels(bool reset = true) = 0;
+	virtual void Prewarm() = 0;
 };
 
 class alignas(32) GSRasterizer : public IRasterizer
@@ -151,33 +160,85 @@ public:
 	__forceinline bool IsOneOfMyScanlines(int top, int bottom) const;
 	__forceinline int FindMyNextScanline(int top) const;
 
-	void Draw(GSRasterizerData* data);
+	void Draw(GSRasterizerData* data) {Draw(data, data->index, data->index_count, data->scissor);}
+	void Draw(GSRasterizerData* data, const u32* index, int index_count, const GSVector4i& scissor);
 
 	// IRasterizer
 
 	void Queue(const std::shared_ptr<GSRasterizerData>& data);
 	void Sync() {}
 	bool IsSynced() const {return true;}
+	void SyncUntil(const std::function<bool()>& done) {}
+	void Parallel(int count, const std::function<void(int)>& func) {for(int i = 0; i < count; i++) func(i);}
 	int GetPixels(bool reset);
+	void Prewarm() {m_ds->Prewarm();}
 };
 
+// Multi-threaded rasterizer.  Each draw is binned once: its primitives are sorted into
+// bands of (1 << m_thread_height) scanlines, and every band that got primitives becomes a
+// job holding only those.  Jobs of one band are run in order and never concurrently, by
+// whichever worker claims the band, with the draw scissored to it.  Workers prefer the bands
+// they own (interleaved like the scanlines used to be) for cache locality, and steal the
+// other ones when they run out of work.  The bins are allocated from the draw arena of the
+// renderer, like the rest of the draw.
 class GSRasterizerList : public IRasterizer
 {
 protected:
-	using GSWorker = GSJobQueue<std::shared_ptr<GSRasterizerData>, 65536>;
+	// A draw with its primitives sorted by band, shared by the jobs of all these bands
+	struct Bins
+	{
+		std::shared_ptr<GSRasterizerData> data;
+		const u32* index; // NULL when every band draws the whole draw
+		const u32* offset; // primitives of band b are index[offset[b - top] .. offset[b - top + 1]]
+		int top;
+	};
+
+	typedef std::shared_ptr<Bins> Job;
+
+	struct alignas(64) Band
+	{
+		ringbuffer_base<Job, 256> queue;
+		std::atomic<bool> busy;
+	};
 
-	// Worker threads depend on the rasterizers, so don't change the order.
 	std::vector<std::unique_ptr<GSRasterizer>> m_r;
-	std::vector<std::unique_ptr<GSWorker>> m_workers;
-	u8* m_scanline;
+	std::vector<std::thread> m_workers;
+	GSDrawArena* m_arena;
+	std::unique_ptr<Band[]> m_bands;
+	int m_band_count;
 	int m_thread_height;
-
-	GSRasterizerList(int threads);
+	std::vector<u32> m_bin_count; // binning scratch, one per band
+	std::vector<u32> m_bin_range; // binning scratch, one per primitive
+
+	// job counters, m_done catches up with m_queued once every job has run
+	alignas(64) std::atomic<u64> m_queued;
+	alignas(64) std::atomic<u64> m_done;
+
+	// Parallel task, items are claimed with m_task_next.  m_task_users counts the workers
+	// that may be looking at it, it is not reused before they are gone.
+	const std::function<void(int)>* m_task;
+	std::atomic<int> m_task_count;
+	alignas(64) std::atomic<int> m_task_next;
+	alignas(64) std::atomic<int> m_task_done;
+	std::atomic<int> m_task_users;
+	std::atomic<bool> m_task_active;
+
+	std::atomic<bool> m_exit;
+	GSEventCount m_notempty;	// jobs queued, task started (or exiting)
+	GSEventCount m_empty;		// jobs done, after each batch, task items done
+
+	GSRasterizerList(int threads, GSDrawArena* arena);
+
+	void ThreadProc(int id);
+	bool RunBand(int id, int band);
+	void RunTask();
+	bool HasTask() const;
+	void Push(int band, const Job& job);
 
 public:
 	virtual ~GSRasterizerList();
 
-	template<class DS> static IRasterizer* Create(int threads)
+	template<class DS> static IRasterizer* Create(int threads, GSDrawArena* arena)
 	{
 		threads = std::max<int>(threads, 0);
 
@@ -186,14 +247,18 @@ public:
 			return new GSRasterizer(new DS(), 0, 1);
 		}
 
-		GSRasterizerList* rl = new GSRasterizerList(threads);
+		GSRasterizerList* rl = new GSRasterizerList(threads, arena);
+
+		// Bands are enforced through the scissor, so every rasterizer sees the whole screen
+		for(int i = 0; i < threads; i++)
+		{
+			rl->m_r.push_back(std::unique_ptr<GSRasterizer>(new GSRasterizer(new DS(), 0, 1)));
+		}
 
+		// Worker threads depend on the rasterizers, so start them last.
 		for(int i = 0; i < threads; i++)
 		{
-			rl->m_r.push_back(std::unique_ptr<GSRasterizer>(new GSRasterizer(new DS(), i, threads)));
-			auto &r = *rl->m_r[i];
-			rl->m_workers.push_back(std::unique_ptr<GSWorker>(new GSWorker(
-				[&r](std::shared_ptr<GSRasterizerData> &item) { r.Draw(item.get()); })));
+			rl->m_workers.push_back(std::thread(&GSRasterizerList::ThreadProc, rl, i));
 		}
 
 		return rl;
@@ -204,5 +269,8 @@ public:
 	void Queue(const std::shared_ptr<GSRasterizerData>& data);
 	void Sync();
 	bool IsSynced() const;
+	void SyncUntil(const std::function<bool()>& done);
+	void Parallel(int count, const std::function<void(int)>& func);
 	int GetPixels(bool reset);
+	void Prewarm();
 };
@@ -22,12 +22,31 @@
 #include "Pcsx2Types.h"
 
 #include "GSRendererSW.h"
+#include "options_tools.h"
+
+#include <chrono>
 
 GSVector4 GSRendererSW::m_pos_scale;
 #if _M_SSE >= 0x501
 GSVector8 GSRendererSW::m_pos_scale2;
 #endif
 
+// Keys of the generated scanline/setup functions are kept in the frontend save directory,
+// one file per game, see GSCodeGeneratorCache.
+static std::string GetCodeCacheFile(u32 crc)
+{
+	const char* dir = NULL;
+
+	if(environ_cb == NULL || !environ_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &dir) || dir == NULL)
+		return {};
+
+	char name[32];
+
+	snprintf(name, sizeof(name), "/pcsx2/gs_jit_%08X.cache", crc);
+
+	return std::string(dir) + name;
+}
+
 void GSRendererSW::InitVectors()
 {
 	m_pos_scale = GSVector4(1.0f / 16, 1.0f / 16, 1.0f, 128.0f);
@@ -46,7 +65,10 @@ GSRendererSW::GSRendererSW(int threads)
 
 	memset(m_texture, 0, sizeof(m_texture));
 
-	m_rl = GSRasterizerList::Create<GSDrawScanline>(threads);
+	m_rl = GSRasterizerList::Create<GSDrawScanline>(threads, &m_arena);
+
+	// the code cache of the game is loaded by SetGameCRC
+	GSCodeGeneratorCache::Get().Clear();
 
 	m_output = (u8*)_aligned_malloc(1024 * 1024 * sizeof(u32), 32);
 
@@ -57,6 +79,16 @@ GSRendererSW::GSRendererSW(int threads)
 		m_tex_pages[i] = 0;
 	}
 
+	memset(&m_sync_stats, 0, sizeof(m_sync_stats));
+	memset(&m_sync_stats_frame, 0, sizeof(m_sync_stats_frame));
+	memset(&m_sync_stats_total, 0, sizeof(m_sync_stats_total));
+	m_sync_frames = 0;
+
+	m_decode_time = 0;
+	m_decode_time_frame = 0;
+	m_decode_time_total = 0;
+	m_decode_time_max = 0;
+
 	#define InitCVB2(P, Q) \
 		m_cvb[P][0][0][Q] = &GSRendererSW::ConvertVertexBuffer<P, 0, 0, Q>; \
 		m_cvb[P][0][1][Q] = &GSRendererSW::ConvertVertexBuffer<P, 0, 1, Q>; \
@@ -92,6 +124,39 @@ GSRendererSW::~GSRendererSW()
 	delete m_rl;
 
 	_aligned_free(m_output);
+
+	GSCodeGeneratorCache& cache = GSCodeGeneratorCache::Get();
+	GSCodeGeneratorCache::Stats stats = cache.GetStats();
+
+	log_cb(RETRO_LOG_INFO, "GS: %llu JIT functions generated (%llu prewarmed) in %.1f ms, slowest %.2f ms\n",
+		(unsigned long long)stats.generated, (unsigned long long)stats.prewarmed,
+		stats.microseconds / 1000.0, stats.max_microseconds / 1000.0);
+
+	if(!m_code_cache_file.empty())
+		cache.Save(m_code_cache_file);
+
+	const GSDrawArena::Stats& arena = m_arena.GetStats();
+
+	log_cb(RETRO_LOG_INFO, "GS: %llu draws, %llu allocations (%.1f MB) from the draw arena, %llu chunks allocated, "
+		"peak %.1f MB per frame, %llu of %llu recycles deferred\n",
+		(unsigned long long)arena.objects, (unsigned long long)arena.allocs, arena.bytes / 1048576.0,
+		(unsigned long long)arena.chunks, arena.peak / 1048576.0,
+		(unsigned long long)arena.deferred, (unsigned long long)(arena.recycles + arena.deferred));
+
+	for(int i = 0; i < SyncReasons; i++)
+	{
+		u64 full = m_sync_stats_total.full[i];
+		u64 pages = m_sync_stats_total.pages[i];
+
+		if(full == 0 && pages == 0) continue;
+
+		log_cb(RETRO_LOG_INFO, "GS: sync reason %d, %llu full syncs, %llu page waits (%.2f/%.2f per frame)\n", i - 1,
+			(unsigned long long)full, (unsigned long long)pages,
+			(double)full / std::max<u64>(m_sync_frames, 1), (double)pages / std::max<u64>(m_sync_frames, 1));
+	}
+
+	log_cb(RETRO_LOG_INFO, "GS: texture decoding took %.3f ms per frame, at most %.3f ms\n",
+		m_decode_time_total / 1000000.0 / std::max<u64>(m_sync_frames, 1), m_decode_time_max / 1000000.0);
 }
 
 void GSRendererSW::Reset()
@@ -103,9 +168,62 @@ void GSRendererSW::Reset()
 	GSRenderer::Reset();
 }
 
+void GSRendererSW::SetGameCRC(u32 crc, int options)
+{
+	GSRenderer::SetGameCRC(crc, options);
+
+	std::string file = GetCodeCacheFile(crc);
+
+	if(file == m_code_cache_file)
+		return;
+
+	// the functions of the previous game (the bios until the elf is known) are saved to its
+	// own file, and the ones of this game are generated now, rather than on their first draw
+
+	Sync(-1);
+
+	GSCodeGeneratorCache& cache = GSCodeGeneratorCache::Get();
+
+	if(!m_code_cache_file.empty())
+		cache.Save(m_code_cache_file);
+
+	m_code_cache_file = file;
+
+	if(!file.empty() && cache.Load(file))
+	{
+		GSCodeGeneratorCache::Stats before = cache.GetStats();
+
+		m_rl->Prewarm();
+
+		GSCodeGeneratorCache::Stats stats = cache.GetStats();
+
+		log_cb(RETRO_LOG_INFO, "GS: prewarmed %llu JIT functions for %08X in %.1f ms\n",
+			(unsigned long long)(stats.prewarmed - before.prewarmed), crc, (stats.microseconds - before.microseconds) / 1000.0);
+	}
+}
+
 void GSRendererSW::VSync(int field)
 {
 	Sync(0); // IncAge might delete a cached texture in use
+	m_arena.Recycle();
+
+	m_sync_stats_frame = m_sync_stats;
+
+	for(int i = 0; i < SyncReasons; i++)
+	{
+		m_sync_stats_total.full[i] += m_sync_stats.full[i];
+		m_sync_stats_total.pages[i] += m_sync_stats.pages[i];
+	}
+
+	m_sync_frames++;
+
+	memset(&m_sync_stats, 0, sizeof(m_sync_stats));
+
+	m_decode_time_frame = m_decode_time;
+	m_decode_time_total += m_decode_time;
+	m_decode_time_max = std::max(m_decode_time_max, m_decode_time);
+	m_decode_time = 0;
+
 	GSRenderer::VSync(field);
 	m_tc->IncAge();
 }
@@ -260,15 +378,21 @@ void GSRendererSW::Draw()
 {
 	const GSDrawingContext* context = m_context;
 
-	SharedData* sd = new SharedData(this);
+	// a frame with that many draws doesn't wait for the vsync once the rasterizers are done
+
+	if(m_arena.GetUsed() >= MaxArenaSize && m_rl->IsSynced())
+	{
+		m_arena.Recycle();
+	}
 
-	std::shared_ptr<GSRasterizerData> data(sd);
+	std::shared_ptr<GSRasterizerData> data = std::allocate_shared<SharedData>(GSDrawArena::Allocator<SharedData>(&m_arena), this);
+
+	SharedData* sd = (SharedData*)data.get();
 
 	sd->primclass = m_vt.m_primclass;
-	sd->buff = (u8*)_aligned_malloc(sizeof(GSVertexSW) * ((m_vertex.next + 1) & ~1) + sizeof(u32) * m_index.tail, 64);
-	sd->vertex = (GSVertexSW*)sd->buff;
+	sd->vertex = (GSVertexSW*)m_arena.Allocate(sizeof(GSVertexSW) * ((m_vertex.next + 1) & ~1) + sizeof(u32) * m_index.tail, 64);
 	sd->vertex_count = m_vertex.next;
-	sd->index = (u32*)(sd->buff + sizeof(GSVertexSW) * ((m_vertex.next + 1) & ~1));
+	sd->index = (u32*)(sd->vertex + ((m_vertex.next + 1) & ~1));
 	sd->index_count = m_index.tail;
 
 	// skip per pixel division if q is constant.
@@ -319,19 +443,15 @@ void GSRendererSW::Draw()
 		zb_pages = m_context->offset.zb->GetPages(r);
 	}
 
+	// wait for the queued draws this one depends on, before it addrefs the same pages
+
 	// check if there is an overlap between this and previous targets
 
-	if(CheckTargetPages(fb_pages, zb_pages, r))
-	{
-		sd->m_syncpoint = SharedData::SyncTarget;
-	}
+	CheckTargetPages(fb_pages, zb_pages, r);
 
 	// check if the texture is not part of a target currently in use
 
-	if(CheckSourcePages(sd))
-	{
-		sd->m_syncpoint = SharedData::SyncSource;
-	}
+	CheckSourcePages(sd);
 
 	// addref source and target pages
 
@@ -348,20 +468,10 @@ void GSRendererSW::Queue(std::shared_ptr<GSRasterizerData>& item)
 {
 	SharedData* sd = (SharedData*)item.get();
 
-	if(sd->m_syncpoint == SharedData::SyncSource) 
-	{
-		Sync(4);
-	}
-
 	// update previously invalidated parts
 
 	sd->UpdateSource();
 
-	if(sd->m_syncpoint == SharedData::SyncTarget)
-	{
-		Sync(5);
-	}
-
 	m_rl->Queue(item);
 
 	// invalidate new parts rendered onto
@@ -381,7 +491,38 @@ void GSRendererSW::Queue(std::shared_ptr<GSRasterizerData>& item)
 
 void GSRendererSW::Sync(int reason)
 {
-	m_rl->Sync();
+	if(!m_rl->IsSynced())
+	{
+		m_sync_stats.full[reason + 1]++;
+
+		m_rl->Sync();
+	}
+}
+
+// Waits for the queued draws that use any of these pages as a target, or also as a texture
+// with tex, the other ones keep running.  No draw gets queued meanwhile, so the page counts
+// only go down.
+void GSRendererSW::SyncPages(const u32* pages, bool tex, int reason)
+{
+	if(IsUsingPages(pages, tex))
+	{
+		m_sync_stats.pages[reason + 1]++;
+
+		m_rl->SyncUntil([this, pages, tex]() {return !IsUsingPages(pages, tex);});
+	}
+}
+
+bool GSRendererSW::IsUsingPages(const u32* pages, bool tex) const
+{
+	for(const u32* RESTRICT p = pages; *p != GSOffset::EOP; p++)
+	{
+		if(m_fzb_pages[*p] || (tex && m_tex_pages[*p]))
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void GSRendererSW::InvalidateVideoMem(const GIFRegBITBLTBUF& BITBLTBUF, const GSVector4i& r)
@@ -390,19 +531,11 @@ void GSRendererSW::InvalidateVideoMem(const GIFRegBITBLTBUF& BITBLTBUF, const GS
 
 	off->GetPages(r, m_tmp_pages);
 
-	// check if the changing pages either used as a texture or a target
+	// wait for the draws using the changing pages either as a texture or a target
 
 	if(!m_rl->IsSynced())
 	{
-		for(u32* RESTRICT p = m_tmp_pages; *p != GSOffset::EOP; p++)
-		{
-			if(m_fzb_pages[*p] | m_tex_pages[*p])
-			{
-				Sync(6);
-
-				break;
-			}
-		}
+		SyncPages(m_tmp_pages, true, 6);
 	}
 
 	m_tc->InvalidatePages(m_tmp_pages, off->psm); // if texture update runs on a thread and Sync(5) happens then this must come later
@@ -416,15 +549,7 @@ void GSRendererSW::InvalidateLocalMem(const GIFRegBITBLTBUF& BITBLTBUF, const GS
 
 		off->GetPages(r, m_tmp_pages);
 
-		for(u32* RESTRICT p = m_tmp_pages; *p != GSOffset::EOP; p++)
-		{
-			if(m_fzb_pages[*p])
-			{
-				Sync(7);
-
-				break;
-			}
-		}
+		SyncPages(m_tmp_pages, false, 7);
 	}
 }
 
@@ -470,14 +595,31 @@ void GSRendererSW::ReleasePages(const u32* pages, const int type)
 	}
 }
 
-bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, const GSVector4i& r)
+void GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, const GSVector4i& r)
 {
 	bool synced = m_rl->IsSynced();
 
 	bool fb = fb_pages != NULL;
 	bool zb = zb_pages != NULL;
 
-	bool res = false;
+	// the pages the queued draws are still using in a conflicting way, only those are waited for
+
+	u32 conflict[MAX_PAGES / 32] = {};
+	u32* RESTRICT busy = m_tmp_pages;
+	int n = 0;
+
+	auto add = [&](u32 i)
+	{
+		u32 row = i >> 5;
+		u32 col = 1 << (i & 31);
+
+		if((conflict[row] & col) == 0)
+		{
+			conflict[row] |= col;
+
+			busy[n++] = i;
+		}
+	};
 
 	if(m_fzb != m_context->offset.fzb4)
 	{
@@ -491,8 +633,6 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 
 		memset(m_fzb_cur_pages, 0, sizeof(m_fzb_cur_pages));
 
-		u32 used = 0;
-
 		for(const u32* p = fb_pages; *p != GSOffset::EOP; p++)
 		{
 			u32 i = *p;
@@ -502,8 +642,7 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 
 			m_fzb_cur_pages[row] |= col;
 
-			used |= m_fzb_pages[i];
-			used |= m_tex_pages[i];
+			if(!synced && (m_fzb_pages[i] | m_tex_pages[i])) add(i);
 		}
 
 		for(const u32* p = zb_pages; *p != GSOffset::EOP; p++)
@@ -515,14 +654,7 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 
 			m_fzb_cur_pages[row] |= col;
 
-			used |= m_fzb_pages[i];
-			used |= m_tex_pages[i];
-		}
-
-		if(!synced)
-		{
-			if(used)
-				res = true;
+			if(!synced && (m_fzb_pages[i] | m_tex_pages[i])) add(i);
 		}
 	}
 	else
@@ -542,8 +674,6 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 			if(fb_pages == NULL) fb_pages = m_context->offset.fb->GetPages(r);
 			if(zb_pages == NULL) zb_pages = m_context->offset.zb->GetPages(r);
 
-			u32 used = 0;
-
 			for(const u32* p = fb_pages; *p != GSOffset::EOP; p++)
 			{
 				u32 i = *p;
@@ -555,7 +685,7 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 				{
 					m_fzb_cur_pages[row] |= col;
 
-					used |= m_fzb_pages[i];
+					if(!synced && m_fzb_pages[i]) add(i);
 				}
 			}
 
@@ -570,15 +700,9 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 				{
 					m_fzb_cur_pages[row] |= col;
 
-					used |= m_fzb_pages[i];
+					if(!synced && m_fzb_pages[i]) add(i);
 				}
 			}
-
-			if(!synced)
-			{
-				if(used)
-					res = true;
-			}
 		}
 
 		if(!synced)
@@ -586,62 +710,54 @@ bool GSRendererSW::CheckTargetPages(const u32* fb_pages, const u32* zb_pages, co
 			// chross-check frame and z-buffer pages, they cannot overlap with eachother and with previous batches in queue,
 			// have to be careful when the two buffers are mutually enabled/disabled and alternating (Bully FBP/ZBP = 0x2300)
 
-			if(fb && !res)
+			if(fb)
 			{
 				for(const u32* p = fb_pages; *p != GSOffset::EOP; p++)
 				{
-					if(m_fzb_pages[*p] & 0xffff0000)
-					{
-						res = true;
-						break;
-					}
+					if(m_fzb_pages[*p] & 0xffff0000) add(*p);
 				}
 			}
 
-			if(zb && !res)
+			if(zb)
 			{
 				for(const u32* p = zb_pages; *p != GSOffset::EOP; p++)
 				{
-					if(m_fzb_pages[*p] & 0x0000ffff)
-					{
-						res = true;
-
-						break;
-					}
+					if(m_fzb_pages[*p] & 0x0000ffff) add(*p);
 				}
 			}
 		}
 	}
 
+	if(n > 0)
+	{
+		busy[n] = GSOffset::EOP;
+
+		SyncPages(busy, true, 5);
+	}
+
 	if(!fb && fb_pages != NULL) delete [] fb_pages;
 	if(!zb && zb_pages != NULL) delete [] zb_pages;
-
-	return res;
 }
 
-bool GSRendererSW::CheckSourcePages(SharedData* sd)
+void GSRendererSW::CheckSourcePages(SharedData* sd)
 {
 	if(!m_rl->IsSynced())
 	{
 		for(size_t i = 0; sd->m_tex[i].t != NULL; i++)
 		{
-			sd->m_tex[i].t->m_offset->GetPages(sd->m_tex[i].r, m_tmp_pages);
+			GSTextureCacheSW::Texture* t = sd->m_tex[i].t;
 
-			u32* pages = m_tmp_pages; // sd->m_tex[i].t->m_pages.n;
+			t->m_offset->GetPages(sd->m_tex[i].r, m_tmp_pages);
 
-			for(const u32* p = pages; *p != GSOffset::EOP; p++)
-			{
-				// TODO: 8H 4HL 4HH texture at the same place as the render target (24 bit, or 32-bit where the alpha channel is masked, Valkyrie Profile 2)
+			// TODO: 8H 4HL 4HH texture at the same place as the render target (24 bit, or 32-bit where the alpha channel is masked, Valkyrie Profile 2)
 
-				if(m_fzb_pages[*p]) // currently being drawn to? => sync
-				{
-					return true;
-				}
-			}
+			// wait for the draws currently drawing to these pages, and when UpdateSource is going to
+			// rewrite the invalid blocks of m_buff in place, also for the draws still sampling them
+			// (a finished writer does not mean the earlier readers on the other bands are done)
+
+			SyncPages(m_tmp_pages, !t->m_complete, 4);
 		}
 	}
-
-	return false;
 }
 
 #include "GSTextureSW.h"
@@ -742,7 +858,7 @@ bool GSRendererSW::GetScanlineGlobalData(SharedData* data)
 			{
 				gd.sel.tlu = 1;
 
-				gd.clut = (u32*)_aligned_malloc(sizeof(u32) * 256, 32); // FIXME: might address uninitialized data of the texture (0xCD) that is not in 0-15 range for 4-bpp formats
+				gd.clut = (u32*)m_arena.Allocate(sizeof(u32) * 256, 32); // FIXME: might address uninitialized data of the texture (0xCD) that is not in 0-15 range for 4-bpp formats
 
 				memcpy(gd.clut, (const u32*)m_mem.m_clut, sizeof(u32) * GSLocalMemory::m_psm[context->TEX0.PSM].pal);
 			}
@@ -1011,7 +1127,7 @@ bool GSRendererSW::GetScanlineGlobalData(SharedData* data)
 		{
 			gd.sel.dthe = 1;
 
-			gd.dimx = (GSVector4i*)_aligned_malloc(sizeof(env.dimx), 32);
+			gd.dimx = (GSVector4i*)m_arena.Allocate(sizeof(env.dimx), 32);
 
 			memcpy(gd.dimx, env.dimx, sizeof(env.dimx));
 		}
@@ -1115,7 +1231,6 @@ GSRendererSW::SharedData::SharedData(GSRendererSW* parent)
 	, m_fpsm(0)
 	, m_zpsm(0)
 	, m_using_pages(false)
-	, m_syncpoint(SyncNone)
 {
 	m_tex[0].t = NULL;
 
@@ -1129,8 +1244,7 @@ GSRendererSW::SharedData::~SharedData()
 {
 	ReleasePages();
 
-	if(global.clut) _aligned_free(global.clut);
-	if(global.dimx) _aligned_free(global.dimx);
+	// the buffers belong to m_parent->m_arena
 }
 
 //static TransactionScope::Lock s_lock;
@@ -1210,9 +1324,11 @@ void GSRendererSW::SharedData::SetSource(GSTextureCacheSW::Texture* t, const GSV
 
 void GSRendererSW::SharedData::UpdateSource()
 {
+	auto start = std::chrono::steady_clock::now();
+
 	for(size_t i = 0; m_tex[i].t != NULL; i++)
 	{
-		if(m_tex[i].t->Update(m_tex[i].r))
+		if(m_tex[i].t->Update(m_tex[i].r, m_parent->m_rl))
 		{
 			global.tex[i] = m_tex[i].t->m_buff;
 		}
@@ -1222,4 +1338,6 @@ void GSRendererSW::SharedData::UpdateSource()
 			global.sel.tfx = TFX_NONE;
 		}
 	}
+
+	m_parent->m_decode_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 }
@@ -25,6 +25,7 @@
 
 #include "GSTextureCacheSW.h"
 #include "GSDrawScanline.h"
+#include "GSDrawArena.h"
 
 class GSRendererSW : public GSRenderer
 {
@@ -49,7 +50,6 @@ class GSRendererSW : public GSRenderer
 		int m_zpsm;
 		bool m_using_pages;
 		TextureLevel m_tex[7 + 1]; // NULL terminated
-		enum {SyncNone, SyncSource, SyncTarget} m_syncpoint;
 
 	public:
 		SharedData(GSRendererSW* parent);
@@ -69,8 +69,23 @@ class GSRendererSW : public GSRenderer
 	template<u32 primclass, u32 tme, u32 fst, u32 q_div>
 	void ConvertVertexBuffer(GSVertexSW* RESTRICT dst, const GSVertex* RESTRICT src, size_t count);
 
+public:
+	// Sync reasons: -1 reset, 0 vsync, 1 output, 4 texture written by a queued draw,
+	// 5 target used by a queued draw, 6 host to local transfer, 7 local to host transfer
+	enum {SyncReasons = 9};
+
+	struct SyncStats
+	{
+		u64 full[SyncReasons];	// waited for the rasterizers to be done, by reason + 1
+		u64 pages[SyncReasons];	// waited for the draws using some pages
+	};
+
 protected:
+	static const size_t MaxArenaSize = 256 * 1024 * 1024;
+
+	GSDrawArena m_arena;
 	IRasterizer* m_rl;
+	std::string m_code_cache_file;
 	GSTextureCacheSW* m_tc;
 	GSTexture* m_texture[2];
 	u8* m_output;
@@ -80,8 +95,17 @@ protected:
 	std::atomic<u32> m_fzb_pages[512]; // uint16 frame/zbuf pages interleaved
 	std::atomic<u16> m_tex_pages[512];
 	u32 m_tmp_pages[512 + 1];
+	SyncStats m_sync_stats;			// current frame
+	SyncStats m_sync_stats_frame;	// last frame
+	SyncStats m_sync_stats_total;
+	u64 m_sync_frames;
+	u64 m_decode_time;			// ns spent updating textures, current frame
+	u64 m_decode_time_frame;	// last frame
+	u64 m_decode_time_total;
+	u64 m_decode_time_max;		// of a frame
 
 	void Reset();
+	void SetGameCRC(u32 crc, int options);
 	void VSync(int field);
 	void ResetDevice();
 	GSTexture* GetOutput(int i, int& y_offset);
@@ -90,20 +114,25 @@ protected:
 	void Draw();
 	void Queue(std::shared_ptr<GSRasterizerData>& item);
 	void Sync(int reason);
+	void SyncPages(const u32* pages, bool tex, int reason);
+	bool IsUsingPages(const u32* pages, bool tex) const;
 	void InvalidateVideoMem(const GIFRegBITBLTBUF& BITBLTBUF, const GSVector4i& r);
 	void InvalidateLocalMem(const GIFRegBITBLTBUF& BITBLTBUF, const GSVector4i& r, bool clut = false);
 
 	void UsePages(const u32* pages, const int type);
 	void ReleasePages(const u32* pages, const int type);
 
-	bool CheckTargetPages(const u32* fb_pages, const u32* zb_pages, const GSVector4i& r);
-	bool CheckSourcePages(SharedData* sd);
+	void CheckTargetPages(const u32* fb_pages, const u32* zb_pages, const GSVector4i& r);
+	void CheckSourcePages(SharedData* sd);
 
 	bool GetScanlineGlobalData(SharedData* data);
 
 public:
 	static void InitVectors();
 
+	const SyncStats& GetSyncStats() const {return m_sync_stats_frame;}
+	u64 GetDecodeTime() const {return m_decode_time_frame;}
+
 	GSRendererSW(int threads);
 	virtual ~GSRendererSW();
 };
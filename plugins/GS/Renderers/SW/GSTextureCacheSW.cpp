@@ -20,6 +20,7 @@
  */
 
 #include "GSTextureCacheSW.h"
+#include "GSRasterizer.h"
 
 GSTextureCacheSW::GSTextureCacheSW(GSState* state)
 	: m_state(state)
@@ -188,7 +189,7 @@ GSTextureCacheSW::Texture::~Texture()
 	}
 }
 
-bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect)
+bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect, IRasterizer* rl)
 {
 	if(m_complete)
 	{
@@ -246,6 +247,19 @@ bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect)
 
 	shift += 3;
 
+	// Large updates (movies, full screen backgrounds) are split into pages, which are decoded
+	// by the rasterizer threads and this one.  The blocks to decode are picked here, m_valid
+	// is only touched by this thread.
+
+	std::vector<GSVector2i> list; // block, offset in m_buff
+
+	bool parallel = rl != NULL && ((r.width() + bs.x - 1) / bs.x) * ((r.height() + bs.y - 1) / bs.y) >= ParallelBlocks;
+
+	if(parallel)
+	{
+		list.reserve(((r.width() + bs.x - 1) / bs.x) * ((r.height() + bs.y - 1) / bs.y));
+	}
+
 	if(m_repeating)
 	{
 		for(int y = r.top; y < r.bottom; y += bs.y, dst += block_pitch)
@@ -263,7 +277,10 @@ bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect)
 				{
 					m_valid[row] |= col;
 
-					(mem.*rtxbP)(block, &dst[x << shift], pitch, m_TEXA);
+					if(parallel)
+						list.push_back(GSVector2i(block, (int)(&dst[x << shift] - (u8*)m_buff)));
+					else
+						(mem.*rtxbP)(block, &dst[x << shift], pitch, m_TEXA);
 
 					blocks++;
 				}
@@ -287,7 +304,10 @@ bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect)
 				{
 					m_valid[row] |= col;
 
-					(mem.*rtxbP)(block, &dst[x << shift], pitch, m_TEXA);
+					if(parallel)
+						list.push_back(GSVector2i(block, (int)(&dst[x << shift] - (u8*)m_buff)));
+					else
+						(mem.*rtxbP)(block, &dst[x << shift], pitch, m_TEXA);
 
 					blocks++;
 				}
@@ -295,6 +315,19 @@ bool GSTextureCacheSW::Texture::Update(const GSVector4i& rect)
 		}
 	}
 
+	if(!list.empty())
+	{
+		const int pages = (int)(list.size() + 31) / 32;
+
+		rl->Parallel(pages, [&](int i)
+		{
+			for(size_t j = i * 32, end = std::min<size_t>(j + 32, list.size()); j < end; j++)
+			{
+				(mem.*rtxbP)(list[j].x, (u8*)m_buff + list[j].y, pitch, m_TEXA);
+			}
+		});
+	}
+
 	return true;
 }
 
@@ -28,12 +28,16 @@
 #include "../Common/GSRenderer.h"
 #include "../Common/GSFastList.h"
 
+class IRasterizer;
+
 class GSTextureCacheSW
 {
 public:
 	class Texture
 	{
 	public:
+		static const int ParallelBlocks = 256; // at least 8 pages to decode
+
 		GSState* m_state;
 		GSOffset* m_offset;
 		GIFRegTEX0 m_TEX0;
@@ -56,7 +60,8 @@ public:
 		Texture(GSState* state, u32 tw0, const GIFRegTEX0& TEX0, const GIFRegTEXA& TEXA);
 		virtual ~Texture();
 
-		bool Update(const GSVector4i& r);
+		// With rl, large updates are decoded on its threads too
+		bool Update(const GSVector4i& r, IRasterizer* rl = NULL);
 		bool Save(const std::string& fn, bool dds = false) const;
 	};
 
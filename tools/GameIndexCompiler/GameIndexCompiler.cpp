@@ -0,0 +1,290 @@
+/*  PCSX2 - PS2 Emulator for PCs
+ *  Copyright (C) 2002-2021  PCSX2 Dev Team
+ *
+ *  PCSX2 is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU Lesser General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  PCSX2 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with PCSX2.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// GameIndexCompiler - compiles GameIndex.yaml into the table read by BinaryGameDatabaseImpl,
+// see pcsx2/GameDatabaseBinary.h for the layout.
+//
+//   GameIndexCompiler <GameIndex.yaml> <output.h|output.bin> [symbol]
+//
+// A .h output is a C array named 'symbol' (GameIndex_bin by default) along with its
+// length, the same way xxd -i embeds the other resources.  Anything else is written as is.
+//
+// Gamefix and speedhack names are not checked here since they are only known to the core,
+// the core validates them when it looks an entry up.
+
+#include "GameDatabaseBinary.h"
+
+#include "yaml-cpp/yaml.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static std::string strToLower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(),
+		[](unsigned char c) { return std::tolower(c); });
+	return str;
+}
+
+class GameIndexWriter
+{
+	std::vector<GameIndexBin::Entry> m_entries;
+	std::vector<uint32_t> m_refs;
+	std::string m_strings;
+	std::unordered_map<std::string, uint32_t> m_interned;
+
+public:
+	GameIndexWriter()
+	{
+		m_strings.push_back('\0');
+		m_interned[""] = 0;
+	}
+
+	uint32_t Intern(const std::string& str)
+	{
+		auto it = m_interned.find(str);
+		if (it != m_interned.end())
+			return it->second;
+
+		const uint32_t offset = m_strings.size();
+		m_strings.append(str.c_str(), str.size() + 1);
+		m_interned.emplace(str, offset);
+		return offset;
+	}
+
+	GameIndexBin::List AddList(const std::vector<uint32_t>& refs)
+	{
+		GameIndexBin::List list = {(uint32_t)m_refs.size(), 0};
+		m_refs.insert(m_refs.end(), refs.begin(), refs.end());
+		return list;
+	}
+
+	GameIndexBin::List AddStrings(const std::vector<std::string>& strings)
+	{
+		std::vector<uint32_t> refs;
+		for (const std::string& str : strings)
+			refs.push_back(Intern(str));
+
+		GameIndexBin::List list = AddList(refs);
+		list.count = strings.size();
+		return list;
+	}
+
+	void AddEntry(const GameIndexBin::Entry& entry) { m_entries.push_back(entry); }
+
+	size_t GetEntryCount() const { return m_entries.size(); }
+	size_t GetStringCount() const { return m_interned.size(); }
+
+	std::vector<uint8_t> Build()
+	{
+		std::sort(m_entries.begin(), m_entries.end(), [this](const GameIndexBin::Entry& a, const GameIndexBin::Entry& b) {
+			return strcmp(&m_strings[a.serial], &m_strings[b.serial]) < 0;
+		});
+
+		GameIndexBin::Header header = {};
+		header.magic = GameIndexBin::Magic;
+		header.version = GameIndexBin::Version;
+		header.entryCount = m_entries.size();
+		header.entriesOffset = sizeof(header);
+		header.refCount = m_refs.size();
+		header.refsOffset = header.entriesOffset + m_entries.size() * sizeof(GameIndexBin::Entry);
+		header.stringsSize = m_strings.size();
+		header.stringsOffset = header.refsOffset + m_refs.size() * sizeof(uint32_t);
+
+		std::vector<uint8_t> out(header.stringsOffset + header.stringsSize);
+		memcpy(&out[0], &header, sizeof(header));
+		if (!m_entries.empty())
+			memcpy(&out[header.entriesOffset], m_entries.data(), m_entries.size() * sizeof(GameIndexBin::Entry));
+		if (!m_refs.empty())
+			memcpy(&out[header.refsOffset], m_refs.data(), m_refs.size() * sizeof(uint32_t));
+		memcpy(&out[header.stringsOffset], m_strings.data(), m_strings.size());
+		return out;
+	}
+};
+
+static std::vector<std::string> convertMultiLineStringToVector(const std::string& multiLineString)
+{
+	std::vector<std::string> lines;
+	std::istringstream stream(multiLineString);
+	std::string line;
+	while (std::getline(stream, line))
+		lines.push_back(line);
+	return lines;
+}
+
+// Mirrors entryFromYaml in pcsx2/GameDatabase.cpp.
+static GameIndexBin::Entry entryFromYaml(GameIndexWriter& writer, const std::string& serial, const YAML::Node& node)
+{
+	GameIndexBin::Entry entry = {};
+	entry.serial = writer.Intern(serial);
+	entry.eeRoundMode = entry.vuRoundMode = -1;
+	entry.eeClampMode = entry.vuClampMode = -1;
+
+	try
+	{
+		entry.name = writer.Intern(node["name"].as<std::string>(""));
+		entry.region = writer.Intern(node["region"].as<std::string>(""));
+		entry.compat = node["compat"].as<int>(0);
+		if (YAML::Node roundModeNode = node["roundModes"])
+		{
+			entry.eeRoundMode = roundModeNode["eeRoundMode"].as<int>(-1);
+			entry.vuRoundMode = roundModeNode["vuRoundMode"].as<int>(-1);
+		}
+		if (YAML::Node clampModeNode = node["clampModes"])
+		{
+			entry.eeClampMode = clampModeNode["eeClampMode"].as<int>(-1);
+			entry.vuClampMode = clampModeNode["vuClampMode"].as<int>(-1);
+		}
+
+		entry.gameFixes = writer.AddStrings(node["gameFixes"].as<std::vector<std::string>>(std::vector<std::string>()));
+
+		if (YAML::Node speedHacksNode = node["speedHacks"])
+		{
+			std::vector<uint32_t> refs;
+			for (const auto& hack : speedHacksNode)
+			{
+				refs.push_back(writer.Intern(hack.first.as<std::string>()));
+				refs.push_back((uint32_t)hack.second.as<int>());
+			}
+			entry.speedHacks = writer.AddList(refs);
+			entry.speedHacks.count = refs.size() / 2;
+		}
+
+		entry.memcardFilters = writer.AddStrings(node["memcardFilters"].as<std::vector<std::string>>(std::vector<std::string>()));
+
+		if (YAML::Node patches = node["patches"])
+		{
+			std::unordered_set<std::string> crcs;
+			std::vector<uint32_t> refs;
+			for (const auto& patch : patches)
+			{
+				std::string crc = strToLower(patch.first.as<std::string>());
+				if (!crcs.insert(crc).second)
+				{
+					fprintf(stderr, "Duplicate CRC '%s' found for serial: '%s'. Skipping, CRCs are case-insensitive!\n", crc.c_str(), serial.c_str());
+					continue;
+				}
+				YAML::Node patchNode = patch.second;
+
+				const uint32_t author = writer.Intern(patchNode["author"].as<std::string>(""));
+				const GameIndexBin::List lines = writer.AddStrings(convertMultiLineStringToVector(patchNode["content"].as<std::string>("")));
+				refs.insert(refs.end(), {writer.Intern(crc), author, lines.first, lines.count});
+			}
+			entry.patches = writer.AddList(refs);
+			entry.patches.count = refs.size() / 4;
+		}
+	}
+	catch (const YAML::RepresentationException& e)
+	{
+		fprintf(stderr, "Invalid GameDB syntax detected on serial: '%s'. Error Details - %s\n", serial.c_str(), e.msg.c_str());
+		entry.flags |= GameIndexBin::Entry_Invalid;
+	}
+	return entry;
+}
+
+static bool writeHeader(const std::string& filename, const std::string& symbol, const std::vector<uint8_t>& data)
+{
+	FILE* fp = fopen(filename.c_str(), "w");
+	if (!fp)
+		return false;
+
+	fprintf(fp, "// Generated by GameIndexCompiler, do not edit.\n\n");
+	fprintf(fp, "alignas(8) const unsigned char %s[] = {", symbol.c_str());
+	for (size_t i = 0; i < data.size(); i++)
+		fprintf(fp, "%s0x%02x,", (i % 16) ? " " : "\n  ", data[i]);
+	fprintf(fp, "\n};\n");
+	fprintf(fp, "const unsigned int %s_len = %zu;\n", symbol.c_str(), data.size());
+
+	return fclose(fp) == 0;
+}
+
+static bool writeBinary(const std::string& filename, const std::vector<uint8_t>& data)
+{
+	FILE* fp = fopen(filename.c_str(), "wb");
+	if (!fp)
+		return false;
+
+	const bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+	return fclose(fp) == 0 && ok;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s <GameIndex.yaml> <output.h|output.bin> [symbol]\n", argv[0]);
+		return 1;
+	}
+
+	const std::string input = argv[1];
+	const std::string output = argv[2];
+	const std::string symbol = argc > 3 ? argv[3] : "GameIndex_bin";
+
+	GameIndexWriter writer;
+	try
+	{
+		std::ifstream stream(input);
+		if (!stream)
+		{
+			fprintf(stderr, "Unable to open '%s'\n", input.c_str());
+			return 1;
+		}
+
+		YAML::Node data = YAML::Load(stream);
+		std::unordered_set<std::string> serials;
+		for (const auto& node : data)
+		{
+			try
+			{
+				// Serials are looked up lower-case, see YamlGameDatabaseImpl::initDatabase
+				std::string serial = strToLower(node.first.as<std::string>());
+				if (!serials.insert(serial).second)
+				{
+					fprintf(stderr, "Duplicate serial '%s' found in GameDB. Skipping, Serials are case-insensitive!\n", serial.c_str());
+					continue;
+				}
+				writer.AddEntry(entryFromYaml(writer, serial, node.second));
+			}
+			catch (const YAML::RepresentationException& e)
+			{
+				fprintf(stderr, "Invalid GameDB syntax detected. Error Details - %s\n", e.msg.c_str());
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "Error occured when reading '%s': %s\n", input.c_str(), e.what());
+		return 1;
+	}
+
+	const std::vector<uint8_t> data = writer.Build();
+	const bool header = output.size() > 2 && output.compare(output.size() - 2, 2, ".h") == 0;
+	if (!(header ? writeHeader(output, symbol, data) : writeBinary(output, data)))
+	{
+		fprintf(stderr, "Unable to write '%s'\n", output.c_str());
+		return 1;
+	}
+
+	printf("GameIndexCompiler: %zu entries, %zu strings, %zu bytes\n", writer.GetEntryCount(), writer.GetStringCount(), data.size());
+	return 0;
+}